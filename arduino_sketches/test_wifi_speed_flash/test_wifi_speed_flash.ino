@@ -20,12 +20,13 @@
 /* Builds up a normal wifi connection, caches BSSID, channel for a faster connection,
  * which additionally persists the channel encryption data for connections in O(200ms).
  * 
- * Caches 132 bytes in EEPROM/Flash at offset 0 (can be changed)
+ * Caches 136 bytes in EEPROM/Flash at offset 0 (can be changed)
  * 
- * Create your own secrets.h using the secrets_sample.h.
+ * Create your own secrets.h using the secrets_sample.h. Needs the WifiHelper
+ * library from lib/WifiHelper in the Arduino libraries folder.
  */
 #include "secrets.h"
-#include "wifi_helper.h"
+#include <WifiHelper.h>
 
 WifiHelper wh; // use wh(123) to set EEPROM offset
 
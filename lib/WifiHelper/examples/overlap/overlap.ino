@@ -0,0 +1,87 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Samples a sensor & builds the payload while WifiHelper connects, then
+ * publishes it; shows the time of each phase and from boot to publish
+ * as <key=value> tags, for serial_parse.py or serial_collect.
+ *
+ * Build with -DSAMPLE_FIRST to sample before connecting instead, to
+ * compare.
+ *
+ * Create your own secrets.h with WIFI_SSID, WIFI_AUTH, MQTT_SERVER,
+ * MQTT_SERVER_PORT, MQTT_USER, MQTT_AUTH & MQTT_CLIENT_ID.
+ */
+#include <Arduino.h>
+#include <WifiHelper.h>
+#include "secrets.h"
+
+#define SAMPLES 64
+#define SAMPLE_MS 2 // e.g. a slow I2C sensor
+
+WifiHelper wh; // use wh(123) to set EEPROM offset, or wh.setStore() for another store
+
+static const char *phase_names[] = {
+  "wh_idle", "wh_fast", "wh_recover", "wh_slow", "wh_preconnect", "wh_mqtt", "wh_done", "wh_failed"
+};
+
+static void show_phase(WIFI_HELPER_STATE phase, bool ok, uint32_t ms) {
+  Serial.printf("<%s=%u><%s_ok=%s>\n", phase_names[phase], ms, phase_names[phase], ok ? "true" : "false");
+}
+
+/* Average of the ADC, polling WifiHelper between the samples
+ */
+static uint32_t sample_sensor(bool poll) {
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < SAMPLES; i++) {
+    sum += analogRead(A0);
+    delay(SAMPLE_MS);
+    if (poll) wh.poll();
+  }
+  return sum / SAMPLES;
+}
+
+void setup() {
+  uint32_t ts_start = millis();
+  wh.setup();
+  Serial.begin(115200);
+  Serial.println("\n<start>");
+  wh.onPhase(show_phase);
+  wh.setBroker(MQTT_SERVER, MQTT_SERVER_PORT, MQTT_CLIENT_ID, MQTT_USER, MQTT_AUTH);
+  char payload[16];
+  #ifdef SAMPLE_FIRST
+  snprintf(payload, sizeof(payload), "%u", sample_sensor(false));
+  wh.begin(WIFI_SSID, WIFI_AUTH);
+  #else
+  wh.begin(WIFI_SSID, WIFI_AUTH);
+  snprintf(payload, sizeof(payload), "%u", sample_sensor(true));
+  #endif
+  wh.publish("sensor/adc", payload);
+  while (!wh.done()) {
+    wh.poll();
+    delay(1);
+  }
+  Serial.printf("<wake_to_publish=%lu><mqtt_ok=%s>\n", millis() - ts_start,
+    (wh.poll() == WH_DONE) ? "true" : "false");
+  Serial.println("<complete>");
+}
+
+void loop() {
+  delay(1000); // wait, reboot, try again.
+  ESP.restart();
+}
@@ -0,0 +1,410 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#include <EEPROM.h>
+extern "C" {
+#include <user_interface.h>
+}
+#include "WifiHelper.h"
+
+#define MQTT_CONNECT    0x10
+#define MQTT_CONNACK    0x20
+#define MQTT_PUBLISH    0x30
+#define MQTT_DISCONNECT 0xE0
+#define MQTT_CLEAN_SESSION 0x02
+#define MQTT_PASSWORD      0x40
+#define MQTT_USERNAME      0x80
+#define MQTT_KEEPALIVE 15 // seconds, same as PubSubClient
+
+/* constructor, the settings go to EEPROM at this offset unless
+ * setStore() says otherwise
+ */
+WifiHelper::WifiHelper(int eeprom_offset) : _eeprom_offset(eeprom_offset),
+  _store_load(NULL), _store_save(NULL), _dirty(false),
+  _state(WH_IDLE), _host(NULL), _client_id(NULL), _user(NULL), _pass(NULL), _port(0),
+  _msg_count(0), _msg_last(false), _dns_pending(false), _dns_ip(0) {
+}
+
+/* Setup function to call as first step
+ */
+void WifiHelper::setup() {
+  WiFi.setAutoConnect(false); // prevent early autoconnect
+}
+
+/* Keep the settings somewhere else than EEPROM; call before begin()
+ */
+void WifiHelper::setStore(WifiHelperLoad load, WifiHelperSave save) {
+  _store_load = load;
+  _store_save = save;
+}
+
+/* MQTT broker to publish to; without one, it's done once connected.
+ * The strings have to stay around until done().
+ */
+void WifiHelper::setBroker(const char *host, uint16_t port, const char *client_id,
+    const char *user, const char *pass) {
+  _host = host;
+  _port = port;
+  _client_id = client_id;
+  _user = user;
+  _pass = pass;
+}
+
+/* Called whenever a phase ends
+ */
+void WifiHelper::onPhase(WifiHelperCallback callback) {
+  _callback = callback;
+}
+
+/* Start connecting; returns right away, call poll() until done()
+ */
+void WifiHelper::begin(const char *ssid, const char *auth) {
+  _msg_count = 0;
+  _msg_last = false;
+  _dirty = false;
+  _looked_up = _mqtt_sent = false;
+  _connack_len = 0;
+  _fast_start = millis();
+  bool have_bssid = false;
+  if (_load_settings() && !strcmp(_settings.wifi_ssid, ssid) && !strcmp(_settings.wifi_auth, auth)) {
+    for (uint8_t i = 0; i < 6; i++) have_bssid |= (_settings.wifi_bssid[i] != 0);
+  } else {
+    _init_settings(ssid, auth);
+  }
+  _enter((have_bssid && _settings.wifi_channel) ? WH_FAST : WH_SLOW);
+}
+
+/* Queue a message for the MQTT phase, which starts after the last one;
+ * false if the queue is full
+ */
+bool WifiHelper::publish(const char *topic, const char *payload, bool last) {
+  if (_msg_count >= WH_MSG_MAX) return false;
+  _topics[_msg_count] = topic;
+  _payloads[_msg_count] = payload;
+  _msg_count++;
+  _msg_last = last;
+  return true;
+}
+
+/* Move on as far as possible without waiting; returns the state
+ */
+WIFI_HELPER_STATE WifiHelper::poll() {
+  switch (_state) {
+    case WH_FAST: _poll_fast(); break;
+    case WH_RECOVER: _poll_recover(); break;
+    case WH_SLOW: _poll_slow(); break;
+    case WH_PRECONNECT: _poll_preconnect(); break;
+    case WH_MQTT: _poll_mqtt(); break;
+    default: break;
+  }
+  return _state;
+}
+
+bool WifiHelper::done() {
+  return (_state == WH_DONE) || (_state == WH_FAILED);
+}
+
+bool WifiHelper::connected() {
+  return WiFi.status() == WL_CONNECTED;
+}
+
+/* Connect to wifi as specified, returns true if ok; blocks, like before
+ */
+bool WifiHelper::connect(const char *ssid, const char *auth) {
+  begin(ssid, auth);
+  while (!done()) {
+    poll();
+    delay(5);
+  }
+  return connected();
+}
+
+/* reset settings structure
+ */
+void WifiHelper::_init_settings(const char *ssid, const char *auth) {
+  memset(&_settings, 0, sizeof(WIFI_HELPER_SETTINGS_T));
+  _settings.magic = WIFI_HELPER_MAGIC;
+  strncpy(_settings.wifi_ssid, ssid, sizeof(_settings.wifi_ssid)-1);
+  strncpy(_settings.wifi_auth, auth, sizeof(_settings.wifi_auth)-1);
+  _dirty = true;
+}
+
+/* load settings from the store, or from EEPROM: straight from its
+ * buffer into ours, end() frees it again with nothing to write back
+ */
+bool WifiHelper::_load_settings() {
+  if (_store_load) {
+    if (!_store_load(&_settings, sizeof(_settings))) return false;
+  } else {
+    if (_eeprom_offset + sizeof(_settings) > WH_EEPROM_SIZE) return false;
+    EEPROM.begin(WH_EEPROM_SIZE);
+    memcpy(&_settings, EEPROM.getConstDataPtr() + _eeprom_offset, sizeof(_settings));
+    EEPROM.end();
+  }
+  return (_settings.magic == WIFI_HELPER_MAGIC);
+}
+
+/* save settings to the store, or to EEPROM; its buffer is only touched,
+ * and the sector only written, when the settings differ
+ */
+bool WifiHelper::_save_settings() {
+  if (_store_save) return _store_save(&_settings, sizeof(_settings));
+  if (_eeprom_offset + sizeof(_settings) > WH_EEPROM_SIZE) return false;
+  EEPROM.begin(WH_EEPROM_SIZE);
+  if (memcmp(EEPROM.getConstDataPtr() + _eeprom_offset, &_settings, sizeof(_settings)))
+    memcpy(EEPROM.getDataPtr() + _eeprom_offset, &_settings, sizeof(_settings));
+  EEPROM.end();
+  return true;
+}
+
+/* Start a phase
+ */
+void WifiHelper::_enter(WIFI_HELPER_STATE state) {
+  _state = state;
+  _phase_start = millis();
+  if (state == WH_FAST) {
+    WiFi.persistent(true);
+    WiFi.mode(WIFI_STA);
+    WiFi.config(_settings.ip_address, _settings.ip_gateway, _settings.ip_mask,
+      _settings.ip_dns1, _settings.ip_dns2);
+    WiFi.begin(_settings.wifi_ssid, _settings.wifi_auth, _settings.wifi_channel, _settings.wifi_bssid, true);
+  } else if (state == WH_RECOVER) {
+    static const uint8_t common[] = { 1, 6, 11 };
+    wifi_station_disconnect(); // keeps the station config, unlike WiFi.disconnect()
+    _channel_count = _channel_pos = 0;
+    _recover_connecting = false;
+    uint8_t candidates[1 + sizeof(common) + WH_CHANNEL_MAX];
+    uint8_t n = 0;
+    candidates[n++] = _settings.wifi_channel;
+    for (uint8_t i = 0; i < sizeof(common); i++) candidates[n++] = common[i];
+    for (uint8_t ch = 1; ch <= WH_CHANNEL_MAX; ch++) candidates[n++] = ch;
+    for (uint8_t i = 0; i < n; i++) {
+      if (!candidates[i] || candidates[i] > WH_CHANNEL_MAX) continue;
+      if (memchr(_channels, candidates[i], _channel_count)) continue;
+      _channels[_channel_count++] = candidates[i];
+    }
+    _scan_next();
+  } else if (state == WH_SLOW) {
+    WiFi.persistent(true);
+    WiFi.mode(WIFI_STA);
+    WiFi.config(0u, 0u, 0u); // back to DHCP
+    WiFi.begin(_settings.wifi_ssid, _settings.wifi_auth, 0, NULL, true);
+  } else if ((state == WH_DONE) || (state == WH_FAILED)) {
+    if (_dirty) _save_settings(); // the radio is idle by now
+    _dirty = false;
+  }
+}
+
+/* The current phase is over, go on with the next one
+ */
+void WifiHelper::_end_phase(bool ok, WIFI_HELPER_STATE next) {
+  if (_callback) _callback(_state, ok, millis() - _phase_start);
+  _enter(next);
+}
+
+/* Connected: cache what we got, then on to the broker if there is one
+ */
+void WifiHelper::_connected() {
+  WIFI_HELPER_SETTINGS_T was = _settings;
+  _settings.ip_address = WiFi.localIP();
+  _settings.ip_gateway = WiFi.gatewayIP();
+  _settings.ip_mask = WiFi.subnetMask();
+  _settings.ip_dns1 = WiFi.dnsIP(0);
+  _settings.ip_dns2 = WiFi.dnsIP(1);
+  memcpy(_settings.wifi_bssid, WiFi.BSSID(), 6);
+  _settings.wifi_channel = WiFi.channel();
+  if (memcmp(&was, &_settings, sizeof(was))) _dirty = true;
+  _end_phase(true, _host ? WH_PRECONNECT : WH_DONE);
+}
+
+/* Scan the next channel for our SSID in the background; false when
+ * there are no more
+ */
+bool WifiHelper::_scan_next() {
+  if (_channel_pos >= _channel_count) return false;
+  WiFi.scanNetworks(true, false, _channels[_channel_pos++], (uint8_t *)_settings.wifi_ssid);
+  return true;
+}
+
+void WifiHelper::_poll_fast() {
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED) { _connected(); return; }
+  // with BSSID & channel given, the SDK says so when the AP isn't there
+  bool gone = (status == WL_NO_SSID_AVAIL) || (status == WL_CONNECT_FAILED);
+  if (gone || (millis() - _fast_start > WH_FAST_TIMEOUT)) _end_phase(false, WH_RECOVER);
+}
+
+/* One channel at a time; the first one with our SSID wins, the cached
+ * BSSID over the strongest other one
+ */
+void WifiHelper::_poll_recover() {
+  bool over = (millis() - _fast_start > WH_FAST_TIMEOUT);
+  if (_recover_connecting) {
+    wl_status_t status = WiFi.status();
+    if (status == WL_CONNECTED) { _connected(); return; }
+    if (over || (status == WL_NO_SSID_AVAIL) || (status == WL_CONNECT_FAILED)) _end_phase(false, WH_SLOW);
+    return;
+  }
+  int8_t n = WiFi.scanComplete();
+  if (n == WIFI_SCAN_RUNNING) {
+    if (over) _end_phase(false, WH_SLOW);
+    return;
+  }
+  int8_t best = -1;
+  for (int8_t i = 0; i < n; i++) {
+    if (WiFi.SSID(i) != _settings.wifi_ssid) continue;
+    if (!memcmp(WiFi.BSSID(i), _settings.wifi_bssid, 6)) { best = i; break; }
+    if ((best < 0) || (WiFi.RSSI(i) > WiFi.RSSI(best))) best = i;
+  }
+  if (best >= 0) {
+    memcpy(_settings.wifi_bssid, WiFi.BSSID(best), 6);
+    _settings.wifi_channel = WiFi.channel(best);
+    _dirty = true;
+    WiFi.scanDelete();
+    WiFi.begin(_settings.wifi_ssid, _settings.wifi_auth, _settings.wifi_channel, _settings.wifi_bssid, true);
+    _recover_connecting = true;
+    return;
+  }
+  WiFi.scanDelete();
+  if (over || !_scan_next()) _end_phase(false, WH_SLOW);
+}
+
+void WifiHelper::_poll_slow() {
+  if (WiFi.status() == WL_CONNECTED) { _connected(); return; }
+  if (millis() - _phase_start > WH_SLOW_TIMEOUT) _end_phase(false, WH_FAILED);
+}
+
+/* Look the broker up in the background; _dns_pending goes back to false
+ * with _dns_ip set, or 0 when it failed
+ */
+void WifiHelper::_lookup() {
+  ip_addr_t addr;
+  _looked_up = true;
+  _dns_ip = 0;
+  _dns_start = millis();
+  _dns_pending = true;
+  err_t err = dns_gethostbyname(_host, &addr, _dns_found, this);
+  if (err == ERR_OK) _dns_ip = ip_addr_get_ip4_u32(&addr); // cached, or an address
+  if (err != ERR_INPROGRESS) _dns_pending = false;
+}
+
+/* lwIP calls this from the SDK, during delay() or yield()
+ */
+void WifiHelper::_dns_found(const char *name, const ip_addr_t *ipaddr, void *arg) {
+  (void)name;
+  WifiHelper *wh = (WifiHelper *)arg;
+  wh->_dns_ip = ipaddr ? ip_addr_get_ip4_u32(ipaddr) : 0;
+  wh->_dns_pending = false;
+}
+
+/* TCP to the broker, with the cached address if there is one. When that
+ * doesn't answer, the name is looked up and tried once more if it moved;
+ * a failed lookup keeps the known-good address for next time.
+ */
+void WifiHelper::_poll_preconnect() {
+  if (_dns_pending) {
+    if (millis() - _dns_start > WH_DNS_TIMEOUT) _end_phase(false, WH_FAILED);
+    return;
+  }
+  if (_looked_up) {
+    if (!_dns_ip || (_dns_ip == _settings.mqtt_ip)) { _end_phase(false, WH_FAILED); return; }
+    _settings.mqtt_ip = _dns_ip;
+    _dirty = true;
+  } else if (!_settings.mqtt_ip) {
+    _lookup();
+    return;
+  }
+  if (_client.connect(IPAddress(_settings.mqtt_ip), _port)) _end_phase(true, WH_MQTT);
+  else if (!_looked_up) _lookup();
+  else _end_phase(false, WH_FAILED);
+}
+
+/* MQTT 3.1.1 packet building; the remaining length fits in 2 bytes, the
+ * buffer is smaller than 16kB
+ */
+static void mqtt_bytes(uint8_t *buf, uint16_t *len, const void *data, uint16_t n) {
+  if (*len + n > WH_MQTT_BUF) { *len = WH_MQTT_BUF + 1; return; } // overflow, stays
+  memcpy(&buf[*len], data, n);
+  *len += n;
+}
+
+static void mqtt_header(uint8_t *buf, uint16_t *len, uint8_t type, uint32_t remaining) {
+  uint8_t head[3] = { type, (uint8_t)(remaining & 0x7F), (uint8_t)(remaining >> 7) };
+  if (remaining > 0x7F) head[1] |= 0x80;
+  mqtt_bytes(buf, len, head, (remaining > 0x7F) ? 3 : 2);
+}
+
+static void mqtt_string(uint8_t *buf, uint16_t *len, const char *s) {
+  uint16_t n = strlen(s);
+  uint8_t be[2] = { (uint8_t)(n >> 8), (uint8_t)n };
+  mqtt_bytes(buf, len, be, 2);
+  mqtt_bytes(buf, len, s, n);
+}
+
+/* CONNECT, the PUBLISHes (QoS0) & DISCONNECT in one segment: the broker
+ * handles a connection's packets in order, and still sends the CONNACK
+ */
+bool WifiHelper::_send_mqtt() {
+  static const uint8_t variable[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+  uint8_t buf[WH_MQTT_BUF];
+  uint16_t len = 0;
+  uint8_t flags = MQTT_CLEAN_SESSION;
+  uint32_t remaining = sizeof(variable) + 1 + 2 + 2 + strlen(_client_id);
+  if (_user) { flags |= MQTT_USERNAME; remaining += 2 + strlen(_user); }
+  if (_user && _pass) { flags |= MQTT_PASSWORD; remaining += 2 + strlen(_pass); }
+  uint8_t tail[3] = { flags, MQTT_KEEPALIVE >> 8, MQTT_KEEPALIVE & 0xFF };
+  mqtt_header(buf, &len, MQTT_CONNECT, remaining);
+  mqtt_bytes(buf, &len, variable, sizeof(variable));
+  mqtt_bytes(buf, &len, tail, sizeof(tail));
+  mqtt_string(buf, &len, _client_id);
+  if (flags & MQTT_USERNAME) mqtt_string(buf, &len, _user);
+  if (flags & MQTT_PASSWORD) mqtt_string(buf, &len, _pass);
+  for (uint8_t i = 0; i < _msg_count; i++) {
+    mqtt_header(buf, &len, MQTT_PUBLISH, 2 + _topics[i].length() + _payloads[i].length());
+    mqtt_string(buf, &len, _topics[i].c_str());
+    mqtt_bytes(buf, &len, _payloads[i].c_str(), _payloads[i].length());
+  }
+  mqtt_header(buf, &len, MQTT_DISCONNECT, 0);
+  if (len > WH_MQTT_BUF) return false;
+  _client.setNoDelay(true);
+  return _client.write(buf, len) == len;
+}
+
+/* Waits for the last message and sends everything, then for the CONNACK
+ */
+void WifiHelper::_poll_mqtt() {
+  if (!_mqtt_sent) {
+    if (!_msg_last) {
+      if (millis() - _phase_start > WH_MQTT_TIMEOUT) { _client.stop(); _end_phase(false, WH_FAILED); }
+      return;
+    }
+    if (!_send_mqtt()) { _client.stop(); _end_phase(false, WH_FAILED); return; }
+    _mqtt_sent = true;
+    _mqtt_sent_ms = millis();
+  }
+  while ((_connack_len < sizeof(_connack)) && _client.available()) _connack[_connack_len++] = _client.read();
+  if (_connack_len == sizeof(_connack)) {
+    bool ok = (_connack[0] == MQTT_CONNACK) && (_connack[1] == 2) && (_connack[3] == 0);
+    _client.stop();
+    _end_phase(ok, ok ? WH_DONE : WH_FAILED);
+  } else if (!_client.connected() || (millis() - _mqtt_sent_ms > WH_CONNACK_TIMEOUT)) {
+    _client.stop();
+    _end_phase(false, WH_FAILED);
+  }
+}
@@ -0,0 +1,144 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Wifi & MQTT connection as a state machine: begin() starts it, poll()
+ * moves it on without blocking, so the sketch can sample sensors and
+ * build its payload while the radio associates.
+ *
+ *   WH_FAST        WiFi.begin() with the cached BSSID, channel & IP
+ *   WH_RECOVER     the cached AP wasn't there: scan for the SSID channel
+ *                  by channel (cached, 1/6/11, the rest), then connect
+ *                  to what was found
+ *   WH_SLOW        plain WiFi.begin() with SSID & auth, DHCP
+ *   WH_PRECONNECT  TCP to the cached broker address; the name is looked
+ *                  up in the background when there is none, or when the
+ *                  cached one doesn't answer
+ *   WH_MQTT        once the last message is queued: CONNECT, PUBLISHes
+ *                  & DISCONNECT in one write, then wait for the CONNACK
+ *
+ * poll() only ever waits for the TCP handshake, one round trip: the
+ * core has no connect() that returns before it's done.
+ *
+ * Each phase that ends calls the phase callback with how long it took.
+ * The settings are saved at the end, when anything changed: to EEPROM,
+ * or to the store given with setStore().
+ */
+
+#ifndef WIFI_HELPER_H
+#define WIFI_HELPER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <lwip/dns.h>
+#include <functional>
+
+struct WIFI_HELPER_SETTINGS_T {
+  uint16_t magic;
+  uint32_t ip_address;
+  uint32_t ip_gateway;
+  uint32_t ip_mask;
+  uint32_t ip_dns1;
+  uint32_t ip_dns2;
+  char wifi_ssid[50];
+  char wifi_auth[50];
+  uint8_t wifi_bssid[6];
+  uint16_t wifi_channel;
+  uint32_t mqtt_ip; // broker address, resolved once
+}; // size = 136 bytes
+
+const uint16_t WIFI_HELPER_MAGIC = 0xF3EE;
+
+enum WIFI_HELPER_STATE {
+  WH_IDLE, WH_FAST, WH_RECOVER, WH_SLOW, WH_PRECONNECT, WH_MQTT, WH_DONE, WH_FAILED
+};
+
+#define WH_FAST_TIMEOUT 5000 // ms, incl. recovery
+#define WH_SLOW_TIMEOUT 15000 // ms
+#define WH_DNS_TIMEOUT 5000 // ms, for the broker's name
+#define WH_MQTT_TIMEOUT 5000 // ms, waiting for the last message after the preconnect
+#define WH_CONNACK_TIMEOUT 5000 // ms
+#define WH_MQTT_BUF 256 // CONNECT, PUBLISHes & DISCONNECT, on the stack
+#define WH_MSG_MAX 4 // queued messages
+#define WH_CHANNEL_MAX 13
+
+#define WH_EEPROM_SIZE 256 // EEPROM.begin() size, offset + settings must fit
+
+// a store for the settings: load() is false when there's no valid record,
+// save() writes one; the firmware's SETTINGS_STORE_T (src/store.h) has
+// the same load & save, e.g. setStore(store_rtc.load, store_rtc.save)
+typedef bool (*WifiHelperLoad)(void *data, uint16_t size);
+typedef bool (*WifiHelperSave)(const void *data, uint16_t size);
+
+// phase that ended, whether it worked, its time in ms
+typedef std::function<void(WIFI_HELPER_STATE phase, bool ok, uint32_t ms)> WifiHelperCallback;
+
+class WifiHelper {
+  public:
+    WifiHelper(int eeprom_offset = 0);
+    void setup();
+    void setStore(WifiHelperLoad load, WifiHelperSave save);
+    void setBroker(const char *host, uint16_t port, const char *client_id,
+      const char *user = NULL, const char *pass = NULL);
+    void onPhase(WifiHelperCallback callback);
+    void begin(const char *ssid, const char *auth);
+    bool publish(const char *topic, const char *payload, bool last = true);
+    WIFI_HELPER_STATE poll();
+    bool done();
+    bool connected();
+    bool connect(const char *ssid, const char *auth);
+  private:
+    void _init_settings(const char *ssid, const char *auth);
+    bool _load_settings();
+    bool _save_settings();
+    void _enter(WIFI_HELPER_STATE state);
+    void _end_phase(bool ok, WIFI_HELPER_STATE next);
+    void _connected();
+    bool _scan_next();
+    void _poll_fast();
+    void _poll_recover();
+    void _poll_slow();
+    void _lookup();
+    static void _dns_found(const char *name, const ip_addr_t *ipaddr, void *arg);
+    bool _send_mqtt();
+    void _poll_preconnect();
+    void _poll_mqtt();
+    struct WIFI_HELPER_SETTINGS_T _settings;
+    int _eeprom_offset;
+    WifiHelperLoad _store_load;
+    WifiHelperSave _store_save;
+    bool _dirty;
+    WIFI_HELPER_STATE _state;
+    uint32_t _phase_start, _fast_start;
+    uint8_t _channels[WH_CHANNEL_MAX], _channel_count, _channel_pos;
+    bool _recover_connecting;
+    const char *_host, *_client_id, *_user, *_pass;
+    uint16_t _port;
+    String _topics[WH_MSG_MAX], _payloads[WH_MSG_MAX];
+    uint8_t _msg_count;
+    bool _msg_last;
+    WifiHelperCallback _callback;
+    WiFiClient _client;
+    volatile bool _dns_pending; // set back by _dns_found()
+    volatile uint32_t _dns_ip;
+    bool _looked_up, _mqtt_sent;
+    uint32_t _dns_start, _mqtt_sent_ms;
+    uint8_t _connack[4], _connack_len;
+};
+
+#endif
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+# encoding: utf8
+
+# MIT License / (C) johnmu
+
+# RAM & flash footprint of a build, by module, and a check against a
+# saved baseline.
+#
+# The sections of every object file in the build directory are summed
+# per module: each file in src/, and each library or the core as one.
+# The totals come from the linked program, which also has the SDK libs
+# and misses what the linker dropped; the difference shows as "other".
+# On the ESP8266, .data, .rodata & .bss are all in the ~80kB of RAM, the
+# heap is what's left; code is in flash (.irom0.text) unless it has to be
+# in the 32kB of IRAM (.text); PROGMEM strings are in flash.
+#
+#   scripts/footprint.py .pio/build/esp01 --size xtensa-lx106-elf-size
+#   scripts/footprint.py .pio/build/esp01 -b footprint/esp01.tsv   # check
+#   scripts/footprint.py .pio/build/esp01 -b footprint/esp01.tsv --save
+#
+# scripts/footprint_pio.py runs this after every PlatformIO build.
+
+import sys, os, argparse, subprocess
+
+KINDS = ["data", "rodata", "bss", "iram", "flash"]
+RAM = ["data", "rodata", "bss"]
+
+# parse commandline arguments
+def parse_args(argv=None):
+    description = "RAM & flash footprint of a build, by module."
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('build',
+                        help="Build directory with the object files, e.g. .pio/build/esp01")
+    parser.add_argument('-p', '--program', type=str,
+                        help="Linked program, defaults to firmware.elf or program in the build directory")
+    parser.add_argument('--size', type=str, default="size",
+                        help="size tool of the toolchain, defaults to size")
+    parser.add_argument('-o', '--output', type=str,
+                        help="Also write the report to this file")
+    parser.add_argument('-b', '--baseline', type=str,
+                        help="TSV of a previous build to compare with")
+    parser.add_argument('--save', action="store_true",
+                        help="Write this build as the new baseline")
+    parser.add_argument('-t', '--tolerance', type=int, default=64,
+                        help="Bytes RAM, IRAM or flash may grow before it's a regression, defaults to 64")
+    return parser.parse_args(argv)
+
+# {section: size} from "size -A"
+def sections(size_tool, filename):
+    out = subprocess.run([size_tool, "-A", filename], check=True, stdout=subprocess.PIPE,
+                         universal_newlines=True).stdout
+    result = {}
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            result[parts[0]] = result.get(parts[0], 0) + int(parts[1])
+    return result
+
+# what an object file's section ends up as; unnamed .text goes to flash
+# on the ESP8266, only IRAM_ATTR code is in .iram*
+def object_kind(name):
+    if name.startswith(".iram"): return "iram"
+    if name.startswith((".irom", ".text", ".literal")): return "flash"
+    if name.startswith(".rodata"): return "rodata"
+    if name.startswith((".data", ".sdata")): return "data"
+    if name.startswith((".bss", ".sbss")) or name == "COMMON": return "bss"
+    return None
+
+# same for the linked program, where .text is IRAM if there is an
+# .irom0.text; a host build only has .text
+def program_kind(name, esp):
+    if name.startswith(".irom0"): return "flash"
+    if name.startswith((".text", ".iram")): return "iram" if esp else "flash"
+    if name.startswith(".rodata"): return "rodata"
+    if name.startswith(".data"): return "data"
+    if name.startswith((".bss", ".noinit")): return "bss"
+    return None
+
+def empty():
+    return dict((k, 0) for k in KINDS)
+
+# src/main.cpp.o -> main.cpp, libs & the core as one module each
+def module_name(build, path):
+    rel = os.path.relpath(path, build)[:-2]
+    parts = rel.split(os.sep)
+    if parts[0] == "src":
+        return "/".join(parts[1:])
+    if parts[0].startswith("lib") and len(parts) > 2:
+        return parts[1]
+    return parts[0]
+
+def measure(args):
+    modules = {}
+    for root, dirs, files in os.walk(args.build):
+        for f in sorted(files):
+            if not f.endswith(".o"): continue
+            path = os.path.join(root, f)
+            m = modules.setdefault(module_name(args.build, path), empty())
+            for name, size in sections(args.size, path).items():
+                kind = object_kind(name)
+                if kind: m[kind] += size
+    program = args.program
+    if not program:
+        for name in ("firmware.elf", "program"):
+            if os.path.exists(os.path.join(args.build, name)):
+                program = os.path.join(args.build, name)
+                break
+    total = None
+    if program:
+        secs = sections(args.size, program)
+        esp = any(s.startswith(".irom0") for s in secs)
+        total = empty()
+        for name, size in secs.items():
+            kind = program_kind(name, esp)
+            if kind: total[kind] += size
+        summed = empty()
+        for m in modules.values():
+            for k in KINDS: summed[k] += m[k]
+        modules["(other)"] = dict((k, total[k] - summed[k]) for k in KINDS)
+    else:
+        total = empty()
+        for m in modules.values():
+            for k in KINDS: total[k] += m[k]
+    return modules, total
+
+def ram(m):
+    return sum(m[k] for k in RAM)
+
+def report(modules, total):
+    lines = ["%-28s %8s %8s %8s %8s %8s %8s" % ("module", "data", "rodata", "bss", "ram", "iram", "flash")]
+    for name in sorted(modules, key=lambda n: (n == "(other)", -ram(modules[n]), n)):
+        m = modules[name]
+        lines.append("%-28s %8d %8d %8d %8d %8d %8d" % (name, m["data"], m["rodata"], m["bss"], ram(m), m["iram"], m["flash"]))
+    lines.append("%-28s %8d %8d %8d %8d %8d %8d" % ("TOTAL", total["data"], total["rodata"], total["bss"], ram(total), total["iram"], total["flash"]))
+    return "\n".join(lines) + "\n"
+
+def write_tsv(filename, modules, total):
+    os.makedirs(os.path.dirname(os.path.abspath(filename)), exist_ok=True)
+    with open(filename, "w") as f:
+        f.write("module\t" + "\t".join(KINDS) + "\n")
+        for name in sorted(modules):
+            f.write(name + "\t" + "\t".join(str(modules[name][k]) for k in KINDS) + "\n")
+        f.write("TOTAL\t" + "\t".join(str(total[k]) for k in KINDS) + "\n")
+
+def read_tsv(filename):
+    modules = {}
+    with open(filename) as f:
+        header = f.readline().rstrip("\n").split("\t")[1:]
+        for line in f:
+            parts = line.rstrip("\n").split("\t")
+            modules[parts[0]] = dict((k, int(v)) for k, v in zip(header, parts[1:]))
+    return modules.pop("TOTAL"), modules
+
+# the regressions, as text; modules that grew are named as a hint
+def compare(modules, total, base_modules, base_total, tolerance):
+    problems = []
+    for label, get in (("RAM", ram), ("IRAM", lambda m: m["iram"]), ("flash", lambda m: m["flash"])):
+        growth = get(total) - get(base_total)
+        if growth <= tolerance: continue
+        grew = []
+        for name, m in modules.items():
+            d = get(m) - get(base_modules.get(name, empty()))
+            if d > 0: grew.append((d, name))
+        grew.sort(reverse=True)
+        problems.append("%s grew by %d bytes to %d (tolerance %d): %s" % (label, growth, get(total), tolerance,
+                        ", ".join("%s +%d" % (n, d) for d, n in grew[:5]) or "no module"))
+    return problems
+
+def main(argv=None):
+    args = parse_args(argv)
+    modules, total = measure(args)
+    text = report(modules, total)
+    print(text, end="")
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    if not args.baseline:
+        return 0
+    if args.save or not os.path.exists(args.baseline):
+        write_tsv(args.baseline, modules, total)
+        print("baseline saved to %s" % args.baseline)
+        return 0
+    base_total, base_modules = read_tsv(args.baseline)
+    print("vs. %s: RAM %+d, IRAM %+d, flash %+d" % (args.baseline, ram(total) - ram(base_total),
+          total["iram"] - base_total["iram"], total["flash"] - base_total["flash"]))
+    problems = compare(modules, total, base_modules, base_total, args.tolerance)
+    for p in problems:
+        print("footprint regression: " + p)
+    if problems:
+        print("if that's intended, save the new baseline with --save")
+        return 1
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,34 @@
+# MIT License / (C) johnmu
+
+# PlatformIO extra script: after the program is linked, write the
+# footprint report (scripts/footprint.py) to footprint.txt in the build
+# directory, and fail the build if RAM, IRAM or flash grew against
+# footprint/<env>.tsv. Without that file, or with FOOTPRINT_SAVE=1 in
+# the environment, the build becomes the new baseline.
+#
+#   extra_scripts = post:scripts/footprint_pio.py
+
+Import("env")
+
+import os, sys
+
+sys.path.insert(0, os.path.join(env.subst("$PROJECT_DIR"), "scripts"))
+import footprint
+
+def size_tool():
+    tool = env.subst("$SIZETOOL")
+    if tool: return tool
+    cc = env.subst("$CC")
+    return cc[:-3] + "size" if cc.endswith("gcc") else "size"
+
+def report(source, target, env):
+    build = env.subst("$BUILD_DIR")
+    baseline = os.path.join(env.subst("$PROJECT_DIR"), "footprint", env.subst("$PIOENV") + ".tsv")
+    argv = [build, "-p", target[0].get_abspath(), "--size", size_tool(),
+            "-o", os.path.join(build, "footprint.txt"), "-b", baseline]
+    if os.environ.get("FOOTPRINT_SAVE"):
+        argv.append("--save")
+    if footprint.main(argv):
+        env.Exit(1)
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}$PROGSUFFIX", report)
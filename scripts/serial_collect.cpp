@@ -0,0 +1,482 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Collect <key=value> rows from many ESP-01s at once
+ *
+ * Like serial_parse.py, but for a rack of boards: every port is read in
+ * chunks through one epoll loop, parsed incrementally, and the rows of
+ * all boards go to one buffered TSV with a "device" column. Binary
+ * telemetry frames (src/telemetry.h) are decoded too; a board is asked
+ * for the field names when it's opened, and when a record has an id
+ * with no name. The field list & names files are the same as
+ * serial_parse.py's.
+ *
+ * Every row also goes into the statistics of stream_stats.h, reported
+ * every -r seconds & at the end; -c picks the fields strategies are
+ * compared by, -t reads the rows of an earlier TSV first, and -l stops
+ * once that many rows came in from all boards together.
+ *
+ * Build:  g++ -std=gnu++11 -O2 -Wall -o serial_collect scripts/serial_collect.cpp scripts/stream_stats.cpp
+ * Usage:  serial_collect [-b baud] [-s stats.tsv] [-f fields.txt]
+ *                        [-n names.txt] [-r seconds] [-c field]...
+ *                        [-t old.tsv]... [-l rows] [-v] [device...]
+ *
+ * A device can be any tty, e.g. a pseudo-terminal for testing.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "stream_stats.h"
+
+#define READ_CHUNK 4096
+#define FLUSH_EVERY_S 2 // write buffered rows at least this often
+#define MAX_TEXT_TAG 512 // longer "<..." runs are noise, not a tag
+#define MAX_FRAME 203 // TELEMETRY_FRAME_MAX + 3 of src/telemetry.h, COBS & crc included
+#define NAMES_REQUEST 0x05 // TELEMETRY_NAMES_REQUEST of src/telemetry.h
+
+struct DEVICE_T {
+	std::string name;
+	int fd;
+	std::string line;		// text since the last '<', or the last newline
+	std::string frame;		// COBS bytes since a 0x00
+	bool in_frame;
+	std::map<std::string, std::string> row;
+	uint32_t rows;
+	uint32_t bad_frames;
+	bool tty;		// can be asked for the field names
+	bool asked;		// during this boot
+};
+
+static std::vector<std::string> g_fieldnames;
+static std::map<uint32_t, std::string> g_names;
+static const char *g_fields_file = "__fields.txt";
+static const char *g_stats_file = "__stats.csv";
+static const char *g_names_file = "__telemetry_names.txt";
+static FILE *g_stats = NULL;
+static bool g_verbose = false;
+static volatile sig_atomic_t g_break = 0;
+static uint64_t g_rows = 0, g_row_limit = 0;
+
+static void stop_processing(int sig) { (void)sig; g_break = 1; }
+
+/* Same as telemetry_id() on the device
+ */
+static uint32_t telemetry_id(const std::string &key) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < key.size(); i++) { h ^= (uint8_t)key[i]; h *= 16777619u; }
+	return (h ^ (h >> 19)) & ((1u << 19) - 1);
+}
+
+static void read_field_file() {
+	FILE *f = fopen(g_fields_file, "r");
+	if (!f) return;
+	char buf[256];
+	while (fgets(buf, sizeof(buf), f)) {
+		std::string s(buf);
+		while (!s.empty() && (s[s.size()-1] == '\n' || s[s.size()-1] == '\r' || s[s.size()-1] == ' ')) s.resize(s.size() - 1);
+		if (!s.empty()) g_fieldnames.push_back(s);
+	}
+	fclose(f);
+}
+
+static void save_field_file() {
+	FILE *f = fopen(g_fields_file, "w");
+	if (!f) { perror(g_fields_file); return; }
+	for (size_t i = 0; i < g_fieldnames.size(); i++) fprintf(f, "%s\n", g_fieldnames[i].c_str());
+	fclose(f);
+}
+
+static void read_names_file() {
+	for (size_t i = 0; i < g_fieldnames.size(); i++) g_names[telemetry_id(g_fieldnames[i])] = g_fieldnames[i];
+	FILE *f = fopen(g_names_file, "r");
+	if (!f) return;
+	char buf[256];
+	unsigned id;
+	while (fgets(buf, sizeof(buf), f)) {
+		char *tab = strchr(buf, '\t');
+		if (!tab || sscanf(buf, "%u", &id) != 1) continue;
+		std::string name(tab + 1);
+		if (!name.empty() && name[name.size()-1] == '\n') name.resize(name.size() - 1);
+		g_names[id] = name;
+	}
+	fclose(f);
+}
+
+static void save_names_file() {
+	FILE *f = fopen(g_names_file, "w");
+	if (!f) { perror(g_names_file); return; }
+	for (std::map<uint32_t, std::string>::iterator it = g_names.begin(); it != g_names.end(); ++it)
+		fprintf(f, "%u\t%s\n", it->first, it->second.c_str());
+	fclose(f);
+}
+
+/* Rows go through one stdio buffer; the header is written when the file
+ * is new, later fields are appended to each row like serial_parse.py does
+ */
+static void open_stats() {
+	struct stat st;
+	bool is_new = stat(g_stats_file, &st) != 0;
+	g_stats = fopen(g_stats_file, "a");
+	if (!g_stats) { perror(g_stats_file); exit(1); }
+	setvbuf(g_stats, NULL, _IOFBF, 1 << 16);
+	if (is_new) {
+		for (size_t i = 0; i < g_fieldnames.size(); i++)
+			fprintf(g_stats, "%s%s", i ? "\t" : "", g_fieldnames[i].c_str());
+		fprintf(g_stats, "\n");
+	}
+}
+
+static void add_field(DEVICE_T *d, const std::string &key, const std::string &value) {
+	if (std::find(g_fieldnames.begin(), g_fieldnames.end(), key) == g_fieldnames.end()) {
+		g_fieldnames.push_back(key);
+		save_field_file();
+	}
+	d->row[key] = value;
+}
+
+static void row_start(DEVICE_T *d) { d->row.clear(); d->asked = false; }
+
+/* Ask the board for all field names, once per boot; they come with the
+ * next one
+ */
+static void request_names(DEVICE_T *d) {
+	if (!d->tty || d->asked) return;
+	uint8_t c = NAMES_REQUEST;
+	if (write(d->fd, &c, 1) == 1) d->asked = true;
+}
+
+static void row_complete(DEVICE_T *d) {
+	add_field(d, "device", d->name);
+	for (size_t i = 0; i < g_fieldnames.size(); i++) {
+		std::map<std::string, std::string>::iterator it = d->row.find(g_fieldnames[i]);
+		fprintf(g_stats, "%s%s", i ? "\t" : "", it == d->row.end() ? "" : it->second.c_str());
+	}
+	fprintf(g_stats, "\n");
+	stats_add_row(d->row);
+	d->rows++;
+	d->row.clear();
+	if (g_row_limit && ++g_rows >= g_row_limit) g_break = 1;
+}
+
+/* A "<...>" from the text output
+ */
+static void parse_tag(DEVICE_T *d, const std::string &tag) {
+	if (tag == "<start>") { row_start(d); return; }
+	if (tag == "<complete>") { row_complete(d); return; }
+	std::string item = tag.substr(1, tag.size() - 2);
+	size_t eq = item.find('=');
+	if (eq == std::string::npos || eq + 1 == item.size()) return;
+	if (item.find('=', eq + 1) != std::string::npos) return;
+	add_field(d, item.substr(0, eq), item.substr(eq + 1));
+}
+
+static bool get_varint(const std::string &f, size_t &i, uint32_t &v) {
+	v = 0;
+	for (int shift = 0; i < f.size() && shift < 35; shift += 7) {
+		uint8_t b = f[i++];
+		v |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+static uint16_t crc16(const std::string &f, size_t len) {
+	uint16_t crc = 0xffff;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= (uint16_t)(uint8_t)f[i] << 8;
+		for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+	return crc;
+}
+
+/* One binary frame without its 0x00 delimiters, see src/telemetry.h;
+ * false if it isn't one
+ */
+static bool parse_frame(DEVICE_T *d, const std::string &cobs) {
+	std::string f;
+	for (size_t i = 0; i < cobs.size(); ) {
+		uint8_t code = cobs[i++];
+		if (i + code - 1 > cobs.size()) return false;
+		f.append(cobs, i, code - 1);
+		i += code - 1;
+		if (code < 0xff && i < cobs.size()) f += '\0';
+	}
+	if (f.size() < 3 || crc16(f, f.size() - 2) != (((uint8_t)f[f.size()-2] << 8) | (uint8_t)f[f.size()-1]))
+		return false;
+	f.resize(f.size() - 2);
+	for (size_t i = 0; i < f.size(); ) {
+		uint32_t tag, v, id;
+		if (!get_varint(f, i, tag)) break;
+		id = tag >> 2;
+		if ((tag & 3) == 3) {
+			if (id == 0) { row_start(d); continue; }
+			if (id == 1) { row_complete(d); continue; }
+			if (!get_varint(f, i, id) || !get_varint(f, i, v) || i + v > f.size()) break;
+			std::string name = f.substr(i, v);
+			i += v;
+			if (g_names[id] != name) { g_names[id] = name; save_names_file(); }
+			continue;
+		}
+		if (!get_varint(f, i, v)) break;
+		std::map<uint32_t, std::string>::iterator it = g_names.find(id);
+		if (it == g_names.end()) request_names(d);
+		std::string key = it != g_names.end() ? it->second : "#" + std::to_string(id);
+		if ((tag & 3) == 2) {
+			if (i + v > f.size()) break;
+			add_field(d, key, f.substr(i, v));
+			i += v;
+		} else {
+			add_field(d, key, std::to_string((tag & 3) ? -1 - (int64_t)v : (int64_t)v));
+		}
+	}
+	return true;
+}
+
+/* One character of the text output
+ */
+static void parse_text(DEVICE_T *d, char c) {
+	if (g_verbose) {
+		if (c == '\n') printf("\n%s: ", d->name.c_str());
+		else if (c != '\r') putchar(c);
+	}
+	if (c == '<') d->line = "<";
+	else if (!d->line.empty()) d->line += c;
+	if (c == '>' && !d->line.empty()) { parse_tag(d, d->line); d->line.clear(); }
+	if (c == '\n' || d->line.size() > MAX_TEXT_TAG) d->line.clear();
+}
+
+/* Feed a chunk of what a device sent through the parser. A 0x00 can
+ * also be noise, e.g. the boot ROM's 74880 baud output: what follows
+ * it is only a frame if it ends in a good crc within MAX_FRAME bytes,
+ * otherwise those bytes are parsed as text after all.
+ */
+static void parse_chunk(DEVICE_T *d, const char *buf, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		char c = buf[i];
+		if (d->in_frame) {
+			if (c) {
+				d->frame += c;
+				if (d->frame.size() <= MAX_FRAME) continue;
+				d->in_frame = false;
+			} else {
+				if (d->frame.empty()) continue; // back-to-back delimiters
+				if (parse_frame(d, d->frame)) { d->in_frame = false; continue; }
+				// this 0x00 may start the next frame
+			}
+			d->bad_frames++;
+			std::string text;
+			text.swap(d->frame);
+			for (size_t j = 0; j < text.size(); j++) parse_text(d, text[j]);
+			continue;
+		}
+		if (!c) { d->in_frame = true; d->frame.clear(); continue; }
+		parse_text(d, c);
+	}
+}
+
+/* Rows of a TSV written by serial_parse.py or an earlier run; like those
+ * do, columns past the header are named by the fields file
+ */
+static void read_tsv(const char *filename) {
+	FILE *f = fopen(filename, "r");
+	if (!f) { perror(filename); exit(1); }
+	std::vector<std::string> header;
+	std::string line;
+	int c;
+	uint64_t rows = 0;
+	do {
+		c = fgetc(f);
+		if (c != '\n' && c != EOF) { line += (char)c; continue; }
+		if (line.empty()) continue;
+		if (!line.empty() && line[line.size()-1] == '\r') line.resize(line.size() - 1);
+		std::vector<std::string> cols;
+		size_t start = 0, tab;
+		while ((tab = line.find('\t', start)) != std::string::npos) { cols.push_back(line.substr(start, tab - start)); start = tab + 1; }
+		cols.push_back(line.substr(start));
+		line.clear();
+		if (header.empty()) { header = cols; continue; }
+		std::map<std::string, std::string> row;
+		for (size_t i = 0; i < cols.size(); i++) {
+			const std::string *name = i < header.size() ? &header[i] : i < g_fieldnames.size() ? &g_fieldnames[i] : NULL;
+			if (name && !cols[i].empty()) row[*name] = cols[i];
+		}
+		stats_add_row(row);
+		rows++;
+	} while (c != EOF);
+	fclose(f);
+	fprintf(stderr, "%s: %llu rows\n", filename, (unsigned long long)rows);
+}
+
+/* Raw mode, 8N1, non-blocking; regular files are read as captures. A
+ * tty is opened for writing as well, for the names requests
+ */
+static int open_device(const char *name, speed_t speed) {
+	int fd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) fd = open(name, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+	if (fd < 0) { perror(name); return -1; }
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		tio.c_cflag |= CLOCAL | CREAD;
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		if (tcsetattr(fd, TCSANOW, &tio) != 0) perror(name);
+	}
+	return fd;
+}
+
+static speed_t baud_speed(unsigned long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 921600: return B921600;
+	}
+	fprintf(stderr, "unsupported baud rate %lu\n", baud);
+	exit(1);
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-b baud] [-s stats.tsv] [-f fields.txt] [-n names.txt]"
+		" [-r seconds] [-c field]... [-t old.tsv]... [-l rows] [-v] [device...]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	unsigned long baud = 115200;
+	unsigned long report_s = 60;
+	std::vector<std::string> compare_fields, old_tsvs;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:s:f:n:r:c:t:l:vh")) != -1) {
+		switch (opt) {
+			case 'b': baud = strtoul(optarg, NULL, 10); break;
+			case 's': g_stats_file = optarg; break;
+			case 'f': g_fields_file = optarg; break;
+			case 'n': g_names_file = optarg; break;
+			case 'r': report_s = strtoul(optarg, NULL, 10); break;
+			case 'c': compare_fields.push_back(optarg); break;
+			case 't': old_tsvs.push_back(optarg); break;
+			case 'l': g_row_limit = strtoull(optarg, NULL, 10); break;
+			case 'v': g_verbose = true; break;
+			default: usage(argv[0]);
+		}
+	}
+	if (optind >= argc && old_tsvs.empty()) usage(argv[0]);
+	if (compare_fields.empty()) compare_fields.push_back("setup_total");
+	speed_t speed = baud_speed(baud);
+
+	read_field_file();
+	read_names_file();
+	for (size_t i = 0; i < old_tsvs.size(); i++) read_tsv(old_tsvs[i].c_str());
+	if (optind >= argc) {
+		stats_report(stdout, compare_fields);
+		return 0;
+	}
+	open_stats();
+
+	int ep = epoll_create1(0);
+	if (ep < 0) { perror("epoll_create1"); return 1; }
+	std::vector<DEVICE_T> devices(argc - optind);
+	int open_count = 0;
+	for (int i = optind; i < argc; i++) {
+		DEVICE_T *d = &devices[i - optind];
+		d->name = argv[i];
+		d->in_frame = false;
+		d->rows = d->bad_frames = 0;
+		d->tty = d->asked = false;
+		d->fd = open_device(argv[i], speed);
+		if (d->fd < 0) continue;
+		d->tty = isatty(d->fd);
+		request_names(d); // a new session, names may have changed
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = d;
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, d->fd, &ev) != 0) {
+			// not pollable, e.g. a capture file: read it all now
+			char buf[READ_CHUNK];
+			ssize_t n;
+			while ((n = read(d->fd, buf, sizeof(buf))) > 0) parse_chunk(d, buf, n);
+			close(d->fd);
+			d->fd = -1;
+			continue;
+		}
+		open_count++;
+	}
+
+	signal(SIGINT, stop_processing);
+	signal(SIGTERM, stop_processing);
+	time_t last_flush = time(NULL), last_report = last_flush;
+	struct epoll_event events[16];
+	while (!g_break && open_count > 0) {
+		int n = epoll_wait(ep, events, 16, FLUSH_EVERY_S * 1000);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait");
+			break;
+		}
+		for (int i = 0; i < n; i++) {
+			DEVICE_T *d = (DEVICE_T *)events[i].data.ptr;
+			char buf[READ_CHUNK];
+			ssize_t len = read(d->fd, buf, sizeof(buf));
+			if (len > 0) { parse_chunk(d, buf, len); continue; }
+			if (len < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+			// unplugged, or the other end of a pty closed
+			fprintf(stderr, "%s: closed\n", d->name.c_str());
+			epoll_ctl(ep, EPOLL_CTL_DEL, d->fd, NULL);
+			close(d->fd);
+			d->fd = -1;
+			open_count--;
+		}
+		if (time(NULL) - last_flush >= FLUSH_EVERY_S) {
+			fflush(g_stats);
+			if (g_verbose) fflush(stdout);
+			last_flush = time(NULL);
+		}
+		if (report_s && (time(NULL) - last_report >= (time_t)report_s)) {
+			stats_report(stderr, compare_fields);
+			last_report = time(NULL);
+		}
+	}
+	fclose(g_stats);
+	stats_report(stdout, compare_fields);
+	fprintf(stderr, "\n");
+	for (size_t i = 0; i < devices.size(); i++) {
+		fprintf(stderr, "%s: %u rows", devices[i].name.c_str(), devices[i].rows);
+		if (devices[i].bad_frames) fprintf(stderr, ", %u bad frames", devices[i].bad_frames);
+		fprintf(stderr, "\n");
+	}
+	return 0;
+}
@@ -3,7 +3,7 @@
 
 # MIT License / (C) johnmu / https://github.com/softplus/openbk-tools
 
-import sys, time, argparse, signal, tempfile, os
+import sys, time, argparse, signal, tempfile, os, binascii
 import serial, serial.tools.list_ports
 
 g_break = False
@@ -13,6 +13,12 @@ g_fieldnames = []
 g_rowdata = {}
 g_csv_filename = ""
 g_field_filename = ""
+g_names = {}
+g_names_filename = ""
+g_request_port = None # the UART, to ask for field names; None for a capture file
+g_asked = False # for the field names during this boot
+MAX_FRAME = 203 # TELEMETRY_FRAME_MAX + 3 of src/telemetry.h, COBS & crc included
+NAMES_REQUEST = b'\x05' # TELEMETRY_NAMES_REQUEST of src/telemetry.h
 
 # parse commandline arguments
 def parse_args():
@@ -33,6 +39,11 @@ def parse_args():
     parser.add_argument('-s', '--statfile', type=str,
                         default="__stats.csv",
                         help="File for statistics on fields")
+    parser.add_argument('-n', '--names', type=str,
+                        default="__telemetry_names.txt",
+                        help="File for binary telemetry field names")
+    parser.add_argument('-i', '--input', type=str,
+                        help="Read a capture file instead of the UART")
     args = parser.parse_args()
     return args
 
@@ -43,26 +54,30 @@ def connect(port, baud):
     time.sleep(0.1)
     return serial_port
 
-# read 1 character from the serial port & display 
-def read_serial(serial_port, show_hex):
-    global g_counter, g_chars
-    ch = serial_port.read()
+# read 1 byte from the serial port & display, binary frames aren't shown
+def read_serial(serial_port, show_hex, in_frame):
+    ch = serial_port.read(1)
     if ch==b'': 
         print("no data.")
-        raise
+        raise EOFError
+    if in_frame or ch==b'\x00':
+        return ch
+    show_serial(ch, show_hex)
+    return ch
+
+def show_serial(ch, show_hex):
+    global g_counter, g_chars
     if show_hex:
         print(ch.hex() + ' ', end='', flush=True)
         g_counter += 1
-        if (ch<b' ' or ch>b'~'): ch=b'.'
-        g_chars += ch.decode("utf-8")
+        g_chars += ch.decode("latin-1") if b' '<=ch<=b'~' else '.'
         if g_counter % 8 == 0: print('  ', end='', flush=True)
         if g_counter % 16 ==0: 
             print(g_chars[:8] + '  ' + g_chars[8:])
             g_chars = ""
             g_counter = 0
     else:
-        print(ch.decode("utf-8"), end="", flush=True)
-    return ch.decode("utf-8")
+        print(ch.decode("latin-1"), end="", flush=True)
 
 # read file for fieldnames
 def read_field_file(filename):
@@ -108,9 +123,17 @@ def wait_if_needed():
         print("Waiting for pause to complete...")
         while os.path.exists(tempfilename): time.sleep(1)
 
+# add a field to the current row
+def add_field(key, value):
+    global g_fieldnames, g_rowdata, g_field_filename
+    if key not in g_fieldnames:
+        g_fieldnames.append(key)
+        save_field_file(g_field_filename)
+    g_rowdata[key] = value
+
 # parse the recent buffer, looking for <field=value>
 def parse_buffer(buffer):
-    global g_fieldnames, g_rowdata, g_csv_filename, g_field_filename
+    global g_rowdata, g_csv_filename
     if buffer=="<start>": 
         g_rowdata = {}
         return
@@ -120,10 +143,109 @@ def parse_buffer(buffer):
     if buffer[0]!="<" or buffer[-1]!=">": return
     items = buffer[1:][:-1].split("=")
     if len(items)!=2 or not items[1]: return
-    if items[0] not in g_fieldnames:
-        g_fieldnames.append(items[0])
-        save_field_file(g_field_filename)
-    g_rowdata[items[0]] = items[1]
+    add_field(items[0], items[1])
+
+# binary telemetry, see src/telemetry.h: field id of a key name
+def telemetry_id(key):
+    h = 2166136261
+    for b in key.encode("utf-8"):
+        h = ((h ^ b) * 16777619) & 0xffffffff
+    return (h ^ (h >> 19)) & ((1 << 19) - 1)
+
+# read file with field names by id; known fields need no names from the device
+def read_names_file(filename):
+    global g_names, g_fieldnames
+    g_names = {telemetry_id(x): x for x in g_fieldnames}
+    if os.path.exists(filename):
+        with open(filename) as f:
+            for line in f:
+                items = line.rstrip("\n").split("\t")
+                if len(items)==2: g_names[int(items[0])] = items[1]
+
+def save_names_file(filename):
+    global g_names
+    with open(filename, "w") as f:
+        f.writelines(["%d\t%s\n" % (k, v) for k, v in sorted(g_names.items())])
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code==0 or i+code > len(data): return None
+        out += data[i+1:i+code]
+        i += code
+        if code<0xff and i<len(data): out.append(0)
+    return bytes(out)
+
+def get_varint(data, i):
+    value, shift = 0, 0
+    while True:
+        b = data[i]  # IndexError on a short record
+        value |= (b & 0x7f) << shift
+        i += 1
+        if not b & 0x80: return value, i
+        shift += 7
+
+# ask the device for all field names, once per boot; they come with the
+# next one
+def request_names():
+    global g_asked
+    if g_request_port is None or g_asked: return
+    g_request_port.write(NAMES_REQUEST)
+    g_asked = True
+
+# decode one frame: records, then CRC-16/CCITT; False if it isn't one
+def parse_frame(cobs):
+    global g_rowdata, g_csv_filename, g_names, g_names_filename, g_asked
+    data = cobs_decode(cobs)
+    if not data or len(data)<3 or binascii.crc_hqx(data[:-2], 0xffff)!=int.from_bytes(data[-2:], "big"):
+        return False
+    data = data[:-2]
+    i = 0
+    try:
+        while i < len(data):
+            tag, i = get_varint(data, i)
+            kind, fid = tag & 3, tag >> 2
+            if kind==3:
+                if fid==0:
+                    g_rowdata = {}
+                    g_asked = False
+                elif fid==1: append_csv_data(g_csv_filename, g_rowdata)
+                elif fid==2:
+                    fid, i = get_varint(data, i)
+                    n, i = get_varint(data, i)
+                    name = data[i:i+n].decode("utf-8", "replace")
+                    i += n
+                    if g_names.get(fid)!=name:
+                        g_names[fid] = name
+                        save_names_file(g_names_filename)
+                continue
+            value, i = get_varint(data, i)
+            if fid not in g_names: request_names()
+            key = g_names.get(fid, "#%d" % fid)
+            if kind==2:
+                text = data[i:i+value].decode("utf-8", "replace")
+                i += value
+                print("<%s=%s>" % (key, text))
+                add_field(key, text)
+            else:
+                if kind==1: value = -1 - value
+                print("<%s=%d>" % (key, value))
+                add_field(key, str(value))
+    except IndexError:
+        print("\n[short telemetry record]")
+    return True
+
+# one character of the text output, returns the new buffer
+def parse_text(buffer, ch):
+    ch = ch.decode("latin-1")
+    buffer += ch
+    if ch=='<': buffer="<"
+    if ch=='>': 
+        parse_buffer(buffer)
+        buffer=""
+    return buffer
 
 # main schboom
 if __name__ == "__main__":
@@ -131,17 +253,44 @@ if __name__ == "__main__":
     signal.signal(signal.SIGINT, stop_processing)
     g_csv_filename = args.statfile
     g_field_filename = args.fields
+    g_names_filename = args.names
     read_field_file(g_field_filename)
-    serial_port = connect(args.device, args.baudrate)
+    read_names_file(g_names_filename)
+    if args.input:
+        serial_port = open(args.input, "rb")
+    else:
+        serial_port = connect(args.device, args.baudrate)
+        g_request_port = serial_port
+        request_names() # a new session, names may have changed
     buffer = ""
+    # bytes after a 0x00: a binary frame if a good CRC ends it within
+    # MAX_FRAME bytes, else it was noise, e.g. from the boot ROM, and
+    # the bytes are text after all
+    frame = None
     while not g_break:
         try:
-            ch = read_serial(serial_port, args.hex)
-            buffer += ch
-            if ch=='<': buffer="<"
-            if ch=='>': 
-                parse_buffer(buffer)
-                buffer=""
+            ch = read_serial(serial_port, args.hex, frame is not None)
+            if frame is not None:
+                if ch!=b'\x00':
+                    frame += ch
+                    if len(frame) <= MAX_FRAME: continue
+                    text, frame = frame, None
+                elif not frame: continue # back-to-back delimiters
+                elif parse_frame(frame):
+                    frame = None
+                    continue
+                else:
+                    text, frame = frame, b"" # this 0x00 may start the next frame
+                for c in text:
+                    show_serial(bytes([c]), args.hex)
+                    buffer = parse_text(buffer, bytes([c]))
+                continue
+            if ch==b'\x00':
+                frame = b""
+                continue
+            buffer = parse_text(buffer, ch)
+        except EOFError:
+            if args.input: break
         except: 
             print(sys.exc_info()[1])
             #break
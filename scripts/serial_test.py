@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+# encoding: utf8
+
+# MIT License / (C) johnmu
+
+# Check serial_collect & serial_parse.py against captures of the
+# simulation's serial output, in text & binary telemetry mode, and of
+# the WifiHelper overlap example, which keeps the library building.
+#
+# The simulation is built with g++ and run with -v, which echoes what
+# the firmware writes to the UART. Each capture is read as a file and
+# through a pseudo-terminal by serial_collect, and with -i by
+# serial_parse.py, plain and with boot ROM noise that has stray 0x00
+# bytes in it; every boot has to come out as one row.
+#
+#   scripts/serial_test.py
+#   scripts/serial_test.py -n 20 -k     # keep the files in serial_test/
+
+import sys, os, argparse, subprocess, tempfile, shutil, pty, time, random, tty
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# parse commandline arguments
+def parse_args():
+    description = "Check serial_collect & serial_parse.py against simulated captures."
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('-n', '--boots', type=int, default=5,
+                        help="Boots per capture, defaults to 5")
+    parser.add_argument('-k', '--keep', action="store_true",
+                        help="Keep the builds & captures in serial_test/")
+    args = parser.parse_args()
+    return args
+
+def build(outdir):
+    collect = os.path.join(outdir, "serial_collect")
+    subprocess.run(["g++", "-std=gnu++11", "-O2", "-o", collect,
+                    os.path.join(ROOT, "scripts", "serial_collect.cpp"),
+                    os.path.join(ROOT, "scripts", "stream_stats.cpp")], check=True)
+    sources = [os.path.join(d, f) for d in (os.path.join(ROOT, "src"), os.path.join(ROOT, "src", "native"))
+               for f in sorted(os.listdir(d)) if f.endswith(".cpp")]
+    native = [os.path.join(ROOT, "src", "native", f) for f in sorted(os.listdir(os.path.join(ROOT, "src", "native")))
+              if f.endswith(".cpp")]
+    lib = os.path.join(ROOT, "lib", "WifiHelper")
+    example = ["-I" + os.path.join(lib, "src"), "-x", "c++", os.path.join(lib, "examples", "overlap", "overlap.ino"),
+               "-x", "none", os.path.join(lib, "src", "WifiHelper.cpp")] + native
+    sims = {}
+    for mode, flags in (("text", sources), ("binary", ["-DTELEMETRY_BINARY"] + sources), ("wifihelper", example)):
+        sims[mode] = os.path.join(outdir, "sim_" + mode)
+        subprocess.run(["g++", "-std=gnu++11", "-O2", "-I" + os.path.join(ROOT, "src", "native"),
+                        "-I" + os.path.join(ROOT, "src"), "-include", os.path.join(ROOT, "src", "native", "secrets.h")] + flags + ["-o", sims[mode]], check=True)
+    return collect, sims
+
+# what the boot ROM prints at 74880 baud, as seen at 115200: junk with
+# a 0x00 here and there, no '<' and no newline before the sketch starts
+def boot_noise(rand):
+    junk = bytes(rand.choice(range(0x80, 0x100)) for i in range(40))
+    return junk[:10] + b"\x00" + junk[10:] + b"\r\n"
+
+# everything the firmware wrote, plus the simulation's report, which
+# has no tags
+def capture(sim, boots):
+    return subprocess.run([sim, "-n", str(boots), "-v"], check=True, stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL).stdout
+
+# noise in front of every boot, which starts with this line
+def with_noise(data, rand):
+    marker = b"get_settings_from_flash"
+    if b"<start>" in data: marker = b"<start>"
+    parts = data.split(marker)
+    return parts[0] + b"".join(boot_noise(rand) + marker + p for p in parts[1:])
+
+def count_rows(tsv):
+    with open(tsv, "rb") as f:
+        return max(0, len(f.read().splitlines()) - 1)
+
+def collect_rows(collect, outdir, name, source):
+    tsv = os.path.join(outdir, name + ".tsv")
+    for f in (tsv, os.path.join(outdir, "fields.txt")):
+        if os.path.exists(f): os.remove(f)
+    cmd = [collect, "-s", tsv, "-f", os.path.join(outdir, "fields.txt"),
+           "-n", os.path.join(outdir, "names.txt"), "-r", "0"]
+    subprocess.run(cmd + [source], check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL,
+                   timeout=20)
+    return count_rows(tsv)
+
+def parse_rows(outdir, name, source):
+    tsv = os.path.join(outdir, name + ".tsv")
+    for f in (tsv, os.path.join(outdir, "fields.txt")):
+        if os.path.exists(f): os.remove(f)
+    subprocess.run([sys.executable, os.path.join(ROOT, "scripts", "serial_parse.py"), "-i", source, "-s", tsv,
+                    "-f", os.path.join(outdir, "fields.txt"), "-n", os.path.join(outdir, "names.txt")],
+                   check=True, stdout=subprocess.DEVNULL, timeout=60)
+    return count_rows(tsv)
+
+# through a pseudo-terminal, in small writes like a UART delivers them
+def collect_pty(collect, outdir, name, data, rows_expected):
+    master, slave = pty.openpty()
+    tty.setraw(slave)
+    tsv = os.path.join(outdir, name + ".tsv")
+    if os.path.exists(tsv): os.remove(tsv)
+    proc = subprocess.Popen([collect, "-s", tsv, "-f", os.path.join(outdir, "fields.txt"),
+                             "-n", os.path.join(outdir, "names.txt"), "-r", "0", "-l", str(rows_expected),
+                             os.ttyname(slave)], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(0.2)
+    for i in range(0, len(data), 64):
+        os.write(master, data[i:i + 64])
+    try:
+        proc.wait(timeout=5)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+    os.close(master)
+    os.close(slave)
+    return count_rows(tsv)
+
+def main():
+    args = parse_args()
+    rand = random.Random(1)
+    outdir = "serial_test" if args.keep else tempfile.mkdtemp(prefix="serial_test_")
+    os.makedirs(outdir, exist_ok=True)
+    failed = 0
+    try:
+        collect, sims = build(outdir)
+        for mode in ("text", "binary", "wifihelper"):
+            data = capture(sims[mode], args.boots)
+            cases = [("plain", data), ("noise", with_noise(data, rand))]
+            for case, payload in cases:
+                name = "%s_%s" % (mode, case)
+                filename = os.path.join(outdir, name + ".bin")
+                with open(filename, "wb") as f:
+                    f.write(payload)
+                results = [("file", collect_rows(collect, outdir, name, filename)),
+                           ("pty", collect_pty(collect, outdir, name + "_pty", payload, args.boots)),
+                           ("parse", parse_rows(outdir, name + "_parse", filename))]
+                for how, rows in results:
+                    ok = rows == args.boots
+                    failed += not ok
+                    print("%-10s %-6s %-5s %d/%d rows %s" % (mode, case, how, rows, args.boots, "ok" if ok else "FAILED"))
+    finally:
+        if not args.keep: shutil.rmtree(outdir)
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())
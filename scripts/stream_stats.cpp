@@ -0,0 +1,253 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Streaming quantiles, bootstrap intervals & strategy comparison
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+#include "stream_stats.h"
+
+typedef std::map<std::string, FIELD_STATS_T> GROUP_T;
+
+static std::map<std::string, GROUP_T> g_groups;
+static std::map<std::string, uint64_t> g_group_rows;
+static std::vector<std::string> g_fields; // in the order they showed up
+static uint64_t g_rows = 0;
+static uint64_t g_rng = 0x9E3779B97F4A7C15ull; // fixed, so reports repeat
+
+static uint64_t rng_next() {
+	g_rng ^= g_rng << 13;
+	g_rng ^= g_rng >> 7;
+	g_rng ^= g_rng << 17;
+	return g_rng;
+}
+
+static size_t rng_below(size_t n) { return (size_t)(rng_next() % n); }
+
+void p2_init(P2_T *p2, double p) {
+	p2->p = p;
+	p2->count = 0;
+	for (int i = 0; i < 5; i++) p2->n[i] = i + 1;
+	p2->np[0] = 1; p2->np[1] = 1 + 2 * p; p2->np[2] = 1 + 4 * p; p2->np[3] = 3 + 2 * p; p2->np[4] = 5;
+}
+
+/* Move marker i by d (+1 or -1), parabolic if that keeps the heights in
+ * order, else linear
+ */
+static void p2_adjust(P2_T *p2, int i, double d) {
+	double *q = p2->q, *n = p2->n;
+	double qp = q[i] + d / (n[i+1] - n[i-1]) * ((n[i] - n[i-1] + d) * (q[i+1] - q[i]) / (n[i+1] - n[i])
+		+ (n[i+1] - n[i] - d) * (q[i] - q[i-1]) / (n[i] - n[i-1]));
+	if (q[i-1] < qp && qp < q[i+1]) q[i] = qp;
+	else q[i] = q[i] + d * (q[i + (int)d] - q[i]) / (n[i + (int)d] - n[i]);
+	n[i] += d;
+}
+
+void p2_add(P2_T *p2, double x) {
+	double *q = p2->q, *n = p2->n;
+	if (p2->count < 5) {
+		q[p2->count++] = x;
+		if (p2->count == 5) std::sort(q, q + 5);
+		return;
+	}
+	p2->count++;
+	int k;
+	if (x < q[0]) { q[0] = x; k = 0; }
+	else if (x < q[1]) k = 0;
+	else if (x < q[2]) k = 1;
+	else if (x < q[3]) k = 2;
+	else if (x <= q[4]) k = 3;
+	else { q[4] = x; k = 3; }
+	for (int i = k + 1; i < 5; i++) n[i]++;
+	const double dn[5] = { 0, p2->p / 2, p2->p, (1 + p2->p) / 2, 1 };
+	for (int i = 0; i < 5; i++) p2->np[i] += dn[i];
+	for (int i = 1; i < 4; i++) {
+		double d = p2->np[i] - n[i];
+		if ((d >= 1 && n[i+1] - n[i] > 1) || (d <= -1 && n[i-1] - n[i] < -1))
+			p2_adjust(p2, i, d > 0 ? 1 : -1);
+	}
+}
+
+double p2_value(const P2_T *p2) {
+	if (!p2->count) return NAN;
+	if (p2->count >= 5) return p2->q[2];
+	double tmp[5];
+	std::copy(p2->q, p2->q + p2->count, tmp);
+	std::sort(tmp, tmp + p2->count);
+	return tmp[(size_t)(p2->p * (p2->count - 1) + 0.5)];
+}
+
+static void field_init(FIELD_STATS_T *s) {
+	s->count = 0;
+	s->mean = s->m2 = 0;
+	s->min = INFINITY;
+	s->max = -INFINITY;
+	p2_init(&s->p50, 0.5);
+	p2_init(&s->p90, 0.9);
+	p2_init(&s->p99, 0.99);
+}
+
+static void field_add(FIELD_STATS_T *s, double x) {
+	s->count++;
+	double delta = x - s->mean;
+	s->mean += delta / s->count;
+	s->m2 += delta * (x - s->mean);
+	s->min = std::min(s->min, x);
+	s->max = std::max(s->max, x);
+	p2_add(&s->p50, x);
+	p2_add(&s->p90, x);
+	p2_add(&s->p99, x);
+	// Algorithm R: every value seen so far is kept with the same chance
+	if (s->reservoir.size() < STATS_RESERVOIR) s->reservoir.push_back(x);
+	else {
+		uint64_t j = rng_next() % s->count;
+		if (j < STATS_RESERVOIR) s->reservoir[j] = x;
+	}
+}
+
+/* One completed row: numbers go to the row's strategy, text is skipped
+ */
+void stats_add_row(const std::map<std::string, std::string> &row) {
+	std::map<std::string, std::string>::const_iterator st = row.find("strategy");
+	const std::string group = st == row.end() ? "?" : st->second;
+	GROUP_T &g = g_groups[group];
+	g_group_rows[group]++;
+	g_rows++;
+	for (std::map<std::string, std::string>::const_iterator it = row.begin(); it != row.end(); ++it) {
+		if (it == st || it->second.empty()) continue;
+		char *end;
+		double v = strtod(it->second.c_str(), &end);
+		if (*end) continue;
+		GROUP_T::iterator f = g.find(it->first);
+		if (f == g.end()) {
+			f = g.insert(std::make_pair(it->first, FIELD_STATS_T())).first;
+			field_init(&f->second);
+			if (std::find(g_fields.begin(), g_fields.end(), it->first) == g_fields.end())
+				g_fields.push_back(it->first);
+		}
+		field_add(&f->second, v);
+	}
+}
+
+uint64_t stats_rows() { return g_rows; }
+
+static double median_of(std::vector<double> &v) {
+	size_t mid = v.size() / 2;
+	std::nth_element(v.begin(), v.begin() + mid, v.end());
+	return v[mid];
+}
+
+static double resampled_median(const std::vector<double> &v, std::vector<double> &tmp) {
+	tmp.resize(v.size());
+	for (size_t i = 0; i < v.size(); i++) tmp[i] = v[rng_below(v.size())];
+	return median_of(tmp);
+}
+
+/* 95% bootstrap interval of the median of a, or of median(a) - median(b)
+ */
+static void bootstrap_median(const std::vector<double> &a, const std::vector<double> *b, double *lo, double *hi) {
+	std::vector<double> est(STATS_BOOTSTRAP), tmp;
+	for (int i = 0; i < STATS_BOOTSTRAP; i++) {
+		est[i] = resampled_median(a, tmp);
+		if (b) est[i] -= resampled_median(*b, tmp);
+	}
+	std::sort(est.begin(), est.end());
+	*lo = est[(size_t)(STATS_BOOTSTRAP * 0.025)];
+	*hi = est[(size_t)(STATS_BOOTSTRAP * 0.975) - 1];
+}
+
+/* Two-sided p of the Mann-Whitney U test, normal approximation with
+ * tie correction; fine for the sample sizes we compare
+ */
+static double mann_whitney_p(const std::vector<double> &a, const std::vector<double> &b) {
+	std::vector<std::pair<double, int> > all;
+	for (size_t i = 0; i < a.size(); i++) all.push_back(std::make_pair(a[i], 0));
+	for (size_t i = 0; i < b.size(); i++) all.push_back(std::make_pair(b[i], 1));
+	std::sort(all.begin(), all.end());
+	double n1 = a.size(), n2 = b.size(), n = all.size();
+	double rank_a = 0, ties = 0;
+	for (size_t i = 0; i < all.size(); ) {
+		size_t j = i;
+		while (j < all.size() && all[j].first == all[i].first) j++;
+		double rank = (i + j + 1) / 2.0, t = j - i;
+		for (size_t k = i; k < j; k++) if (!all[k].second) rank_a += rank;
+		ties += t * t * t - t;
+		i = j;
+	}
+	double u = rank_a - n1 * (n1 + 1) / 2;
+	double sigma = sqrt(n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1))));
+	if (sigma <= 0) return 1;
+	double z = (fabs(u - n1 * n2 / 2) - 0.5) / sigma;
+	return z <= 0 ? 1 : erfc(z / sqrt(2.0));
+}
+
+/* Per strategy: every numeric field's quantiles & spread. Then, for
+ * each compare field, the strategies ranked by median with bootstrap
+ * intervals, each against the best; '*' marks a difference that's
+ * significant after the Bonferroni correction for all those tests.
+ */
+void stats_report(FILE *f, const std::vector<std::string> &compare_fields) {
+	for (std::map<std::string, GROUP_T>::iterator g = g_groups.begin(); g != g_groups.end(); ++g) {
+		fprintf(f, "\nstrategy=%s (%llu rows)\n", g->first.c_str(), (unsigned long long)g_group_rows[g->first]);
+		fprintf(f, "  %-24s %7s %10s %10s %10s %10s %10s\n", "field", "n", "p50", "p90", "p99", "mean", "stddev");
+		for (size_t i = 0; i < g_fields.size(); i++) {
+			GROUP_T::iterator it = g->second.find(g_fields[i]);
+			if (it == g->second.end()) continue;
+			FIELD_STATS_T *s = &it->second;
+			fprintf(f, "  %-24s %7llu %10.0f %10.0f %10.0f %10.0f %10.0f\n", g_fields[i].c_str(),
+				(unsigned long long)s->count, p2_value(&s->p50), p2_value(&s->p90), p2_value(&s->p99),
+				s->mean, s->count > 1 ? sqrt(s->m2 / (s->count - 1)) : 0.0);
+		}
+	}
+
+	for (size_t c = 0; c < compare_fields.size(); c++) {
+		const std::string &field = compare_fields[c];
+		std::vector<std::pair<double, std::string> > ranked;
+		for (std::map<std::string, GROUP_T>::iterator g = g_groups.begin(); g != g_groups.end(); ++g) {
+			GROUP_T::iterator it = g->second.find(field);
+			if (it == g->second.end() || it->second.count < STATS_MIN_N) continue;
+			std::vector<double> tmp = it->second.reservoir;
+			ranked.push_back(std::make_pair(median_of(tmp), g->first));
+		}
+		if (ranked.empty()) continue;
+		std::sort(ranked.begin(), ranked.end());
+		fprintf(f, "\n%s by strategy, median with 95%% bootstrap interval, vs. the best:\n", field.c_str());
+		const std::vector<double> &best = g_groups[ranked[0].second][field].reservoir;
+		size_t tests = ranked.size() - 1;
+		for (size_t r = 0; r < ranked.size(); r++) {
+			const std::vector<double> &res = g_groups[ranked[r].second][field].reservoir;
+			double lo, hi;
+			bootstrap_median(res, NULL, &lo, &hi);
+			fprintf(f, "  %-10.0f [%.0f, %.0f] n=%-6zu", ranked[r].first, lo, hi, res.size());
+			if (r) {
+				double dlo, dhi;
+				bootstrap_median(res, &best, &dlo, &dhi);
+				double p = std::min(1.0, mann_whitney_p(res, best) * tests);
+				fprintf(f, " %+10.0f [%.0f, %.0f] p=%-9.2g%s", ranked[r].first - ranked[0].first, dlo, dhi, p,
+					p < STATS_ALPHA ? "*" : " ");
+			} else {
+				fprintf(f, " %10s %-20s", "best", "");
+			}
+			fprintf(f, " %s\n", ranked[r].second.c_str());
+		}
+	}
+}
@@ -0,0 +1,67 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+/* Streaming statistics for the host tools, per <strategy=...> and field
+ *
+ * Quantiles come from P² estimators (Jain & Chlamtac, five markers each),
+ * mean & stddev from Welford's method; both use constant memory. A
+ * reservoir of up to STATS_RESERVOIR values per field keeps a uniform
+ * sample for bootstrap confidence intervals and for the Mann-Whitney U
+ * test that compares strategies.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#define STATS_RESERVOIR 1024	// values kept per strategy & field
+#define STATS_BOOTSTRAP 400		// resamples per confidence interval
+#define STATS_ALPHA 0.05		// before the Bonferroni correction
+#define STATS_MIN_N 10			// fewer values aren't compared
+
+// P² estimate of one quantile
+struct P2_T {
+	double p;
+	double q[5];	// marker heights
+	double n[5];	// marker positions
+	double np[5];	// desired positions
+	uint32_t count;
+};
+
+struct FIELD_STATS_T {
+	uint64_t count;
+	double mean, m2, min, max;
+	P2_T p50, p90, p99;
+	std::vector<double> reservoir;
+};
+
+void p2_init(P2_T *p2, double p);
+void p2_add(P2_T *p2, double x);
+double p2_value(const P2_T *p2);
+
+void stats_add_row(const std::map<std::string, std::string> &row);
+void stats_report(FILE *f, const std::vector<std::string> &compare_fields);
+uint64_t stats_rows();
+
+#endif
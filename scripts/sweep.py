@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+# encoding: utf8
+
+# MIT License / (C) johnmu
+
+# Run a sweep of connection strategies and rank them.
+#
+# A sweep file (see sweeps/) lists the variants: built-in strategies by
+# name, new ones as flags, or axes whose combinations are all tried.
+# The variants go into one firmware via -DSTRATEGY_DEFINE and
+# -DSTRATEGY_SCHEDULE (src/strategy.h), so each boot runs the next one
+# of a shuffled schedule and they see the same conditions. With more
+# than STRATEGY_MAX variants, they are run in batches.
+#
+# Against the simulation (default), every batch is built with g++ and
+# run for iterations * variants boots. With -d, every batch is built &
+# flashed with PlatformIO, and serial_collect reads the boards until
+# enough rows are in. At the end, serial_collect ranks all the rows
+# with bootstrap intervals, see scripts/stream_stats.h.
+#
+#   scripts/sweep.py sweeps/variations.ini
+#   scripts/sweep.py sweeps/connect.ini -n 500 -d /dev/ttyUSB0 -d /dev/ttyUSB1
+
+import sys, os, re, argparse, configparser, itertools, subprocess
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+STRATEGY_MAX = 20
+STRATEGY_NAME_MAX = 8
+
+# parse commandline arguments
+def parse_args():
+    description = "Run a sweep of connection strategies and rank them."
+    parser = argparse.ArgumentParser(description=description)
+    parser.add_argument('sweep',
+                        help="Sweep file, e.g. sweeps/variations.ini")
+    parser.add_argument('-n', '--iterations', type=int,
+                        help="Boots per variant, overrides the sweep file")
+    parser.add_argument('-d', '--device', action="append", default=[],
+                        help="Flash & read this board instead of simulating, can be repeated")
+    parser.add_argument('-e', '--env', type=str, default="esp01",
+                        help="PlatformIO env to flash, defaults to esp01")
+    parser.add_argument('-s', '--seed', type=int, default=1,
+                        help="Seed of the simulation, defaults to 1")
+    parser.add_argument('-o', '--output', type=str,
+                        help="Directory for builds, TSVs & report, defaults to sweep_<name>")
+    parser.add_argument('--dry-run', action="store_true",
+                        help="Only show the variants & build flags")
+    args = parser.parse_args()
+    return args
+
+# flag names as shown in the <strategy=...> tag, from src/strategy.cpp
+def read_flag_names():
+    with open(os.path.join(ROOT, "src", "strategy.cpp")) as f:
+        text = f.read()
+    table = text[text.index("flag_names[]"):]
+    table = table[:table.index("};")]
+    names = re.findall(r'\{ STRAT_\w+, "(\w+)" \}', table)
+    builtin = re.findall(r'^\t\{ "(\w+)",', text, re.M)
+    return set(names + ["rfcal", "norfcal"]), builtin
+
+# "flag+flag/5" with "-" for nothing -> (flags, publish count)
+def split_flags(value):
+    value = value.strip()
+    count = None
+    if "/" in value:
+        value, count = value.rsplit("/", 1)
+        count = int(count)
+    flags = [f for f in value.replace(" ", "").split("+") if f and f != "-"]
+    return flags, count
+
+def join_flags(flags, count):
+    text = "+".join(flags)
+    return text + "/%d" % count if count else text
+
+# variants of the sweep file: (name, definition or None for built-in)
+def read_sweep(filename, flag_names, builtin):
+    config = configparser.ConfigParser(inline_comment_prefixes=("#", ";"))
+    config.optionxform = str
+    if not config.read(filename):
+        sys.exit("%s: can't read" % filename)
+    sweep = config["sweep"] if config.has_section("sweep") else {}
+    variants = []
+    if config.has_section("variants"):
+        for name, value in config.items("variants"):
+            if value.strip():
+                variants.append((name, value.strip()))
+            elif name in builtin:
+                variants.append((name, None))
+            else:
+                sys.exit("%s: no built-in strategy \"%s\"" % (filename, name))
+    if config.has_section("axes"):
+        base = split_flags(sweep.get("base", ""))
+        axes = [[split_flags(v) for v in values.split("|")] for _, values in config.items("axes")]
+        prefix = sweep.get("prefix", "x")
+        for i, combo in enumerate(itertools.product(*axes)):
+            flags, count = list(base[0]), base[1]
+            for f, c in combo:
+                flags += [x for x in f if x not in flags]
+                if c: count = c
+            variants.append(("%s%d" % (prefix, i + 1), join_flags(flags, count)))
+    if not variants:
+        sys.exit("%s: no [variants] or [axes]" % filename)
+    for name, value in variants:
+        if value is None:
+            continue
+        if len(name) > STRATEGY_NAME_MAX or not re.match(r"^\w+$", name):
+            sys.exit("%s: bad variant name \"%s\"" % (filename, name))
+        flags, count = split_flags(value)
+        unknown = [f for f in flags if f not in flag_names]
+        if unknown:
+            sys.exit("%s: %s: unknown flags %s" % (filename, name, ", ".join(unknown)))
+        if not flags:
+            sys.exit("%s: %s: no flags" % (filename, name))
+    names = [name for name, _ in variants]
+    if len(set(names)) != len(names):
+        sys.exit("%s: variant names must differ" % filename)
+    return sweep, variants
+
+# -D flags for one batch of variants
+def build_flags(batch, extra):
+    define = ",".join("%s=%s" % (name, value) for name, value in batch if value)
+    schedule = ",".join(name for name, _ in batch)
+    flags = ['-DSTRATEGY_SCHEDULE=\\"%s\\"' % schedule]
+    if define:
+        flags.append('-DSTRATEGY_DEFINE=\\"%s\\"' % define)
+    return flags + extra.split()
+
+def run(cmd, **kwargs):
+    print("+ " + " ".join(cmd), flush=True)
+    subprocess.run(cmd, check=True, **kwargs)
+
+def build_collect(outdir):
+    program = os.path.join(outdir, "serial_collect")
+    run(["g++", "-std=gnu++11", "-O2", "-Wall", "-o", program,
+         os.path.join(ROOT, "scripts", "serial_collect.cpp"),
+         os.path.join(ROOT, "scripts", "stream_stats.cpp")])
+    return program
+
+# the native env's sources, without needing PlatformIO
+def run_sim(batch, flags, boots, args, sim_options, outdir, index):
+    program = os.path.join(outdir, "sim_%d" % index)
+    tsv = os.path.join(outdir, "batch_%d.tsv" % index)
+    sources = [os.path.join(d, f) for d in (os.path.join(ROOT, "src"), os.path.join(ROOT, "src", "native"))
+               for f in sorted(os.listdir(d)) if f.endswith(".cpp")]
+    run(["g++", "-std=gnu++11", "-O2", "-I" + os.path.join(ROOT, "src", "native"),
+         "-I" + os.path.join(ROOT, "src"), "-include", os.path.join(ROOT, "src", "native", "secrets.h")] + [f.replace('\\"', '"') for f in flags] + sources + ["-o", program])
+    run([program, "-n", str(boots), "-s", str(args.seed + index), "-o", tsv] + sim_options.split(),
+        stdout=subprocess.DEVNULL)
+    return tsv
+
+def run_devices(batch, flags, boots, args, collect, outdir, index):
+    tsv = os.path.join(outdir, "batch_%d.tsv" % index)
+    if os.path.exists(tsv): os.remove(tsv)
+    env = dict(os.environ, PLATFORMIO_BUILD_FLAGS=" ".join(flags))
+    for device in args.device:
+        run(["pio", "run", "-d", ROOT, "-e", args.env, "-t", "upload", "--upload-port", device], env=env)
+    run([collect, "-s", tsv, "-r", "0", "-l", str(boots),
+         "-f", os.path.join(outdir, "fields.txt"), "-n", os.path.join(outdir, "names.txt")] + args.device,
+        stdout=subprocess.DEVNULL)
+    return tsv
+
+def main():
+    args = parse_args()
+    flag_names, builtin = read_flag_names()
+    sweep, variants = read_sweep(args.sweep, flag_names, builtin)
+    iterations = args.iterations or int(sweep.get("iterations", "100"))
+    compare = [c.strip() for c in sweep.get("compare", "setup_total").split(",") if c.strip()]
+    extra = sweep.get("build_flags", "")
+    outdir = args.output or "sweep_" + os.path.splitext(os.path.basename(args.sweep))[0]
+
+    batches = [variants[i:i + STRATEGY_MAX] for i in range(0, len(variants), STRATEGY_MAX)]
+    if len(batches) > 1:
+        print("%d variants, run in %d batches of up to %d: only variants in the same batch are interleaved"
+              % (len(variants), len(batches), STRATEGY_MAX))
+    for index, batch in enumerate(batches):
+        print("batch %d: %s" % (index, " ".join(build_flags(batch, extra))))
+        for name, value in batch:
+            print("  %-8s %s" % (name, value or "(built-in)"))
+    if args.dry_run:
+        return
+
+    os.makedirs(outdir, exist_ok=True)
+    collect = build_collect(outdir)
+    tsvs = []
+    for index, batch in enumerate(batches):
+        flags = build_flags(batch, extra)
+        boots = iterations * len(batch)
+        if args.device:
+            tsvs.append(run_devices(batch, flags, boots, args, collect, outdir, index))
+        else:
+            tsvs.append(run_sim(batch, flags, boots, args, sweep.get("sim_options", ""), outdir, index))
+
+    cmd = [collect, "-f", os.path.join(outdir, "fields.txt")]
+    for tsv in tsvs: cmd += ["-t", tsv]
+    for c in compare: cmd += ["-c", c]
+    report = subprocess.run(cmd, check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    with open(os.path.join(outdir, "report.txt"), "w") as f:
+        f.write(report)
+    # only the ranking, the statistics of every field are in report.txt
+    lines = report.splitlines()
+    first = next((i for i, line in enumerate(lines) if " by strategy, " in line), 0)
+    print("\n".join(lines[first:]))
+    print("\nfull report: %s" % os.path.join(outdir, "report.txt"))
+
+if __name__ == '__main__':
+    main()
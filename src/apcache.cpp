@@ -0,0 +1,150 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Ranked cache of access points for the fast connect
+ *
+ * Several APs (mesh, repeaters) can serve our SSID. The cache keeps the
+ * ones we used or saw in a scan, sorted so that the fast connect tries
+ * the most promising first: reliable, strong & quick, and not failing
+ * lately.
+ */
+
+#include <Arduino.h>
+
+#include "main.h"
+#include "apcache.h"
+
+/* Higher is better, empty entries rank last
+ */
+static int32_t ap_score(const AP_ENTRY_T *e) {
+	if (!e->channel) return INT32_MIN;
+	return (int32_t)min(e->success, (uint16_t)AP_SUCCESS_CAP) * 8
+		- (int32_t)e->fails * 40
+		+ e->rssi
+		- e->latency_ms / 16;
+}
+
+/* Insertion sort, it's only a handful of entries
+ */
+static void ap_cache_sort(AP_CACHE_T *c) {
+	for (uint8_t i = 1; i < AP_CACHE_SIZE; i++) {
+		AP_ENTRY_T e = c->ap[i];
+		uint8_t j = i;
+		while (j > 0 && ap_score(&c->ap[j - 1]) < ap_score(&e)) {
+			c->ap[j] = c->ap[j - 1];
+			j--;
+		}
+		c->ap[j] = e;
+	}
+}
+
+void ap_cache_clear(AP_CACHE_T *c) {
+	memset(c, 0, sizeof(AP_CACHE_T));
+}
+
+AP_ENTRY_T *ap_cache_find(AP_CACHE_T *c, const uint8_t *bssid) {
+	for (uint8_t i = 0; i < AP_CACHE_SIZE; i++) {
+		if (c->ap[i].channel && !memcmp(c->ap[i].bssid, bssid, 6)) return &c->ap[i];
+	}
+	return NULL;
+}
+
+/* Entry for this BSSID; a new one takes the last place if it ranks
+ * better than what is there
+ */
+static AP_ENTRY_T *ap_cache_get(AP_CACHE_T *c, const uint8_t *bssid, int32_t channel,
+		int32_t rssi) {
+	AP_ENTRY_T *e = ap_cache_find(c, bssid);
+	if (e) return e;
+	AP_ENTRY_T fresh;
+	memset(&fresh, 0, sizeof(fresh));
+	memcpy(fresh.bssid, bssid, 6);
+	fresh.channel = channel;
+	fresh.rssi = rssi;
+	e = &c->ap[AP_CACHE_SIZE - 1];
+	if (ap_score(e) >= ap_score(&fresh)) return NULL;
+	*e = fresh;
+	return e;
+}
+
+/* A scan found our SSID on this AP
+ */
+void ap_cache_seen(AP_CACHE_T *c, const uint8_t *bssid, int32_t channel, int32_t rssi) {
+	if (channel <= 0 || channel > 14) return;
+	AP_ENTRY_T *e = ap_cache_get(c, bssid, channel, rssi);
+	if (!e) return;
+	e->channel = channel;
+	e->rssi = constrain(rssi, -128, 0);
+	e->missed = 0;
+	ap_cache_sort(c);
+}
+
+/* We got connected to this AP; latency_ms 0 keeps the last known one
+ */
+void ap_cache_connected(AP_CACHE_T *c, const uint8_t *bssid, int32_t channel, int32_t rssi,
+		uint32_t latency_ms) {
+	if (channel <= 0 || channel > 14) return;
+	// the one we're on always gets a place
+	AP_ENTRY_T *e = ap_cache_find(c, bssid);
+	if (!e) {
+		e = &c->ap[AP_CACHE_SIZE - 1];
+		memset(e, 0, sizeof(AP_ENTRY_T));
+		memcpy(e->bssid, bssid, 6);
+	}
+	e->channel = channel;
+	e->rssi = constrain(rssi, -128, 0);
+	if (latency_ms) e->latency_ms = min(latency_ms, (uint32_t)UINT16_MAX);
+	if (e->success < UINT16_MAX) e->success++;
+	e->fails = e->missed = 0;
+	ap_cache_sort(c);
+}
+
+/* Connecting to this AP didn't work out in time
+ */
+void ap_cache_failed(AP_CACHE_T *c, const uint8_t *bssid) {
+	AP_ENTRY_T *e = ap_cache_find(c, bssid);
+	if (!e) return;
+	if (e->fails < AP_FAILS_MAX) e->fails++;
+	ap_cache_sort(c);
+}
+
+/* A background scan didn't see this AP; one scan can miss a beacon, so
+ * only every AP_PROBE_MISSES in a row count as a failed connect
+ */
+void ap_cache_missed(AP_CACHE_T *c, const uint8_t *bssid) {
+	AP_ENTRY_T *e = ap_cache_find(c, bssid);
+	if (!e) return;
+	if (++e->missed < AP_PROBE_MISSES) return;
+	e->missed = 0;
+	ap_cache_failed(c, bssid);
+}
+
+/* Show the cache on Serial
+ */
+void ap_cache_display(const AP_CACHE_T *c) {
+	#ifdef DEBUG_MODE
+	for (uint8_t i = 0; i < AP_CACHE_SIZE; i++) {
+		const AP_ENTRY_T *e = &c->ap[i];
+		if (!e->channel) continue;
+		Serial.printf_P(PSTR("AP %d:        %02X:%02X:%02X:%02X:%02X:%02X ch %d %ddBm %dms ok %d fail %d missed %d\n"),
+			i, e->bssid[0], e->bssid[1], e->bssid[2], e->bssid[3], e->bssid[4], e->bssid[5],
+			e->channel, e->rssi, e->latency_ms, e->success, e->fails, e->missed);
+	}
+	#endif
+}
@@ -0,0 +1,55 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef APCACHE_H
+#define APCACHE_H
+
+#include <Arduino.h>
+
+// ranked list of the APs we connected to or saw with our SSID, best first;
+// channel 0 marks an empty entry
+#define AP_CACHE_SIZE 4
+#define AP_SUCCESS_CAP 16 // successes beyond this don't raise the score
+#define AP_FAILS_MAX 255
+#define AP_PROBE_MISSES 3 // background scans in a row without it count as one fail
+
+struct AP_ENTRY_T {
+	uint8_t bssid[6];
+	uint8_t channel;
+	int8_t rssi;         // dBm, last seen
+	uint16_t latency_ms; // last connect time, 0 = unknown
+	uint16_t success;    // connects, saturating
+	uint8_t fails;       // failed connects since the last success
+	uint8_t missed;      // background scans in a row that didn't see it
+};
+
+struct AP_CACHE_T {
+	AP_ENTRY_T ap[AP_CACHE_SIZE];
+};
+
+void ap_cache_clear(AP_CACHE_T *c);
+AP_ENTRY_T *ap_cache_find(AP_CACHE_T *c, const uint8_t *bssid);
+void ap_cache_seen(AP_CACHE_T *c, const uint8_t *bssid, int32_t channel, int32_t rssi);
+void ap_cache_connected(AP_CACHE_T *c, const uint8_t *bssid, int32_t channel, int32_t rssi,
+	uint32_t latency_ms);
+void ap_cache_failed(AP_CACHE_T *c, const uint8_t *bssid);
+void ap_cache_missed(AP_CACHE_T *c, const uint8_t *bssid);
+void ap_cache_display(const AP_CACHE_T *c);
+
+#endif
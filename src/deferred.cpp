@@ -0,0 +1,56 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Deferred work: what is off the critical path to the publish waits in
+ * a small queue, then runs in order, each as its own trace span.
+ * Adding the same work twice only keeps the first.
+ */
+
+#include <Arduino.h>
+
+#include "deferred.h"
+#include "times.h"
+
+static DEFERRED_T deferred[DEFERRED_MAX];
+static uint8_t deferred_count = 0;
+
+/* False when the queue is full, then the caller has to do it right away
+ */
+bool deferred_add(PGM_P name, DEFERRED_FN fn, void *arg) {
+	for (uint8_t i = 0; i < deferred_count; i++) {
+		if (deferred[i].fn == fn && deferred[i].arg == arg) return true;
+	}
+	if (deferred_count >= DEFERRED_MAX) return false;
+	deferred[deferred_count].name = name;
+	deferred[deferred_count].fn = fn;
+	deferred[deferred_count].arg = arg;
+	deferred_count++;
+	return true;
+}
+
+/* Work may add more work, that runs in the same call
+ */
+void deferred_run() {
+	for (uint8_t i = 0; i < deferred_count; i++) {
+		TIME_START(ts_deferred);
+		deferred[i].fn(deferred[i].arg);
+		trace_stop(ts_deferred, deferred[i].name);
+	}
+	deferred_count = 0;
+}
@@ -17,38 +17,24 @@
   THE SOFTWARE.
 */
 
-#ifndef WIFI_HELPER_H
-#define WIFI_HELPER_H
+#ifndef DEFERRED_H
+#define DEFERRED_H
 
-struct WIFI_SETTINGS_T {
-  uint16_t magic;
-  uint32_t ip_address;
-  uint32_t ip_gateway;
-  uint32_t ip_mask;
-  uint32_t ip_dns1;
-  uint32_t ip_dns2;
-  char wifi_ssid[50];
-  char wifi_auth[50];
-  uint8_t wifi_bssid[6];
-  uint16_t wifi_channel;
-}; // size = 132 bytes
+#include <Arduino.h>
 
-const uint16_t WIFI_SETTINGS_MAGIC = 0xF3ED;
+// work that does not need to happen before the publish, like a DNS
+// refresh or an AP probe; queued on the way, run once it is done
+#define DEFERRED_MAX 8
 
-class WifiHelper {
-  public:
-    WifiHelper();
-    WifiHelper(int eeprom_offset);
-    void setup();
-    bool connect(const char *ssid, const char *auth);
-  private:
-    void _init_settings(const char *ssid, const char *auth);
-    bool _load_settings();
-    bool _save_settings();
-    bool _fast_connect();
-    bool _normal_connect();
-    struct WIFI_SETTINGS_T _settings;
-    int _eeprom_offset;
+typedef void (*DEFERRED_FN)(void *arg);
+
+struct DEFERRED_T {
+	PGM_P name;			// also the name of its trace span, PSTR()
+	DEFERRED_FN fn;
+	void *arg;
 };
 
+bool deferred_add(PGM_P name, DEFERRED_FN fn, void *arg);
+void deferred_run();
+
 #endif
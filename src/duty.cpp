@@ -0,0 +1,86 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Deep sleep duty cycle: the time budget of each wake, radio on & CPU
+ * awake, from millis(). It is shown at the very end of setup(), so only
+ * the last serial output & going to sleep are missing from it. The
+ * number of wakes is kept in RTC memory.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "main.h"
+#include "duty.h"
+#include "rtcmem.h"
+
+#define DUTY_RTC_MAGIC 0xD7C1
+
+struct DUTY_RTC_T {
+	uint16_t wakes;		// since the last cold start, wraps
+	uint16_t check;		// DUTY_RTC_MAGIC ^ wakes
+};
+
+static_assert(sizeof(DUTY_RTC_T) <= RTC_DUTY_BLOCKS * 4, "duty cycle RTC data doesn't fit");
+
+static uint32_t radio_off_ms = 0;
+
+/* Wakes before this one since the last cold start
+ */
+uint16_t duty_wakes() {
+	DUTY_RTC_T d;
+	ESP.rtcUserMemoryRead(RTC_DUTY_BLOCK, (uint32_t *)&d, sizeof(d));
+	return (d.check == (DUTY_RTC_MAGIC ^ d.wakes)) ? d.wakes : 0;
+}
+
+/* Once the publish & deferred work are done, nothing needs the radio
+ */
+void duty_radio_off() {
+	WiFi.mode(WIFI_OFF);
+	WiFi.forceSleepBegin();
+	radio_off_ms = millis();
+}
+
+/* This wake's budget so far, and the average current over a cycle of it
+ * plus seconds asleep, in uA
+ */
+void duty_display(uint32_t seconds) {
+	uint32_t awake_ms = millis();
+	uint32_t radio_ms = radio_off_ms ? radio_off_ms : awake_ms;
+	uint64_t cycle_ms = (uint64_t)seconds * 1000 + awake_ms;
+	uint64_t charge_uams = (uint64_t)radio_ms * DUTY_RADIO_MA * 1000
+		+ (uint64_t)(awake_ms - radio_ms) * DUTY_CPU_MA * 1000
+		+ (uint64_t)seconds * 1000 * DUTY_SLEEP_UA;
+	DEBUG_TAG("wake_count", duty_wakes() + 1);
+	DEBUG_TAG("wake_awake_ms", awake_ms);
+	DEBUG_TAG("wake_radio_ms", radio_ms);
+	DEBUG_TAG("duty_avg_ua", (int32_t)(charge_uams / cycle_ms));
+}
+
+/* Count this wake & sleep; wake_rf is the RFMode of the next wake
+ */
+void duty_sleep(uint32_t seconds, uint8_t wake_rf) {
+	DUTY_RTC_T d;
+	d.wakes = duty_wakes() + 1;
+	d.check = DUTY_RTC_MAGIC ^ d.wakes;
+	ESP.rtcUserMemoryWrite(RTC_DUTY_BLOCK, (uint32_t *)&d, sizeof(d));
+	Serial.flush();
+	ESP.deepSleep((uint64_t)seconds * 1000000, (RFMode)wake_rf);
+	for (;;) yield(); // deepSleep() doesn't return
+}
@@ -0,0 +1,40 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef DUTY_H
+#define DUTY_H
+
+#include <Arduino.h>
+
+// with -DDUTY_CYCLE_S=n, deep sleep n seconds after each publish instead
+// of the ESP.restart() loop, like a battery node would
+
+// rough currents for the charge estimate; radio on is mostly receiving
+#define DUTY_RADIO_MA 70
+#define DUTY_CPU_MA 15
+#define DUTY_SLEEP_UA 20
+
+#define DUTY_PROBE_WAKES 10 // one wake in n scans for our APs before sleeping
+
+uint16_t duty_wakes();
+void duty_radio_off();
+void duty_display(uint32_t seconds);
+void duty_sleep(uint32_t seconds, uint8_t wake_rf) __attribute__((noreturn));
+
+#endif
@@ -0,0 +1,36 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef FLASHMAP_H
+#define FLASHMAP_H
+
+#include <flash_hal.h>
+
+// who uses which sectors of the FS area; eagle.flash.512k64.ld has 16
+#define FLASH_LOG_SECTOR 0      // settings log, SETTINGS_LOG_SECTORS of them
+#define FLASH_STORE_SECTOR 4    // store_flash
+#define FLASH_LITTLEFS_SECTOR 8 // store_littlefs, up to the end
+
+#define FLASH_SECTOR_ADDR(s) (FS_PHYS_ADDR + (uint32_t)(s) * FS_PHYS_BLOCK)
+
+#if FS_PHYS_SIZE < 16 * FS_PHYS_BLOCK
+#error "the flash map needs a 64kB FS area, see board_build.ldscript"
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Compact log-scale histograms, small enough to keep with the settings
+ */
+
+#include <Arduino.h>
+
+#include "histogram.h"
+
+/* Upper edge of a bucket; half-octave steps, sqrt(2) ~ 181/128
+ */
+uint32_t histo_edge(uint32_t base, uint8_t bucket) {
+	if (bucket >= HISTO_BUCKETS - 1) return UINT32_MAX;
+	uint32_t edge = base << (bucket / 2);
+	if (bucket & 1) edge = edge * 181 / 128;
+	return edge;
+}
+
+static uint8_t histo_bucket(uint32_t base, uint32_t value) {
+	uint8_t bucket = 0;
+	while (bucket < HISTO_BUCKETS - 1 && value >= histo_edge(base, bucket)) bucket++;
+	return bucket;
+}
+
+/* Upper edge of the bucket holding the given percentile, for both count sizes
+ */
+template <typename T> static uint32_t counts_percentile(const T *count, uint32_t total, uint32_t base, uint8_t percent) {
+	uint32_t needed = (total * percent + 99) / 100;
+	uint32_t sum = 0;
+	for (uint8_t i = 0; i < HISTO_BUCKETS; i++) {
+		sum += count[i];
+		if (sum >= needed && sum > 0) return histo_edge(base, i);
+	}
+	return UINT32_MAX;
+}
+
+/* Count a value, aging the histogram when it gets full
+ */
+void histo_add(HISTO_T *h, uint32_t base, uint32_t value) {
+	uint8_t bucket = histo_bucket(base, value);
+	if (histo_total(h) >= HISTO_MAX_COUNT) {
+		for (uint8_t i = 0; i < HISTO_BUCKETS; i++) h->count[i] /= 2;
+	}
+	h->count[bucket]++;
+}
+
+uint32_t histo_total(const HISTO_T *h) {
+	uint32_t total = 0;
+	for (uint8_t i = 0; i < HISTO_BUCKETS; i++) total += h->count[i];
+	return total;
+}
+
+uint32_t histo_percentile(const HISTO_T *h, uint32_t base, uint8_t percent) {
+	return counts_percentile(h->count, histo_total(h), base, percent);
+}
+
+void histo8_add(HISTO8_T *h, uint32_t base, uint32_t value) {
+	uint8_t bucket = histo_bucket(base, value);
+	if (h->count[bucket] == UINT8_MAX) {
+		for (uint8_t i = 0; i < HISTO_BUCKETS; i++) h->count[i] /= 2;
+	}
+	h->count[bucket]++;
+}
+
+uint32_t histo8_total(const HISTO8_T *h) {
+	uint32_t total = 0;
+	for (uint8_t i = 0; i < HISTO_BUCKETS; i++) total += h->count[i];
+	return total;
+}
+
+uint32_t histo8_percentile(const HISTO8_T *h, uint32_t base, uint8_t percent) {
+	return counts_percentile(h->count, histo8_total(h), base, percent);
+}
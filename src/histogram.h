@@ -0,0 +1,48 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <Arduino.h>
+
+// log-scale histogram, buckets are half an octave wide: the upper edges
+// are base, base*1.41, base*2, base*2.83, ... and the last one is open
+#define HISTO_BUCKETS 16
+#define HISTO_MAX_COUNT 1000 // halve all counts beyond this, so old data fades
+
+struct HISTO_T {
+	uint16_t count[HISTO_BUCKETS];
+};
+
+// same buckets with 8 bit counts, for keeping several; all counts are
+// halved when one would overflow
+struct HISTO8_T {
+	uint8_t count[HISTO_BUCKETS];
+};
+
+void histo_add(HISTO_T *h, uint32_t base, uint32_t value);
+uint32_t histo_total(const HISTO_T *h);
+uint32_t histo_edge(uint32_t base, uint8_t bucket);
+uint32_t histo_percentile(const HISTO_T *h, uint32_t base, uint8_t percent);
+void histo8_add(HISTO8_T *h, uint32_t base, uint32_t value);
+uint32_t histo8_total(const HISTO8_T *h);
+uint32_t histo8_percentile(const HISTO8_T *h, uint32_t base, uint8_t percent);
+
+#endif
@@ -28,88 +28,156 @@
 #include <EEPROM.h>
 
 #include "main.h"
+#include "deferred.h"
+#include "duty.h"
 #include "times.h"
 #include "secrets.h"
 #include "settings.h"
+#include "store.h"
+#include "strategy.h"
+#include "tasks.h"
+#include "wifievents.h"
 #include "wifistuff.h"
 
 // Our testing MQTT topic
 #define MQTT_ACTION_TOPIC "wled/testing"
 #define MQTT_ACTION_VALUE "T"
 
+// publish the average of this many ADC readings instead, taken while
+// the wifi connects; 0 = MQTT_ACTION_VALUE
+#ifndef SENSOR_SAMPLES
+#define SENSOR_SAMPLES 0
+#endif
+#define SENSOR_SAMPLE_MS 5	// between readings, reading more often starves the wifi
+#define PAYLOAD_TIMEOUT 2000 // ms the publish waits for the payload
+
+struct SENSOR_T {
+	uint8_t count;
+	uint32_t sum;
+	uint32_t last_ms;
+	char payload[12];
+};
+
 struct WIFI_SETTINGS_T wifi_settings;
+static uint8_t next_wake_rf = WAKE_RF_DEFAULT; // of the next strategy
+static SENSOR_T sensor;
 
-// options for speed tests
-#define TRY_FASTCONNECT
-//#define TRY_AUTORECONNECT
-//#define TRY_ENABLESTA
-//#define TRY_USERECONNECT
-#define TRY_STATICIP
+/* Task: build the payload, see tasks.h; the readings run in the gaps of
+ * the connect
+ */
+static bool task_payload(TASK_T *t) {
+	SENSOR_T *s = (SENSOR_T *)t->arg;
+	TASK_BEGIN(t);
+	strcpy(s->payload, MQTT_ACTION_VALUE);
+	#if SENSOR_SAMPLES
+	for (s->sum = 0, s->count = 0; s->count < SENSOR_SAMPLES; s->count++) {
+		if (s->count) TASK_WAIT_UNTIL(t, millis() - s->last_ms >= SENSOR_SAMPLE_MS);
+		s->last_ms = millis();
+		s->sum += analogRead(A0);
+	}
+	snprintf(s->payload, sizeof(s->payload), "%u", (unsigned)(s->sum / SENSOR_SAMPLES));
+	#endif
+	TASK_END(t);
+}
+
+/* Off the critical path, see deferred_add()
+ */
+static void deferred_dns_refresh(void *arg) {
+	resolver_finish(&((WIFI_SETTINGS_T *)arg)->mqtt_dns);
+}
 
 /* main setup function, does the wifi connection + mqtt publishing
  */
 void setup() {
 	// requirements
 	WiFi.setAutoConnect(false);
+	wifi_events_setup(&WiFi);
 
 	Serial.begin(115200);
+	#ifndef DUTY_CYCLE_S
 	delay(1500); // wait some secs
-
-	// show settings
-	DEBUG_OUT("<start>");
-	DEBUG_OUTS("<strategy=");
-	DEBUG_OUTS("ch:?t,esp01,nodebug,");
-	DEBUG_OUTS("sdk-default,")
-	#ifdef TRY_FASTCONNECT
-	DEBUG_OUTS("fastconnect,");
-	#else
-	DEBUG_OUTS("no-settings,");
 	#endif
-	#ifdef TRY_AUTORECONNECT
-	DEBUG_OUTS("autoreconnect,");
-	#endif
-	#ifdef TRY_ENABLESTA
-	DEBUG_OUTS("enablesta,");
-	#endif
-	#ifdef TRY_USERECONNECT
-	DEBUG_OUTS("usereconnect,");
-	#endif
-	#ifdef TRY_STATICIP
-	DEBUG_OUTS("staticip,");
-	#endif
-	
-	DEBUG_OUT(">");
+
+	telemetry_start();
 
 	uint32_t start_time_all = millis();
 
+	trace_begin();
 	TIME_START(ts_setup_total);
+	TIME_START(ts_to_publish);
 	TIME_START(ts_setup_wifi);
 
+	// the publish needs the TCP connection & the payload, the payload
+	// nothing, so it runs while the wifi connects; the flash writes are
+	// deferred until after the publish
+	tasks_begin();
+	uint8_t t_wifi = task_add(PSTR("wifi"), NULL, NULL, 0);
+	uint8_t t_payload = task_add(PSTR("payload"), task_payload, &sensor, 0);
+	uint8_t t_tcp = task_add(PSTR("tcp"), NULL, NULL, TASK_BIT(t_wifi));
+	uint8_t t_publish = task_add(PSTR("publish"), NULL, NULL, TASK_BIT(t_tcp) | TASK_BIT(t_payload));
+
 	bool wifi_working = false;
 	bool save_wifi_settings = false;
 
-	DEBUG_OUT("get_settings_from_flash");
+	DEBUG_OUT(F("get_settings_from_flash"));
 
 	TIME_START(ts_get_flash);
 	bool data_ok = get_settings_from_flash(&wifi_settings);
 	TIME_STOP(ts_get_flash, "get_flash");
 
-	#ifdef TRY_FASTCONNECT
-	if ((!data_ok) || (wifi_settings.force_slow!=0)) {
-		DEBUG_OUTS("<slow_reason="); 
-		DEBUG_OUTS(data_ok?"forced":"settings_bad");
-		DEBUG_OUT(">");
+	// pick this boot's strategy, tag is shown after the timed part
+	const STRATEGY_T *strat = strategy_next(&wifi_settings);
+	task_start(t_wifi, 0);
+
+	if (!(strat->flags & STRAT_FASTCONNECT)) {
+		DEBUG_OUT(F("Try connection..."));
+		if (strat->flags & STRAT_ENABLESTA) WiFi.enableSTA(true);
+		if (strat->flags & STRAT_AUTORECONNECT) {
+			WiFi.setAutoReconnect(true);
+			//WiFi.setAutoConnect(true);
+			WiFi.persistent(true);
+		}
 
-		DEBUG_OUT("doing slow connect");
+		if ((strat->flags & STRAT_STATICIP) && data_ok) {
+			WiFi.config(IPAddress(wifi_settings.ip_address),
+				IPAddress(wifi_settings.ip_gateway), 
+				IPAddress(wifi_settings.ip_mask), 
+				IPAddress(wifi_settings.ip_dns1), 
+				IPAddress(wifi_settings.ip_dns2));
+		}
+
+		bool recon_ok = false;
+		if ((strat->flags & STRAT_USERECONNECT) && !wifi_settings.force_slow) {
+			TIME_START(ts_recon);
+			recon_ok = wifi_just_reconnect(&WiFi);
+			TIME_STOP(ts_recon, "just_reconnect");
+			wifi_working=recon_ok;
+			DEBUG_TAGS("wifi_reconnect", recon_ok?"true":"false");
+		}
+
+		if (!recon_ok) {
+			TIME_START(ts_slow_3);
+			bool try_slow = wifi_slow_connect(&WiFi);
+			TIME_STOP(ts_slow_3, "try_slow_connect");
+			wifi_working = try_slow;
+			if (wifi_settings.force_slow) { 
+				wifi_settings.force_slow=0; save_wifi_settings=true; 
+			}
+		}
+		if (!data_ok) save_wifi_settings=true;
+	} else if ((!data_ok) || (wifi_settings.force_slow!=0)) {
+		DEBUG_TAGS("slow_reason", data_ok?"forced":"settings_bad");
+
+		DEBUG_OUT(F("doing slow connect"));
 
 		TIME_START(ts_slow_1);
 		bool slow_ok = wifi_slow_connect(&WiFi);
 		TIME_STOP(ts_slow_1, "slow_connect_1");
-		DEBUG_OUT("<wifi_conn=slow>")
+		DEBUG_TAGS("wifi_conn", "slow");
 
 		if (!slow_ok) {
 			wifi_working = false;
-			DEBUG_OUT(" Failed ");
+			DEBUG_OUT(F(" Failed "));
 		} else {
 			// connected, cache settings
 			wifi_settings.force_slow = 0;
@@ -119,103 +187,79 @@ void setup() {
 	} else {
 		// try fast-connect
 		//display_settings(&wifi_settings);
-		DEBUG_OUT("Try wifi_fast_connect");
+		DEBUG_OUT(F("Try wifi_fast_connect"));
 
 		TIME_START(ts_wifi_fast);
-		bool can_fast = wifi_fast_connect(&wifi_settings, &WiFi);
+		bool can_fast = wifi_fast_connect(&wifi_settings, &WiFi, strat);
 		TIME_STOP(ts_wifi_fast, "wifi_fast_connect");
 
 		if (!can_fast) { 
 			// nope, revert to slow
-			DEBUG_OUT("<wifi_conn=fallback_slow>")
-			DEBUG_OUT("Try fallback wifi_slow_connect...");
+			DEBUG_TAGS("wifi_conn", "fallback_slow");
+			DEBUG_OUT(F("Try fallback wifi_slow_connect..."));
 			TIME_START(ts_slow_2);
 			bool try_slow = wifi_slow_connect(&WiFi);
 			TIME_STOP(ts_slow_2, "fallback_slow_connect");
 
 			if (!try_slow) {
 				wifi_working = false; // we failed. sad
-				DEBUG_OUT("Slow connect fallback failed");
+				DEBUG_OUT(F("Slow connect fallback failed"));
 			} else {
+				AP_ENTRY_T *ap = ap_cache_find(&wifi_settings.ap_cache, WiFi.BSSID());
+				if (ap && (WiFi.channel() == ap->channel)) {
+					DEBUG_TAGS("fast_missed", "true");
+					wifi_fast_missed(&wifi_settings, strat);
+				}
 				wifi_working = true;
 				save_wifi_settings = true;
 			}
 		} else {
-			DEBUG_OUT("<wifi_conn=fast>")
+			DEBUG_TAGS("wifi_conn", "fast");
 			wifi_working = true;
 		}
 	}
-	#else
-		DEBUG_OUT("Try connection...");
-		#ifdef TRY_ENABLESTA
-		WiFi.enableSTA(true);
-		#endif
-		#ifdef TRY_AUTORECONNECT
-	    WiFi.setAutoReconnect(true);
-		//WiFi.setAutoConnect(true);
-		WiFi.persistent(true);
-		#endif
-
-		#ifdef TRY_STATICIP
-		WiFi.config(IPAddress(wifi_settings.ip_address),
-			IPAddress(wifi_settings.ip_gateway), 
-			IPAddress(wifi_settings.ip_mask), 
-			IPAddress(wifi_settings.ip_dns1), 
-			IPAddress(wifi_settings.ip_dns2));
-		#endif
+	DEBUG_TAGS("wifi_ok", wifi_working?"true":"false");
 
-		bool recon_ok = false;
-		#ifdef TRY_USERECONNECT
-		if (!wifi_settings.force_slow) {
-			TIME_START(ts_recon);
-			recon_ok = wifi_just_reconnect(&WiFi);
-			TIME_STOP(ts_recon, "just_reconnect");
-			wifi_working=recon_ok;
-			DEBUG_OUT(recon_ok?"<wifi_reconnect=true>":"<wifi_reconnect=false>");
-		}
-		#endif
-
-		if (!recon_ok) {
-			TIME_START(ts_slow_3);
-			bool try_slow = wifi_slow_connect(&WiFi);
-			TIME_STOP(ts_slow_3, "try_slow_connect");
-			wifi_working = try_slow;
-			if (wifi_settings.force_slow) { 
-				wifi_settings.force_slow=0; save_wifi_settings=true; 
-			}
-		}
-		if (!data_ok) save_wifi_settings=true;
-	#endif
-	DEBUG_OUT(wifi_working?"<wifi_ok=true>":"<wifi_ok=false>");
+	wifi_events_display();
 
 	if (wifi_working) {
-		DEBUG_OUTS("<channel="); DEBUG_OUTS(WiFi.channel()); DEBUG_OUT(">");
-		DEBUG_OUTS("<bssid="); DEBUG_OUTS(WiFi.BSSIDstr().c_str()); DEBUG_OUT(">");
+		DEBUG_TAG("channel", WiFi.channel());
+		DEBUG_TAGS("bssid", WiFi.BSSIDstr().c_str());
 	}
 
 	if (random(100)>90) {
 		wifi_settings.force_slow=1;
 		save_wifi_settings = true;
-		DEBUG_OUT("Wifi forced next run");
+		DEBUG_OUT(F("Wifi forced next run"));
 	}
 
 	if (wifi_working && save_wifi_settings) {
-		DEBUG_OUT("Save settings to struct");
+		DEBUG_OUT(F("Save settings to struct"));
 		TIME_START(ts_save_to_struct);
 		build_settings_from_wifi(&wifi_settings, &WiFi);
 		TIME_STOP(ts_save_to_struct, "save_to_struct");
+		//display_settings(&wifi_settings);
+	}
 
-		DEBUG_OUT("save_settings_to_flash ");
-		TIME_START(ts_save_to_flash);
-		save_settings_to_flash(&wifi_settings);
-		TIME_STOP(ts_save_to_flash, "save_to_flash");
+	// the publish only waits for DNS without a broker address, e.g. when
+	// the last lookup failed; the settings are saved after the timed part
+	if (wifi_working && !wifi_settings.mqtt_dns.ip) {
+		TIME_START(ts_dns);
+		resolver_lookup(&wifi_settings.mqtt_dns, settings_str(&wifi_settings, SETTINGS_MQTT_HOST), WiFi.dnsIP(0));
+		TIME_STOP(ts_dns, "dns_resolve");
+	}
 
-		//display_settings(&wifi_settings);
+	// past its TTL: ask again now, the answer is picked up after the
+	// publish, meanwhile the cached address is used
+	if (wifi_working && wifi_settings.mqtt_dns.ip && resolver_stale(&wifi_settings.mqtt_dns)) {
+		if (resolver_start(settings_str(&wifi_settings, SETTINGS_MQTT_HOST), WiFi.dnsIP(0)))
+			deferred_add(PSTR("dns_refresh"), deferred_dns_refresh, &wifi_settings);
 	}
 
+	task_stop(t_wifi);
 	TIME_STOP(ts_setup_wifi, "setup_wifi");
 
-	DEBUG_OUT("");
+	DEBUG_OUT(F(""));
 
 	TIME_START(ts_setup_mqtt);
 
@@ -224,75 +268,128 @@ void setup() {
 		WiFiClient wclient;
 		//show_connection(&WiFi);
 
-		DEBUG_OUT("preconnect_ip ");
-		TIME_START(ts_preconnect);
-		bool can_precon = preconnect_ip(&wclient, wifi_settings.mqtt_host_ip, wifi_settings.mqtt_host_port);
-		TIME_STOP(ts_preconnect, "preconnect_ip");
+		bool can_precon = true;
+		task_start(t_tcp, 0);
+		if (strat->flags & STRAT_PRECONNECT) {
+			DEBUG_OUT(F("preconnect_ip "));
+			TIME_START(ts_preconnect);
+			can_precon = preconnect_ip(&wclient, wifi_settings.mqtt_dns.ip, wifi_settings.mqtt_host_port);
+			TIME_STOP(ts_preconnect, "preconnect_ip");
+			wifi_events_display_tcp();
+		}
+		task_stop(t_tcp);
 
 		if (can_precon) {
-			DEBUG_OUT("<preconnect=true>");
-			DEBUG_OUT("publish_mqtt ");
+			DEBUG_TAGS("preconnect", (strat->flags & STRAT_PRECONNECT)?"true":"skipped");
+			// on a timeout, publish what the payload has so far
+			if (!task_start(t_publish, PAYLOAD_TIMEOUT)) DEBUG_OUT(F("payload not ready "));
+			DEBUG_OUT(F("publish_mqtt "));
 			TIME_START(ts_mqtt_pub);
-			bool pub_ok = publish_mqtt(&wclient, &wifi_settings, 
-				MQTT_ACTION_TOPIC, MQTT_ACTION_VALUE);
+			bool pub_ok = publish_mqtt(&wclient, &wifi_settings, strat,
+				MQTT_ACTION_TOPIC, sensor.payload);
 			TIME_STOP(ts_mqtt_pub, "publish_mqtt");
+			task_stop(t_publish);
 
 			if (pub_ok) {
 				mqtt_worked = true;
-				DEBUG_OUT("MQTT publish OK ");
+				DEBUG_OUT(F("MQTT publish OK "));
 			} else {
 				mqtt_worked = false;
-				DEBUG_OUT("MQTT publish Failed ");
+				DEBUG_OUT(F("MQTT publish Failed "));
 			}
 		} else {
-			DEBUG_OUT("<preconnect=false>");
+			DEBUG_TAGS("preconnect", "false");
 			mqtt_worked = false;
-			DEBUG_OUT("MQTT preconnect failed ");
+			DEBUG_OUT(F("MQTT preconnect failed "));
 		}
 	}
 	TIME_STOP(ts_setup_mqtt, "setup_mqtt");
-	DEBUG_OUT(mqtt_worked?"<mqtt_ok=true>":"<mqtt_ok=false>");
+	TIME_STOP(ts_to_publish, "time_to_publish");
+	DEBUG_TAGS("mqtt_ok", mqtt_worked?"true":"false");
+
+	// now and then, look for our APs while the radio is idle anyway;
+	// the results are merged in loop(), after the timed part, or with
+	// the duty cycle before the radio goes off, on one wake in
+	// DUTY_PROBE_WAKES
+	#ifdef DUTY_CYCLE_S
+	bool probe = (duty_wakes() + 1) % DUTY_PROBE_WAKES == 0;
+	#else
+	bool probe = random(100) > 90;
+	#endif
+	if (wifi_working && (wifi_settings.magic == MAGIC_NUM) && probe)
+		deferred_add(PSTR("ap_probe"), wifi_probe_start, &wifi_settings);
+
+	// the publish is done or failed, the radio is idle
+	deferred_run();
 
 	TIME_STOP(ts_setup_total, "setup_total");
 
+	#ifdef DUTY_CYCLE_S
+	if (wifi_settings.magic == MAGIC_NUM) wifi_probe_finish(&wifi_settings); // needs the radio
+	duty_radio_off();
+	#endif
+
+	// show settings
+	strategy_display(strat);
+	publish_mqtt_display();
+	tasks_display();
+
+	// count the phase times & keep the strategy schedule going, outside
+	// of the timed part
+	if (wifi_settings.magic == MAGIC_NUM) {
+		phases_record(&wifi_settings.phases);
+		// close enough, only the reboot & delay in loop() are missing
+		#ifdef DUTY_CYCLE_S
+		resolver_age(&wifi_settings.mqtt_dns, millis() + DUTY_CYCLE_S * 1000UL);
+		#else
+		resolver_age(&wifi_settings.mqtt_dns, millis());
+		#endif
+	}
+	next_wake_rf = strategy_peek(&wifi_settings)->wake_rf;
+	TIME_START(ts_save_to_flash);
+	save_settings_to_flash(&wifi_settings);
+	TIME_STOP(ts_save_to_flash, "save_to_flash");
+	display_settings_storage();
+	phases_display(&wifi_settings.phases);
+
+	#ifdef STORE_BENCHMARK
+	store_benchmark(&wifi_settings, sizeof(WIFI_SETTINGS_T));
+	#endif
+
+	// the timed part is over, now it's ok to print the spans
+	trace_flush();
+
 	#ifdef DEBUG_MODE
 	Serial.println();
-	Serial.print("Duration: "); 
+	Serial.print(F("Duration: ")); 
 	Serial.print((millis()-start_time_all)); 
-	Serial.println(" ms");
+	Serial.println(F(" ms"));
 	#endif
 
-	DEBUG_OUT("<complete>");
+	#ifdef DUTY_CYCLE_S
+	duty_display(DUTY_CYCLE_S); // last, to count as much of the wake as possible
+	#endif
+	telemetry_complete();
 }
 
 /* main loop:
- *   10% of the time: scan the wifi networks and display them; 
- *                    useful for checking if the right BSSID, channel
+ *   With DUTY_CYCLE_S: deep sleep, waking up the way the next strategy
+ *                    wants it
+ *   10% of the time: merge the scan for our SSID started after the
+ *                    publish into the AP cache, so a moved AP is
+ *                    tried on its new channel next time
  *   Then: reboot
  */
 void loop() {
-	// nothing, reboot
-	if (random(100)>90) {
-		DEBUG_OUT("Scanning wifi");
-		WiFi.mode(WIFI_STA);
-		WiFi.disconnect();
-		int n = WiFi.scanNetworks(false, true);
-
-		for (int i = 0; i < n; i++) {
-			DEBUG_OUTS(i + 1);
-			DEBUG_OUTS(": ");
-			DEBUG_OUTS(WiFi.SSID(i));// SSID
-			DEBUG_OUTS(" - ");
-			DEBUG_OUTS(WiFi.RSSI(i));//Signal strength in dBm  
-			DEBUG_OUTS("dBm, Channel ");
-			DEBUG_OUTS(WiFi.channel(i));
-			DEBUG_OUTS(" @ ");
-			DEBUG_OUTS(WiFi.BSSIDstr(i));
-			DEBUG_OUT("");
-		}
-	}
+	#ifdef DUTY_CYCLE_S
+	duty_sleep(DUTY_CYCLE_S, next_wake_rf);
+	#endif
+
+	// pick up the background scan, if one was started
+	if ((wifi_settings.magic == MAGIC_NUM) && wifi_probe_finish(&wifi_settings))
+		save_settings_to_flash(&wifi_settings);
 	delay(500);
-	DEBUG_OUT("REBOOTING NOW");
+	DEBUG_OUT(F("REBOOTING NOW"));
 	ESP.restart();
-	DEBUG_OUT("BUT WHY");
+	DEBUG_OUT(F("BUT WHY"));
 }
@@ -20,14 +20,27 @@
 #ifndef MAIN_H
 #define MAIN_H
 
+#include "telemetry.h"
+
 #define DEBUG_MODE
 
+// string literals go through F(), so they stay in flash instead of RAM
 #ifdef DEBUG_MODE
 #define DEBUG_OUT(x) {Serial.println(x);}
 #define DEBUG_OUTS(x) {Serial.print(x);}
+// <key=value> tags with a literal key, kept in flash, see telemetry.h;
+// the _P ones take a key pointer, in flash or RAM
+#define DEBUG_TAG(key, value) {telemetry_value(PSTR(key), value);}
+#define DEBUG_TAGS(key, text) {telemetry_text(PSTR(key), text);}
+#define DEBUG_TAG_P(key, value) {telemetry_value(key, value);}
+#define DEBUG_TAGS_P(key, text) {telemetry_text(key, text);}
 #else
 #define DEBUG_OUT(x) {}
 #define DEBUG_OUTS(x) {}
+#define DEBUG_TAG(key, value) {}
+#define DEBUG_TAGS(key, text) {}
+#define DEBUG_TAG_P(key, value) {}
+#define DEBUG_TAGS_P(key, text) {}
 #endif
 
 #endif
@@ -0,0 +1,293 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Minimal MQTT client that does not wait for the CONNACK before it
+ * publishes: the broker handles the packets of a connection in order,
+ * so PUBLISHes right behind the CONNECT are fine. With Nagle off the
+ * whole flight leaves in one segment, instead of a write and possibly
+ * a delayed ACK per packet.
+ * With QoS1 the flight stops at the window, and mqtt_lite_acks() sends
+ * the rest as the PUBACKs come in; the DISCONNECT goes last.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "mqttlite.h"
+
+#define MQTT_CONNECT    0x10
+#define MQTT_CONNACK    0x20
+#define MQTT_PUBLISH    0x30
+#define MQTT_PUBACK     0x40
+#define MQTT_DISCONNECT 0xE0
+
+#define MQTT_QOS1 0x02
+#define MQTT_DUP  0x08
+
+#define MQTT_CLEAN_SESSION 0x02
+#define MQTT_PASSWORD      0x40
+#define MQTT_USERNAME      0x80
+
+/* Fixed header; the remaining length is a varint of up to 4 bytes, but
+ * a packet never exceeds the buffer, so at most 2 are used here
+ */
+static bool mqtt_lite_header(MQTT_LITE_T *m, uint8_t type, uint32_t remaining) {
+	uint8_t head[5];
+	uint8_t n = 0;
+	head[n++] = type;
+	do {
+		uint8_t b = remaining & 0x7F;
+		remaining >>= 7;
+		head[n++] = remaining ? b | 0x80 : b;
+	} while (remaining);
+	if (m->overflow || m->len + n > MQTT_LITE_BUF) { m->overflow = true; return false; }
+	memcpy(&m->buf[m->len], head, n);
+	m->len += n;
+	return true;
+}
+
+static void mqtt_lite_bytes(MQTT_LITE_T *m, const void *data, uint16_t len) {
+	if (m->overflow || m->len + len > MQTT_LITE_BUF) { m->overflow = true; return; }
+	memcpy(&m->buf[m->len], data, len);
+	m->len += len;
+}
+
+static void mqtt_lite_string(MQTT_LITE_T *m, const char *s) {
+	uint16_t len = strlen(s);
+	uint8_t be[2] = { (uint8_t)(len >> 8), (uint8_t)len };
+	mqtt_lite_bytes(m, be, 2);
+	mqtt_lite_bytes(m, s, len);
+}
+
+void mqtt_lite_begin(MQTT_LITE_T *m) {
+	m->len = m->sent = 0;
+	m->overflow = false;
+	m->msg_count = m->retransmits = 0;
+}
+
+/* No will; user & pass may be NULL. Without a clean session the broker
+ * keeps the session of this client id between connections
+ */
+void mqtt_lite_connect(MQTT_LITE_T *m, const char *client_id, const char *user, const char *pass,
+		bool clean_session) {
+	static const uint8_t variable[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+	uint8_t flags = clean_session ? MQTT_CLEAN_SESSION : 0;
+	uint32_t remaining = sizeof(variable) + 1 + 2 + 2 + strlen(client_id);
+	if (user) { flags |= MQTT_USERNAME; remaining += 2 + strlen(user); }
+	if (user && pass) { flags |= MQTT_PASSWORD; remaining += 2 + strlen(pass); }
+	if (!mqtt_lite_header(m, MQTT_CONNECT, remaining)) return;
+	uint8_t tail[3] = { flags, MQTT_LITE_KEEPALIVE >> 8, MQTT_LITE_KEEPALIVE & 0xFF };
+	mqtt_lite_bytes(m, variable, sizeof(variable));
+	mqtt_lite_bytes(m, tail, sizeof(tail));
+	mqtt_lite_string(m, client_id);
+	if (flags & MQTT_USERNAME) mqtt_lite_string(m, user);
+	if (flags & MQTT_PASSWORD) mqtt_lite_string(m, pass);
+}
+
+/* QoS0, not retained; no packet id
+ */
+void mqtt_lite_publish(MQTT_LITE_T *m, const char *topic, const char *payload) {
+	uint16_t payload_len = strlen(payload);
+	if (!mqtt_lite_header(m, MQTT_PUBLISH, 2 + strlen(topic) + payload_len)) return;
+	mqtt_lite_string(m, topic);
+	mqtt_lite_bytes(m, payload, payload_len);
+}
+
+/* Packet id must not be 0, nor in use by another unacknowledged PUBLISH
+ */
+void mqtt_lite_publish_qos1(MQTT_LITE_T *m, const char *topic, const char *payload, uint16_t id) {
+	if (m->msg_count >= MQTT_LITE_MSGS) { m->overflow = true; return; }
+	uint16_t offset = m->len, payload_len = strlen(payload);
+	uint8_t be[2] = { (uint8_t)(id >> 8), (uint8_t)id };
+	if (!mqtt_lite_header(m, MQTT_PUBLISH | MQTT_QOS1, 2 + strlen(topic) + 2 + payload_len)) return;
+	mqtt_lite_string(m, topic);
+	mqtt_lite_bytes(m, be, 2);
+	mqtt_lite_bytes(m, payload, payload_len);
+	if (m->overflow) return;
+	MQTT_LITE_MSG_T *msg = &m->msg[m->msg_count++];
+	memset(msg, 0, sizeof(MQTT_LITE_MSG_T));
+	msg->id = id;
+	msg->offset = offset;
+	msg->len = m->len - offset;
+}
+
+/* Lets the broker close the session right away, without a will
+ */
+void mqtt_lite_disconnect(MQTT_LITE_T *m) {
+	mqtt_lite_header(m, MQTT_DISCONNECT, 0);
+}
+
+/* Write what may go out now: up to the first QoS1 PUBLISH outside the
+ * window, and what follows the last one only once all are acknowledged
+ */
+static bool mqtt_lite_flush(MQTT_LITE_T *m, WiFiClient *wclient) {
+	uint16_t end = m->len;
+	uint8_t in_flight = 0;
+	for (uint8_t i = 0; i < m->msg_count; i++) {
+		MQTT_LITE_MSG_T *msg = &m->msg[i];
+		if (msg->acked) continue;
+		if (!msg->tries && in_flight >= MQTT_LITE_WINDOW) { end = msg->offset; break; }
+		in_flight++;
+	}
+	if (in_flight && end == m->len) {
+		MQTT_LITE_MSG_T *last = &m->msg[m->msg_count - 1];
+		end = last->offset + last->len;
+	}
+	if (end <= m->sent) return true;
+	uint32_t now_ms = millis(), now_us = micros();
+	for (uint8_t i = 0; i < m->msg_count; i++) {
+		MQTT_LITE_MSG_T *msg = &m->msg[i];
+		if (msg->tries || msg->offset >= end) continue;
+		msg->tries = 1;
+		msg->sent_ms = now_ms;
+		msg->first_us = now_us;
+	}
+	uint16_t len = end - m->sent;
+	bool ok = wclient->write(&m->buf[m->sent], len) == len;
+	m->sent = end;
+	return ok;
+}
+
+/* The TCP connection must already be open
+ */
+bool mqtt_lite_send(MQTT_LITE_T *m, WiFiClient *wclient) {
+	if (m->overflow || !m->len) return false;
+	wclient->setNoDelay(true);
+	m->sent = 0;
+	return mqtt_lite_flush(m, wclient);
+}
+
+/* QoS1 PUBLISHes as mqtt_lite_unacked() left them, back to back, with
+ * their packet ids & DUP flags; returns how many were added
+ */
+uint8_t mqtt_lite_publish_packets(MQTT_LITE_T *m, const uint8_t *data, uint16_t len) {
+	uint8_t added = 0;
+	uint16_t pos = 0;
+	while (pos + 2 <= len && m->msg_count < MQTT_LITE_MSGS) {
+		uint16_t head = 2, remaining = data[pos + 1] & 0x7F;
+		if (data[pos + 1] & 0x80) {
+			if (pos + 3 > len || data[pos + 2] & 0x80) break;
+			remaining |= data[pos + 2] << 7;
+			head++;
+		}
+		if ((data[pos] & ~MQTT_DUP) != (MQTT_PUBLISH | MQTT_QOS1) || remaining < 4) break;
+		if (pos + head + remaining > len) break;
+		const uint8_t *p = &data[pos + head];
+		uint16_t topic_len = p[0] << 8 | p[1];
+		if (2 + topic_len + 2 > remaining) break;
+		uint16_t offset = m->len;
+		mqtt_lite_bytes(m, &data[pos], head + remaining);
+		if (m->overflow) break;
+		MQTT_LITE_MSG_T *msg = &m->msg[m->msg_count++];
+		memset(msg, 0, sizeof(MQTT_LITE_MSG_T));
+		msg->id = p[2 + topic_len] << 8 | p[3 + topic_len];
+		msg->offset = offset;
+		msg->len = head + remaining;
+		pos += head + remaining;
+		added++;
+	}
+	return added;
+}
+
+/* The QoS1 PUBLISHes not acknowledged, oldest first & back to back, as
+ * many as fit in *len bytes & max; DUP set on the ones that went out.
+ * Returns how many, *len the bytes used
+ */
+uint8_t mqtt_lite_unacked(const MQTT_LITE_T *m, uint8_t *buf, uint16_t *len, uint8_t max) {
+	uint16_t size = *len;
+	uint8_t n = 0;
+	*len = 0;
+	if (m->overflow) return 0;
+	for (uint8_t i = 0; i < m->msg_count && n < max; i++) {
+		const MQTT_LITE_MSG_T *msg = &m->msg[i];
+		if (msg->acked) continue;
+		if (*len + msg->len > size) break;
+		memcpy(&buf[*len], &m->buf[msg->offset], msg->len);
+		if (msg->tries) buf[*len] |= MQTT_DUP;
+		*len += msg->len;
+		n++;
+	}
+	return n;
+}
+
+/* True when the broker accepted the session; the CONNACK is sent before
+ * the broker closes after the DISCONNECT, so it can still be read: the
+ * client counts as connected while there is something to read. Without
+ * a CONNACK, a closed connection ends the wait early. session_present
+ * may be NULL.
+ */
+bool mqtt_lite_connack(WiFiClient *wclient, bool *session_present) {
+	uint8_t ack[4];
+	uint8_t n = 0;
+	uint32_t timeout = millis() + MQTT_LITE_TIMEOUT;
+	while (n < sizeof(ack) && millis() < timeout) {
+		if (wclient->available()) {
+			ack[n++] = wclient->read();
+		} else if (!wclient->connected()) {
+			return false; // closed by the broker, nothing more to come
+		} else {
+			yield();
+		}
+	}
+	bool ok = n == sizeof(ack) && ack[0] == MQTT_CONNACK && ack[1] == 2 && ack[3] == 0;
+	if (session_present) *session_present = ok && (ack[2] & 0x01);
+	return ok;
+}
+
+/* After the CONNACK: match PUBACKs to the QoS1 PUBLISHes, send the rest
+ * of the flight as the window opens & retry the ones not acknowledged;
+ * true once all are acknowledged & the DISCONNECT is sent
+ */
+bool mqtt_lite_acks(MQTT_LITE_T *m, WiFiClient *wclient) {
+	uint8_t ack[4];
+	uint8_t n = 0, acked = 0;
+	uint32_t timeout = millis() + MQTT_LITE_TIMEOUT;
+	while (acked < m->msg_count && millis() < timeout) {
+		if (wclient->available()) {
+			ack[n++] = wclient->read();
+			if (n < sizeof(ack)) continue;
+			n = 0;
+			if (ack[0] != MQTT_PUBACK || ack[1] != 2) return false;
+			uint16_t id = ack[2] << 8 | ack[3];
+			for (uint8_t i = 0; i < m->msg_count; i++) {
+				MQTT_LITE_MSG_T *msg = &m->msg[i];
+				if (msg->id != id || !msg->tries || msg->acked) continue;
+				msg->acked = true;
+				msg->ack_us = micros() - msg->first_us;
+				acked++;
+				break;
+			}
+			if (!mqtt_lite_flush(m, wclient)) return false;
+			continue;
+		}
+		if (!wclient->connected()) return false;
+		for (uint8_t i = 0; i < m->msg_count; i++) {
+			MQTT_LITE_MSG_T *msg = &m->msg[i];
+			if (!msg->tries || msg->acked || millis() - msg->sent_ms < MQTT_LITE_RETRY) continue;
+			if (msg->tries >= MQTT_LITE_TRIES) return false;
+			m->buf[msg->offset] |= MQTT_DUP;
+			if (wclient->write(&m->buf[msg->offset], msg->len) != msg->len) return false;
+			msg->tries++;
+			msg->sent_ms = millis();
+			m->retransmits++;
+		}
+		yield();
+	}
+	return acked == m->msg_count && m->sent == m->len;
+}
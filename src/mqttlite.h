@@ -0,0 +1,73 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef MQTTLITE_H
+#define MQTTLITE_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// MQTT 3.1.1 packets for one flight: CONNECT, PUBLISHes & DISCONNECT
+// built into one buffer, then written at once; nothing is allocated
+#define MQTT_LITE_BUF 256
+#define MQTT_LITE_KEEPALIVE 15 // seconds, same as PubSubClient
+#define MQTT_LITE_TIMEOUT 15000 // ms to wait for the CONNACK, or all PUBACKs
+
+// QoS1: at most MQTT_LITE_WINDOW PUBLISHes wait for their PUBACK at once,
+// the rest follow as PUBACKs come in; one that is not acknowledged
+// within MQTT_LITE_RETRY ms is sent again with DUP set
+#define MQTT_LITE_MSGS 8
+#define MQTT_LITE_WINDOW 4
+#define MQTT_LITE_RETRY 1000
+#define MQTT_LITE_TRIES 3
+
+struct MQTT_LITE_MSG_T {
+	uint16_t id;		// packet id
+	uint16_t offset;	// of the PUBLISH in buf
+	uint16_t len;
+	uint8_t tries;		// 0 = not sent yet
+	bool acked;
+	uint32_t sent_ms;	// millis() of the last try
+	uint32_t first_us;	// micros() of the first try
+	uint32_t ack_us;	// first try to PUBACK
+};
+
+struct MQTT_LITE_T {
+	uint8_t buf[MQTT_LITE_BUF];
+	uint16_t len;
+	uint16_t sent;	// bytes of buf written so far
+	bool overflow;	// a packet did not fit, the flight is not sent
+	MQTT_LITE_MSG_T msg[MQTT_LITE_MSGS]; // the QoS1 PUBLISHes
+	uint8_t msg_count;
+	uint8_t retransmits;
+};
+
+void mqtt_lite_begin(MQTT_LITE_T *m);
+void mqtt_lite_connect(MQTT_LITE_T *m, const char *client_id, const char *user, const char *pass,
+	bool clean_session);
+void mqtt_lite_publish(MQTT_LITE_T *m, const char *topic, const char *payload);
+void mqtt_lite_publish_qos1(MQTT_LITE_T *m, const char *topic, const char *payload, uint16_t id);
+void mqtt_lite_disconnect(MQTT_LITE_T *m);
+bool mqtt_lite_send(MQTT_LITE_T *m, WiFiClient *wclient);
+uint8_t mqtt_lite_publish_packets(MQTT_LITE_T *m, const uint8_t *data, uint16_t len);
+uint8_t mqtt_lite_unacked(const MQTT_LITE_T *m, uint8_t *buf, uint16_t *len, uint8_t max);
+bool mqtt_lite_connack(WiFiClient *wclient, bool *session_present);
+bool mqtt_lite_acks(MQTT_LITE_T *m, WiFiClient *wclient);
+
+#endif
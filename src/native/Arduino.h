@@ -0,0 +1,200 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the parts of the ESP8266 Arduino core that this
+ * project uses. Only built for [env:native], see sim.h.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+
+using std::min;
+using std::max;
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define DEC 10
+#define HEX 16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+uint64_t micros64();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+#define A0 17
+int analogRead(uint8_t pin);
+
+// flash strings: on the ESP8266 these stay in flash and are read with
+// 32-bit loads; here all memory is the same
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(PSTR(s))
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define memcpy_P memcpy
+#define strcmp_P strcmp
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define strncat_P strncat
+
+class String {
+	public:
+		String() {}
+		String(const char *s) : _s(s ? s : "") {}
+		String(const std::string &s) : _s(s) {}
+		String(char c) : _s(1, c) {}
+		String(int v, unsigned char base=DEC);
+		String(unsigned int v, unsigned char base=DEC);
+		String(long v, unsigned char base=DEC);
+		String(unsigned long v, unsigned char base=DEC);
+		const char *c_str() const { return _s.c_str(); }
+		unsigned int length() const { return _s.length(); }
+		bool equals(const String &o) const { return _s == o._s; }
+		bool operator==(const String &o) const { return _s == o._s; }
+		bool operator==(const char *o) const { return _s == o; }
+		bool operator!=(const String &o) const { return _s != o._s; }
+		String &operator+=(const String &o) { _s += o._s; return *this; }
+		String &operator+=(const char *o) { _s += o; return *this; }
+		String &operator+=(char c) { _s += c; return *this; }
+		String operator+(const String &o) const { return String(_s + o._s); }
+		char operator[](unsigned int i) const { return _s[i]; }
+	private:
+		std::string _s;
+};
+
+class Print;
+
+class Printable {
+	public:
+		virtual ~Printable() {}
+		virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+	public:
+		virtual ~Print() {}
+		virtual size_t write(uint8_t c) = 0;
+		virtual size_t write(const uint8_t *buf, size_t len);
+		size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+		size_t print(const char *s) { return write(s); }
+		size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+		size_t print(const String &s) { return write(s.c_str()); }
+		size_t print(char c) { return write((uint8_t)c); }
+		size_t print(unsigned char v, int base=DEC) { return print((unsigned long)v, base); }
+		size_t print(int v, int base=DEC) { return print((long)v, base); }
+		size_t print(unsigned int v, int base=DEC) { return print((unsigned long)v, base); }
+		size_t print(long v, int base=DEC);
+		size_t print(unsigned long v, int base=DEC);
+		size_t print(double v, int digits=2);
+		size_t print(const Printable &p) { return p.printTo(*this); }
+		size_t println() { return write("\r\n"); }
+		template <typename T> size_t println(const T &v) { size_t n = print(v); return n + println(); }
+		template <typename T> size_t println(const T &v, int fmt) { size_t n = print(v, fmt); return n + println(); }
+		size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+		size_t printf_P(PGM_P format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class HardwareSerial : public Print {
+	public:
+		void begin(unsigned long baud) { _baud = baud; _tx_done_us = 0; }
+		size_t write(uint8_t c) override;
+		using Print::write;
+		int available() { return 0; }
+		int read() { return -1; }
+		void flush();
+	private:
+		unsigned long _baud = 0;
+		double _tx_done_us = 0; // when the UART has sent the last byte
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress : public Printable {
+	public:
+		IPAddress() { _address.dword = 0; }
+		IPAddress(uint32_t address) { _address.dword = address; }
+		IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+			_address.bytes[0] = a; _address.bytes[1] = b;
+			_address.bytes[2] = c; _address.bytes[3] = d;
+		}
+		IPAddress(const uint8_t *address) { memcpy(_address.bytes, address, 4); }
+		operator uint32_t() const { return _address.dword; }
+		operator uint8_t*() { return _address.bytes; }
+		uint8_t operator[](int index) const { return _address.bytes[index]; }
+		uint8_t &operator[](int index) { return _address.bytes[index]; }
+		bool operator==(const IPAddress &o) const { return _address.dword == o._address.dword; }
+		bool isSet() const { return _address.dword != 0; }
+		String toString() const;
+		size_t printTo(Print &p) const override;
+	private:
+		union {
+			uint8_t bytes[4];
+			uint32_t dword;
+		} _address;
+};
+
+enum RFMode { RF_DEFAULT = 0, RF_CAL = 1, RF_NO_CAL = 2, RF_DISABLED = 4 };
+#define WAKE_RF_DEFAULT RF_DEFAULT
+#define WAKE_RFCAL RF_CAL
+#define WAKE_NO_RFCAL RF_NO_CAL
+#define WAKE_RF_DISABLED RF_DISABLED
+
+// -DSIM_CPU_MHZ=160 like board_build.f_cpu = 160000000L; the cycle
+// counter then wraps after 26.8s instead of 53s
+#ifndef SIM_CPU_MHZ
+#define SIM_CPU_MHZ 80
+#endif
+
+class EspClass {
+	public:
+		void restart() __attribute__((noreturn));
+		void deepSleep(uint64_t time_us, RFMode mode = RF_DEFAULT) __attribute__((noreturn));
+		uint32_t getCycleCount();
+		uint32_t getFreeHeap();
+		uint32_t getChipId() { return 0x4A6934; }
+		uint8_t getCpuFreqMHz() { return SIM_CPU_MHZ; }
+		bool flashEraseSector(uint32_t sector);
+		bool flashWrite(uint32_t offset, const uint32_t *data, size_t size);
+		bool flashRead(uint32_t offset, uint32_t *data, size_t size);
+		bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+		bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+};
+
+extern EspClass ESP;
+
+#endif
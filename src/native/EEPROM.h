@@ -0,0 +1,59 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the ESP8266 EEPROM emulation: a RAM copy of one
+ * flash sector, written back on commit()/end() as erase + write.
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+class EEPROMClass {
+	public:
+		void begin(size_t size);
+		uint8_t read(int address) { return _data[address]; }
+		void write(int address, uint8_t val);
+		bool commit();
+		void end();
+		size_t length() { return _size; }
+		uint8_t *getDataPtr() { _dirty = true; return _data; }
+		const uint8_t *getConstDataPtr() const { return _data; }
+
+		template <typename T> T &get(int address, T &t) {
+			memcpy((uint8_t *)&t, _data + address, sizeof(T));
+			return t;
+		}
+		template <typename T> const T &put(int address, const T &t) {
+			if (memcmp(_data + address, (const uint8_t *)&t, sizeof(T)) != 0) {
+				_dirty = true;
+				memcpy(_data + address, (const uint8_t *)&t, sizeof(T));
+			}
+			return t;
+		}
+	private:
+		uint8_t *_data = NULL;
+		size_t _size = 0;
+		bool _dirty = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,159 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for ESP8266WiFi: station mode, scanning, DNS and TCP.
+ * Connection timing comes from the latency models in sim.h.
+ */
+
+#ifndef ESP8266WIFI_H
+#define ESP8266WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+
+typedef enum {
+	WL_IDLE_STATUS = 0,
+	WL_NO_SSID_AVAIL = 1,
+	WL_SCAN_COMPLETED = 2,
+	WL_CONNECTED = 3,
+	WL_CONNECT_FAILED = 4,
+	WL_CONNECTION_LOST = 5,
+	WL_WRONG_PASSWORD = 6,
+	WL_DISCONNECTED = 7
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+typedef enum {
+	WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3
+} WiFiMode_t;
+
+typedef enum {
+	WIFI_DISCONNECT_REASON_UNSPECIFIED = 1,
+	WIFI_DISCONNECT_REASON_AUTH_EXPIRE = 2,
+	WIFI_DISCONNECT_REASON_ASSOC_LEAVE = 8,
+	WIFI_DISCONNECT_REASON_BEACON_TIMEOUT = 200,
+	WIFI_DISCONNECT_REASON_NO_AP_FOUND = 201,
+	WIFI_DISCONNECT_REASON_AUTH_FAIL = 202,
+} WiFiDisconnectReason;
+
+struct WiFiEventStationModeConnected {
+	String ssid;
+	uint8_t bssid[6];
+	uint8_t channel;
+};
+
+struct WiFiEventStationModeDisconnected {
+	String ssid;
+	uint8_t bssid[6];
+	WiFiDisconnectReason reason;
+};
+
+struct WiFiEventStationModeGotIP {
+	IPAddress ip;
+	IPAddress mask;
+	IPAddress gw;
+};
+
+// handlers stay registered as long as the returned handle is kept
+class WiFiEventHandlerOpaque {
+	public:
+		virtual ~WiFiEventHandlerOpaque() {}
+};
+typedef std::shared_ptr<WiFiEventHandlerOpaque> WiFiEventHandler;
+
+class Client : public Print {
+	public:
+		virtual int connect(IPAddress ip, uint16_t port) = 0;
+		virtual int connect(const char *host, uint16_t port) = 0;
+		virtual int available() = 0;
+		virtual int read() = 0;
+		virtual void stop() = 0;
+		virtual uint8_t connected() = 0;
+};
+
+class WiFiClient : public Client {
+	public:
+		int connect(IPAddress ip, uint16_t port) override;
+		int connect(const char *host, uint16_t port) override;
+		size_t write(uint8_t c) override { return write(&c, 1); }
+		size_t write(const uint8_t *buf, size_t len) override;
+		int available() override;
+		int read() override;
+		void stop() override { _connected = false; }
+		uint8_t connected() override;
+		void setNoDelay(bool nodelay) { _nodelay = nodelay; }
+	private:
+		bool _connected = false;
+		bool _nodelay = false;
+};
+
+class ESP8266WiFiClass {
+	public:
+		// generic
+		bool mode(WiFiMode_t m);
+		bool forceSleepBegin(uint32_t sleepUs = 0) { (void)sleepUs; return true; }
+		WiFiMode_t getMode() { return _mode; }
+		bool enableSTA(bool enable) { return mode(enable ? WIFI_STA : WIFI_OFF); }
+		void persistent(bool persistent) { _persistent = persistent; }
+		bool setAutoConnect(bool autoConnect) { (void)autoConnect; return true; }
+		bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+		int hostByName(const char *aHostname, IPAddress &aResult);
+		void printDiag(Print &dest);
+		WiFiEventHandler onStationModeConnected(std::function<void(const WiFiEventStationModeConnected &)> f);
+		WiFiEventHandler onStationModeDisconnected(std::function<void(const WiFiEventStationModeDisconnected &)> f);
+		WiFiEventHandler onStationModeGotIP(std::function<void(const WiFiEventStationModeGotIP &)> f);
+
+		// station
+		wl_status_t begin(const char *ssid, const char *passphrase=NULL,
+			int32_t channel=0, const uint8_t *bssid=NULL, bool connect=true);
+		bool config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+			IPAddress dns1=(uint32_t)0, IPAddress dns2=(uint32_t)0);
+		bool reconnect();
+		bool disconnect(bool wifioff=false);
+		wl_status_t status();
+		IPAddress localIP();
+		IPAddress subnetMask();
+		IPAddress gatewayIP();
+		IPAddress dnsIP(uint8_t dns_no=0);
+		uint8_t *BSSID();
+		String BSSIDstr();
+		int32_t channel();
+		int32_t RSSI();
+
+		// scan
+		int8_t scanNetworks(bool async=false, bool show_hidden=false, uint8_t channel=0, uint8_t *ssid=NULL);
+		int8_t scanComplete();
+		void scanDelete();
+		String SSID(uint8_t i);
+		int32_t RSSI(uint8_t i);
+		int32_t channel(uint8_t i);
+		uint8_t *BSSID(uint8_t i);
+		String BSSIDstr(uint8_t i);
+
+	private:
+		WiFiMode_t _mode = WIFI_OFF;
+		bool _persistent = false;
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
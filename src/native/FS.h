@@ -0,0 +1,80 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the core's FS.h: File & FS over an FSImpl, just the
+ * parts used here
+ */
+
+#ifndef FS_H
+#define FS_H
+
+#include <Arduino.h>
+#include <memory>
+
+namespace fs {
+
+class FileImpl {
+	public:
+		virtual ~FileImpl() {}
+		virtual size_t write(const uint8_t *buf, size_t size) = 0;
+		virtual size_t read(uint8_t *buf, size_t size) = 0;
+		virtual size_t size() const = 0;
+		virtual void close() = 0;
+};
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+class File {
+	public:
+		File(FileImplPtr p = FileImplPtr()) : _p(p) {}
+		size_t write(const uint8_t *buf, size_t size) { return _p ? _p->write(buf, size) : 0; }
+		size_t read(uint8_t *buf, size_t size) { return _p ? _p->read(buf, size) : 0; }
+		size_t size() const { return _p ? _p->size() : 0; }
+		void close() { if (_p) { _p->close(); _p.reset(); } }
+		operator bool() const { return _p != NULL; }
+	private:
+		FileImplPtr _p;
+};
+
+class FSImpl {
+	public:
+		virtual ~FSImpl() {}
+		virtual bool begin() = 0;
+		virtual void end() = 0;
+		virtual FileImplPtr open(const char *path, const char *mode) = 0;
+};
+typedef std::shared_ptr<FSImpl> FSImplPtr;
+
+class FS {
+	public:
+		FS(FSImplPtr impl) : _impl(impl) {}
+		bool begin() { return _impl->begin(); }
+		void end() { _impl->end(); }
+		File open(const char *path, const char *mode) { return File(_impl->open(path, mode)); }
+	private:
+		FSImplPtr _impl;
+};
+
+}
+
+using fs::FS;
+using fs::File;
+using fs::FSImpl;
+using fs::FSImplPtr;
+
+#endif
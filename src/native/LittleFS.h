@@ -0,0 +1,51 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the core's LittleFS.h; see sim_libs.cpp
+ */
+
+#ifndef LITTLEFS_H
+#define LITTLEFS_H
+
+#include <FS.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace littlefs_impl {
+
+class LittleFSImpl : public fs::FSImpl {
+	public:
+		LittleFSImpl(uint32_t start, uint32_t size, uint32_t pageSize, uint32_t blockSize,
+				uint32_t maxOpenFds)
+			: _start(start), _size(size), _page(pageSize), _block(blockSize),
+			_mounted_boot(0), _next_block(0), _commits(0) { (void)maxOpenFds; }
+		bool begin();
+		void end();
+		fs::FileImplPtr open(const char *path, const char *mode);
+		void commit(const std::string &path, const std::vector<uint8_t> &data);
+		std::map<std::string, std::vector<uint8_t> > _files;
+	private:
+		uint32_t _start, _size, _page, _block;
+		uint32_t _mounted_boot, _next_block, _commits;
+};
+
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for knolleary/PubSubClient, with the broker round-trips
+ * timed by the latency models in sim.h.
+ */
+
+#ifndef PUBSUBCLIENT_H
+#define PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+class PubSubClient {
+	public:
+		PubSubClient(Client &client) : _client(&client) {}
+		PubSubClient &setServer(IPAddress ip, uint16_t port);
+		PubSubClient &setServer(const char *domain, uint16_t port);
+		bool connect(const char *id);
+		bool connect(const char *id, const char *user, const char *pass);
+		bool publish(const char *topic, const char *payload);
+		bool connected();
+		void disconnect();
+	private:
+		Client *_client;
+		IPAddress _ip;
+		const char *_domain = NULL;
+		uint16_t _port = 0;
+		bool _connected = false;
+};
+
+#endif
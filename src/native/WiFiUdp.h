@@ -0,0 +1,59 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for WiFiUdp: one datagram out, answers come back from
+ * the simulated DNS server & mDNS responder, see sim_wifi.cpp
+ */
+
+#ifndef WIFIUDP_H
+#define WIFIUDP_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include <deque>
+#include <vector>
+
+class WiFiUDP : public Print {
+	public:
+		uint8_t begin(uint16_t port);
+		void stop();
+		int beginPacket(IPAddress ip, uint16_t port);
+		int beginPacketMulticast(IPAddress addr, uint16_t port, IPAddress interfaceAddr, int ttl = 1);
+		size_t write(uint8_t c) override { _out.push_back(c); return 1; }
+		size_t write(const uint8_t *buf, size_t len) override { _out.insert(_out.end(), buf, buf + len); return len; }
+		int endPacket();
+		int parsePacket();
+		int read(uint8_t *buf, size_t len);
+		int available() { return _in.size() - _in_pos; }
+	private:
+		struct Datagram {
+			uint64_t at;	// arrives then
+			std::vector<uint8_t> data;
+		};
+		bool _bound = false;
+		uint32_t _to_ip = 0;
+		uint16_t _to_port = 0;
+		std::vector<uint8_t> _out;
+		std::deque<Datagram> _queue;
+		std::vector<uint8_t> _in;	// the current one, after parsePacket()
+		size_t _in_pos = 0;
+};
+
+#endif
@@ -0,0 +1,53 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the core's scheduling helpers in coredecls.h
+ */
+
+#ifndef __COREDECLS_H
+#define __COREDECLS_H
+
+#include <Arduino.h>
+#include "sim.h"
+
+extern "C" void esp_schedule();
+extern "C" uint32_t crc32(const void *data, size_t length, uint32_t crc = 0xffffffff);
+
+/* Sleep until blocked() returns false or timeout_ms passes. On the
+ * device the loop task is suspended and woken by esp_schedule() or
+ * every intvl_ms; here the clock jumps to the next simulated event.
+ */
+template <typename T>
+inline void esp_delay(const uint32_t timeout_ms, T &&blocked, const uint32_t intvl_ms) {
+	uint64_t deadline = sim_now_us() + timeout_ms * 1000ULL;
+	while (blocked() && sim_now_us() < deadline) {
+		uint64_t next = sim_now_us() + intvl_ms * 1000ULL;
+		if (next > deadline) next = deadline;
+		uint64_t ev = sim_next_event_us();
+		if (ev > sim_now_us() && ev < next) next = ev;
+		sim_advance_to_us(next > sim_now_us() ? next : sim_now_us() + 1);
+	}
+}
+
+template <typename T>
+inline void esp_delay(const uint32_t timeout_ms, T &&blocked) {
+	esp_delay(timeout_ms, blocked, timeout_ms);
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host stand-in for the core's flash_hal.h: the FS area of the
+ * eagle.flash.512k64.ld layout, just below the EEPROM sector
+ */
+
+#ifndef FLASH_HAL_H
+#define FLASH_HAL_H
+
+#include "sim.h"
+
+#define FS_PHYS_SIZE 0x10000
+#define FS_PHYS_ADDR (SIM_EEPROM_SECTOR * SIM_FLASH_SECTOR_SIZE - FS_PHYS_SIZE)
+#define FS_PHYS_PAGE 0x100
+#define FS_PHYS_BLOCK 0x1000
+
+#endif
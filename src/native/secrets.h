@@ -0,0 +1,37 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+//
+// Defines for the simulated access point & MQTT server. [env:native]
+// force-includes this file (-include), so the SECRETS_H guard keeps a
+// src/secrets.h out and the firmware & the stand-ins see the same ones
+//
+
+#ifndef SECRETS_H
+#define SECRETS_H
+
+#define WIFI_SSID "SIM-WIFI"
+#define WIFI_AUTH "sim-password"
+#define MQTT_SERVER "mqtt-host.local"
+#define MQTT_SERVER_PORT 1883
+#define MQTT_USER "mqtt-user"
+#define MQTT_AUTH "mqtt-password"
+#define MQTT_CLIENT_ID "WIFI_TEST"
+
+#endif
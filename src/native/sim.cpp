@@ -0,0 +1,486 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Boot loop, virtual clock, latency models and <key=value> statistics
+ * for the native simulation.
+ *
+ * Usage: program [-n boots] [-s seed] [-v] [-o file.tsv]
+ *                [-m model=median,p90[,max]] [-p fault=chance]
+ *
+ * Faults, each a chance from 0 to 1, see SIM_CONFIG_T:
+ *   assoc_retry, channel_hop, ap_down, power_loss, puback_loss,
+ *   bssid_change, dhcp_loss, arp_loss, syn_loss, mqtt_loss, broker_drop
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "sim.h"
+
+void setup();
+void loop();
+
+// median, p90 & max in ms; see variations.txt & README for where they came from
+SIM_MODEL_T sim_models[SIM_MODEL_COUNT] = {
+	{ "scan_full",     2750,   3200, 10000 },
+	{ "scan_bssid",     780,   1000, 10000 },
+	{ "pmk",            930,    980,  2000 },
+	{ "assoc",          160,    230,  5000 },
+	{ "assoc_retry",   1000,   1400,  5000 },
+	{ "reconnect",      420,   1200,  5000 },
+	{ "dhcp",            70,    250, 10000 },
+	{ "arp",              2,      6,  1000 },
+	{ "tcp",              4,     12,  5000 },
+	{ "dns",             12,    600, 10000 },
+	{ "mqtt_connack",    15,     24, 15000 },
+	{ "mqtt_publish",     0.3,    0.8, 100 },
+	{ "scan_diag",     2150,   2300,  5000 },
+	{ "flash_erase",     35,     48,   400 },
+	{ "flash_write",      0.6,    0.8,   3 },
+	{ "fs_mount",         4,      8,     50 },
+	{ "rf_cal",         170,    200,    400 },
+	{ "scan_channel",    40,     70,    120 },
+	{ "tcp_rto",        500,   1000,   3000 },
+};
+
+SIM_CONFIG_T sim_config = {
+	1000,	// boots
+	1,		// seed
+	false,	// verbose
+	NULL,	// csv_file
+	0.10,	// p_assoc_retry
+	0.01,	// p_channel_hop
+	0.0,	// p_ap_down
+	0.0,	// p_power_loss
+	0.01,	// p_puback_loss
+	0.0,	// p_bssid_change
+	0.0,	// p_dhcp_loss
+	0.0,	// p_arp_loss
+	0.0,	// p_syn_loss
+	0.0,	// p_mqtt_loss
+	0.0,	// p_broker_drop
+};
+
+SIM_AP_T sim_aps[SIM_AP_COUNT] = {
+	{ { 0x3C, 0xA6, 0x2F, 0x11, 0x22, 0x33 }, 11, -61, true },
+	{ { 0x3C, 0xA6, 0x2F, 0x11, 0x22, 0x34 }, 1, -72, true },
+};
+
+SIM_NETWORK_T sim_net = {
+	NULL, NULL,
+	0x6FB2A8C0, 0x01B2A8C0, 0x00FFFFFF, 0x01B2A8C0, 0x00000000, // 192.168.178.x
+	0x02B2A8C0, 1883, NULL, 120
+};
+
+#define SIM_BOOT_US 65000 // ROM bootloader + core init before setup()
+
+static uint64_t g_now_us = 0;
+static uint64_t g_total_us = 0;
+static std::mt19937 g_rng;
+static uint8_t g_flash[SIM_FLASH_SIZE];
+static uint32_t g_flash_erases = 0;
+static uint8_t g_rtc[SIM_RTC_USER_SIZE];
+static uint32_t g_power_losses = 0;
+static int32_t g_heap_used = 0;
+static uint32_t g_boot_count = 0;
+static uint32_t g_channel_hops = 0;
+static uint32_t g_bssid_changes = 0;
+static uint32_t g_deep_sleeps = 0;
+static uint64_t g_sleep_us = 0;		// asleep before the next boot
+static int g_wake_rf = 0;			// RFMode of the next boot
+
+/* virtual clock
+ */
+uint64_t sim_now_us() { return g_now_us; }
+void sim_advance_us(uint64_t us) { sim_advance_to_us(g_now_us + us); }
+uint64_t sim_next_event_us() { return sim_wifi_next_event_us(); }
+
+/* Move the clock, stopping at each pending event to fire it on time
+ */
+void sim_advance_to_us(uint64_t t) {
+	for (;;) {
+		uint64_t ev = sim_next_event_us();
+		if (ev > t) break;
+		if (ev > g_now_us) g_now_us = ev;
+		sim_wifi_fire_events();
+	}
+	if (t > g_now_us) g_now_us = t;
+}
+
+/* Draw from a log-normal with the model's median & p90, up to max
+ */
+uint32_t sim_sample_us(SIM_MODEL_ID model) {
+	const SIM_MODEL_T *m = &sim_models[model];
+	double sigma = 0;
+	if (m->p90_ms > m->median_ms) sigma = log(m->p90_ms / m->median_ms) / 1.2815516;
+	std::lognormal_distribution<double> dist(log(m->median_ms), sigma);
+	double ms = dist(g_rng);
+	if (m->max_ms > 0 && ms > m->max_ms) ms = m->max_ms;
+	return (uint32_t)(ms * 1000.0);
+}
+
+bool sim_chance(double p) {
+	return std::uniform_real_distribution<double>(0, 1)(g_rng) < p;
+}
+
+uint32_t sim_random() { return g_rng(); }
+
+/* Emulated flash: erased bits are 1, writes can only clear bits
+ */
+void sim_flash_read(uint32_t addr, void *buf, size_t len) {
+	memcpy(buf, g_flash + addr, len);
+	sim_advance_us(10 + len / 20);
+}
+
+void sim_flash_write(uint32_t addr, const void *buf, size_t len) {
+	const uint8_t *src = (const uint8_t *)buf;
+	for (size_t i = 0; i < len; i++) g_flash[addr + i] &= src[i];
+	for (size_t i = 0; i < len; i += 256) sim_advance_us(sim_sample_us(SIM_FLASH_WRITE));
+}
+
+void sim_flash_erase_sector(uint32_t sector) {
+	memset(g_flash + sector * SIM_FLASH_SECTOR_SIZE, 0xFF, SIM_FLASH_SECTOR_SIZE);
+	sim_advance_us(sim_sample_us(SIM_FLASH_ERASE));
+	g_flash_erases++;
+}
+
+void sim_heap_change(int32_t bytes) { g_heap_used += bytes; }
+int32_t sim_heap_used() { return g_heap_used; }
+uint32_t sim_boot_count() { return g_boot_count; }
+
+/* RTC user memory: random after power-on
+ */
+static void sim_rtc_power_on() {
+	for (size_t i = 0; i < sizeof(g_rtc); i++) g_rtc[i] = sim_random();
+}
+
+void sim_rtc_read(uint32_t addr, void *buf, size_t len) {
+	memcpy(buf, g_rtc + addr, len);
+	sim_advance_us(1 + len / 16);
+}
+
+void sim_rtc_write(uint32_t addr, const void *buf, size_t len) {
+	memcpy(g_rtc + addr, buf, len);
+	sim_advance_us(1 + len / 16);
+}
+
+/* Collect <key=value> rows from the serial output, like serial_parse.py;
+ * binary telemetry frames (see telemetry.h) are decoded into the same rows
+ */
+static std::vector<std::string> g_fieldnames;
+static std::vector<std::map<std::string, std::string> > g_rows;
+static std::map<std::string, std::string> g_row;
+static std::string g_buffer;
+static std::string g_frame;
+static bool g_in_frame = false;
+static std::map<uint32_t, std::string> g_frame_fields;
+static uint64_t g_serial_bytes = 0;
+static uint32_t g_frame_errors = 0;
+
+static void add_field(const std::string &key, const std::string &value) {
+	if (std::find(g_fieldnames.begin(), g_fieldnames.end(), key) == g_fieldnames.end())
+		g_fieldnames.push_back(key);
+	g_row[key] = value;
+}
+
+static void parse_buffer(const std::string &buffer) {
+	if (buffer == "<start>") { g_row.clear(); return; }
+	if (buffer == "<complete>") { g_rows.push_back(g_row); return; }
+	if (buffer.size() < 2 || buffer[0] != '<' || buffer[buffer.size()-1] != '>') return;
+	std::string item = buffer.substr(1, buffer.size() - 2);
+	size_t eq = item.find('=');
+	if (eq == std::string::npos || eq + 1 == item.size()) return;
+	if (item.find('=', eq + 1) != std::string::npos) return;
+	add_field(item.substr(0, eq), item.substr(eq + 1));
+}
+
+static bool get_varint(const std::string &f, size_t &i, uint32_t &v) {
+	v = 0;
+	for (int shift = 0; i < f.size() && shift < 35; shift += 7) {
+		uint8_t b = f[i++];
+		v |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+static uint16_t crc16(const std::string &f, size_t len) {
+	uint16_t crc = 0xffff;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= (uint16_t)(uint8_t)f[i] << 8;
+		for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+	return crc;
+}
+
+/* One COBS frame without its 0x00 delimiters
+ */
+static void parse_frame(const std::string &cobs) {
+	std::string f;
+	for (size_t i = 0; i < cobs.size(); ) {
+		uint8_t code = cobs[i++];
+		for (uint8_t k = 1; k < code; k++) {
+			if (i >= cobs.size()) { g_frame_errors++; return; }
+			f += cobs[i++];
+		}
+		if (code < 0xff && i < cobs.size()) f += '\0';
+	}
+	if (f.size() < 3 || crc16(f, f.size() - 2) != (((uint8_t)f[f.size()-2] << 8) | (uint8_t)f[f.size()-1])) {
+		g_frame_errors++;
+		return;
+	}
+	f.resize(f.size() - 2);
+	for (size_t i = 0; i < f.size(); ) {
+		uint32_t tag, v, id;
+		if (!get_varint(f, i, tag)) break;
+		id = tag >> 2;
+		if ((tag & 3) == 3) {
+			if (id == 0) { g_row.clear(); continue; }
+			if (id == 1) { g_rows.push_back(g_row); continue; }
+			if (!get_varint(f, i, id) || !get_varint(f, i, v) || i + v > f.size()) break;
+			g_frame_fields[id] = f.substr(i, v);
+			i += v;
+			continue;
+		}
+		if (!get_varint(f, i, v)) break;
+		std::map<uint32_t, std::string>::iterator it = g_frame_fields.find(id);
+		std::string key = it != g_frame_fields.end() ? it->second : "#" + std::to_string(id);
+		if ((tag & 3) == 2) {
+			if (i + v > f.size()) break;
+			add_field(key, f.substr(i, v));
+			i += v;
+		} else {
+			add_field(key, std::to_string((tag & 3) ? -1 - (int64_t)v : (int64_t)v));
+		}
+	}
+}
+
+void sim_serial_write(uint8_t c) {
+	if (sim_config.verbose) putchar(c);
+	g_serial_bytes++;
+	if (g_in_frame) {
+		if (c) { g_frame += (char)c; return; }
+		if (g_frame.empty()) return; // back-to-back delimiters
+		parse_frame(g_frame);
+		g_in_frame = false;
+		return;
+	}
+	if (!c) { g_in_frame = true; g_frame.clear(); return; }
+	g_buffer += (char)c;
+	if (c == '<') g_buffer = "<";
+	if (c == '>') { parse_buffer(g_buffer); g_buffer.clear(); }
+}
+
+/* Write all rows as TSV, same layout as serial_parse.py
+ */
+static void write_csv(const char *filename) {
+	FILE *f = fopen(filename, "w");
+	if (!f) { perror(filename); return; }
+	for (size_t i = 0; i < g_fieldnames.size(); i++)
+		fprintf(f, "%s%s", i ? "\t" : "", g_fieldnames[i].c_str());
+	fprintf(f, "\n");
+	for (size_t r = 0; r < g_rows.size(); r++) {
+		for (size_t i = 0; i < g_fieldnames.size(); i++) {
+			std::map<std::string, std::string>::const_iterator it = g_rows[r].find(g_fieldnames[i]);
+			fprintf(f, "%s%s", i ? "\t" : "", it == g_rows[r].end() ? "" : it->second.c_str());
+		}
+		fprintf(f, "\n");
+	}
+	fclose(f);
+}
+
+/* Show per-strategy statistics for each field: numbers get
+ * median / p90 / mean / stddev, anything else a breakdown of values.
+ */
+static void print_report() {
+	std::map<std::string, std::vector<size_t> > groups;
+	for (size_t r = 0; r < g_rows.size(); r++) groups[g_rows[r]["strategy"]].push_back(r);
+
+	for (std::map<std::string, std::vector<size_t> >::iterator g = groups.begin(); g != groups.end(); ++g) {
+		printf("\nstrategy=%s (%zu boots)\n", g->first.c_str(), g->second.size());
+		printf("  %-24s %6s %10s %10s %10s %10s\n", "field", "n", "median", "p90", "mean", "stddev");
+		for (size_t i = 0; i < g_fieldnames.size(); i++) {
+			const std::string &key = g_fieldnames[i];
+			if (key == "strategy") continue;
+			std::vector<double> nums;
+			std::map<std::string, size_t> labels;
+			for (size_t j = 0; j < g->second.size(); j++) {
+				std::map<std::string, std::string> &row = g_rows[g->second[j]];
+				std::map<std::string, std::string>::iterator it = row.find(key);
+				if (it == row.end()) continue;
+				char *end;
+				double v = strtod(it->second.c_str(), &end);
+				if (*end == 0) nums.push_back(v); else labels[it->second]++;
+			}
+			if (!labels.empty()) {
+				printf("  %-24s", key.c_str());
+				for (std::map<std::string, size_t>::iterator l = labels.begin(); l != labels.end(); ++l)
+					printf(" %s:%zu", l->first.c_str(), l->second);
+				printf("\n");
+			}
+			if (nums.empty()) continue;
+			std::sort(nums.begin(), nums.end());
+			double sum = 0, sq = 0;
+			for (size_t j = 0; j < nums.size(); j++) sum += nums[j];
+			double mean = sum / nums.size();
+			for (size_t j = 0; j < nums.size(); j++) sq += (nums[j] - mean) * (nums[j] - mean);
+			printf("  %-24s %6zu %10.0f %10.0f %10.0f %10.0f\n", key.c_str(), nums.size(),
+				nums[nums.size() / 2], nums[(size_t)(nums.size() * 0.9)], mean,
+				nums.size() > 1 ? sqrt(sq / (nums.size() - 1)) : 0.0);
+		}
+	}
+}
+
+/* -m name=median,p90[,max]
+ */
+static bool set_model(const char *arg) {
+	const char *eq = strchr(arg, '=');
+	if (!eq) return false;
+	for (int i = 0; i < SIM_MODEL_COUNT; i++) {
+		if (strncmp(arg, sim_models[i].name, eq - arg) != 0 || sim_models[i].name[eq - arg]) continue;
+		return sscanf(eq + 1, "%lf,%lf,%lf", &sim_models[i].median_ms,
+			&sim_models[i].p90_ms, &sim_models[i].max_ms) >= 2;
+	}
+	return false;
+}
+
+/* -p name=chance
+ */
+static bool set_chance(const char *arg) {
+	double v;
+	if (sscanf(arg, "assoc_retry=%lf", &v) == 1) { sim_config.p_assoc_retry = v; return true; }
+	if (sscanf(arg, "channel_hop=%lf", &v) == 1) { sim_config.p_channel_hop = v; return true; }
+	if (sscanf(arg, "ap_down=%lf", &v) == 1) { sim_config.p_ap_down = v; return true; }
+	if (sscanf(arg, "power_loss=%lf", &v) == 1) { sim_config.p_power_loss = v; return true; }
+	if (sscanf(arg, "puback_loss=%lf", &v) == 1) { sim_config.p_puback_loss = v; return true; }
+	if (sscanf(arg, "bssid_change=%lf", &v) == 1) { sim_config.p_bssid_change = v; return true; }
+	if (sscanf(arg, "dhcp_loss=%lf", &v) == 1) { sim_config.p_dhcp_loss = v; return true; }
+	if (sscanf(arg, "arp_loss=%lf", &v) == 1) { sim_config.p_arp_loss = v; return true; }
+	if (sscanf(arg, "syn_loss=%lf", &v) == 1) { sim_config.p_syn_loss = v; return true; }
+	if (sscanf(arg, "mqtt_loss=%lf", &v) == 1) { sim_config.p_mqtt_loss = v; return true; }
+	if (sscanf(arg, "broker_drop=%lf", &v) == 1) { sim_config.p_broker_drop = v; return true; }
+	return false;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "usage: %s [-n boots] [-s seed] [-v] [-o file.tsv]"
+		" [-m model=median,p90[,max]] [-p fault=chance]\nfaults: assoc_retry channel_hop ap_down power_loss"
+		" puback_loss bssid_change dhcp_loss arp_loss syn_loss mqtt_loss broker_drop\nmodels:", name);
+	for (int i = 0; i < SIM_MODEL_COUNT; i++)
+		fprintf(stderr, " %s=%g,%g,%g", sim_models[i].name, sim_models[i].median_ms,
+			sim_models[i].p90_ms, sim_models[i].max_ms);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+void sim_deep_sleep(uint64_t time_us, int mode) {
+	g_sleep_us = time_us;
+	g_wake_rf = mode;
+	g_deep_sleeps++;
+}
+
+/* Reset everything a real reboot resets, maybe move an AP
+ */
+static void sim_boot() {
+	g_total_us += g_now_us + g_sleep_us;
+	g_now_us = SIM_BOOT_US;
+	if (g_wake_rf == 1) g_now_us += sim_sample_us(SIM_RF_CAL); // RF_CAL
+	g_sleep_us = 0;
+	g_wake_rf = 0;
+	g_heap_used = 0;
+	g_boot_count++;
+	sim_wifi_reset();
+	if (sim_chance(sim_config.p_channel_hop)) {
+		static const int32_t channels[] = { 1, 6, 11 };
+		SIM_AP_T *ap = &sim_aps[sim_random() % SIM_AP_COUNT];
+		int32_t ch = ap->channel;
+		while (ch == ap->channel) ch = channels[sim_random() % 3];
+		ap->channel = ch;
+		g_channel_hops++;
+	}
+	// a replaced AP keeps SSID & channel, the cached BSSID is gone
+	if (sim_chance(sim_config.p_bssid_change)) {
+		SIM_AP_T *ap = &sim_aps[sim_random() % SIM_AP_COUNT];
+		ap->bssid[4] ^= 0x80;
+		ap->bssid[5] = (uint8_t)sim_random();
+		g_bssid_changes++;
+	}
+	sim_aps[0].up = !sim_chance(sim_config.p_ap_down);
+	if (sim_chance(sim_config.p_power_loss)) {
+		sim_rtc_power_on();
+		g_power_losses++;
+	}
+}
+
+int main(int argc, char **argv) {
+	int opt;
+	while ((opt = getopt(argc, argv, "n:s:vo:m:p:h")) != -1) {
+		switch (opt) {
+			case 'n': sim_config.boots = strtoul(optarg, NULL, 10); break;
+			case 's': sim_config.seed = strtoul(optarg, NULL, 10); break;
+			case 'v': sim_config.verbose = true; break;
+			case 'o': sim_config.csv_file = optarg; break;
+			case 'm': if (!set_model(optarg)) usage(argv[0]); break;
+			case 'p': if (!set_chance(optarg)) usage(argv[0]); break;
+			default: usage(argv[0]);
+		}
+	}
+	g_rng.seed(sim_config.seed);
+	memset(g_flash, 0xFF, sizeof(g_flash));
+	sim_rtc_power_on();
+
+	clock_t wall_start = clock();
+	for (uint32_t boot = 0; boot < sim_config.boots; boot++) {
+		sim_boot();
+		try {
+			setup();
+			for (;;) loop();
+		} catch (const SimRestart &) {
+		}
+	}
+	g_total_us += g_now_us;
+	double wall_s = (double)(clock() - wall_start) / CLOCKS_PER_SEC;
+
+	print_report();
+	if (sim_config.csv_file) write_csv(sim_config.csv_file);
+	fprintf(stderr, "\n%u boots (%zu complete), %.0f s simulated in %.2f s wall, "
+		"%u flash erases, %u channel hops, %u power losses, %.0f serial bytes/boot",
+		sim_config.boots, g_rows.size(), g_total_us / 1e6, wall_s, g_flash_erases, g_channel_hops,
+		g_power_losses, (double)g_serial_bytes / sim_config.boots);
+	if (g_frame_errors) fprintf(stderr, ", %u bad frames", g_frame_errors);
+	if (g_deep_sleeps) fprintf(stderr, ", %u deep sleeps", g_deep_sleeps);
+	if (g_bssid_changes) fprintf(stderr, ", %u BSSID changes", g_bssid_changes);
+	if (sim_broker_stats.connects)
+		fprintf(stderr, "\nbroker: %u connects, %u publishes (%u QoS1, %u DUP), %u disconnects, %u errors",
+			sim_broker_stats.connects, sim_broker_stats.publishes, sim_broker_stats.qos1,
+			sim_broker_stats.duplicates, sim_broker_stats.disconnects, sim_broker_stats.errors);
+	if (sim_broker_stats.drops || sim_broker_stats.losses)
+		fprintf(stderr, ", %u dropped, %u lost packets", sim_broker_stats.drops, sim_broker_stats.losses);
+	fprintf(stderr, "\n");
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Host simulation of an ESP-01 boot loop, for [env:native]
+ *
+ * The stand-ins in this directory replace the Arduino core, ESP8266WiFi,
+ * EEPROM and PubSubClient. Time is virtual: delay() and the simulated
+ * radio just move a clock forward, so thousands of boots run per second.
+ * Each latency is drawn from a log-normal model given by its median and
+ * p90 in ms, defaults taken from variations.txt, cut off at a maximum.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// latency models, see sim_models[] in sim.cpp for the defaults
+enum SIM_MODEL_ID {
+	SIM_SCAN_FULL,		// find AP without BSSID & channel
+	SIM_SCAN_BSSID,		// find AP with BSSID but no channel
+	SIM_PMK,			// derive PMK when not persisted by the SDK
+	SIM_ASSOC,			// auth + assoc + 4-way handshake
+	SIM_ASSOC_RETRY,	// extra cost when the first assoc attempt fails
+	SIM_RECONNECT,		// overhead of reconnect() vs. begin(..., true)
+	SIM_DHCP,			// DHCP lease, skipped with static IP
+	SIM_ARP,			// first ARP on a fresh connection
+	SIM_TCP,			// TCP handshake to the broker
+	SIM_DNS,			// hostByName() round-trip
+	SIM_MQTT_CONNACK,	// MQTT CONNECT -> CONNACK
+	SIM_MQTT_PUBLISH,	// one QoS0 PUBLISH write, or one write to the broker
+	SIM_SCAN_DIAG,		// scanNetworks() in loop()
+	SIM_FLASH_ERASE,	// one 4kB sector erase
+	SIM_FLASH_WRITE,	// one 256 byte page write
+	SIM_FS_MOUNT,		// LittleFS.begin(), a guess
+	SIM_RF_CAL,			// full RF calibration at boot, WAKE_RFCAL; a guess
+	SIM_SCAN_CHANNEL,	// active scan of one channel that has the SSID; a guess
+	SIM_TCP_RTO,		// TCP retransmit of a lost segment to or from the broker; a guess
+	SIM_MODEL_COUNT
+};
+
+struct SIM_MODEL_T {
+	const char *name;
+	double median_ms;
+	double p90_ms;
+	double max_ms;	// samples are cut off here, e.g. at a timeout
+};
+
+struct SIM_CONFIG_T {
+	uint32_t boots;
+	uint32_t seed;
+	bool verbose;
+	const char *csv_file;
+	double p_assoc_retry;	// chance the first association attempt fails
+	double p_channel_hop;	// chance per boot that an AP changed channel
+	double p_ap_down;		// chance per boot that the main AP is off
+	double p_power_loss;	// chance per boot of a cold start, RTC memory lost
+	double p_puback_loss;	// chance the broker does not acknowledge a QoS1 PUBLISH
+	// faults of the network stand-in, for the long tail & fallbacks
+	double p_bssid_change;	// chance per boot that an AP was replaced, new BSSID
+	double p_dhcp_loss;		// chance per DHCP packet of a lost one, lwIP retries after 1s, 2s, 4s
+	double p_arp_loss;		// chance the first ARP request is lost, retried after 1s
+	double p_syn_loss;		// chance the TCP SYN to the broker is lost, retried after 3s
+	double p_mqtt_loss;		// chance an MQTT packet or its reply is lost, see SIM_TCP_RTO
+	double p_broker_drop;	// chance the broker closes the connection instead of a CONNACK
+};
+
+extern SIM_MODEL_T sim_models[SIM_MODEL_COUNT];
+extern SIM_CONFIG_T sim_config;
+
+// virtual clock; moving it fires simulated SDK events on the way
+uint64_t sim_now_us();
+void sim_advance_us(uint64_t us);
+void sim_advance_to_us(uint64_t t);
+uint64_t sim_next_event_us();
+
+// random draws
+uint32_t sim_sample_us(SIM_MODEL_ID model);
+bool sim_chance(double p);
+uint32_t sim_random();
+
+// the simulated network: mesh APs with the same SSID, DHCP, broker
+struct SIM_AP_T {
+	uint8_t bssid[6];
+	int32_t channel;
+	int32_t rssi;
+	bool up;
+};
+#define SIM_AP_COUNT 2
+extern SIM_AP_T sim_aps[SIM_AP_COUNT];
+
+struct SIM_NETWORK_T {
+	const char *ssid;
+	const char *auth;
+	uint32_t lease_ip, gateway, mask, dns1, dns2;
+	uint32_t broker_ip;
+	uint16_t broker_port;
+	const char *broker_host;
+	uint32_t broker_ttl;	// s, in DNS & mDNS answers
+};
+extern SIM_NETWORK_T sim_net;
+bool sim_wifi_up();
+
+// emulated SPI flash of a 512kB ESP-01
+#define SIM_FLASH_SIZE 0x80000
+#define SIM_FLASH_SECTOR_SIZE 4096
+#define SIM_EEPROM_SECTOR 0x7B
+void sim_flash_read(uint32_t addr, void *buf, size_t len);
+void sim_flash_write(uint32_t addr, const void *buf, size_t len);
+void sim_flash_erase_sector(uint32_t sector);
+
+// heap in use by the stand-ins, for ESP.getFreeHeap(); reset on boot
+#define SIM_HEAP_FREE 40000
+void sim_heap_change(int32_t bytes);
+int32_t sim_heap_used();
+uint32_t sim_boot_count();
+
+// ESP.deepSleep(): the next boot starts after time_us, with RF
+// calibration when mode asks for it
+void sim_deep_sleep(uint64_t time_us, int mode);
+
+// RTC user memory, kept over ESP.restart() but not a power loss
+#define SIM_RTC_USER_SIZE 512
+void sim_rtc_read(uint32_t addr, void *buf, size_t len);
+void sim_rtc_write(uint32_t addr, const void *buf, size_t len);
+
+// hooks of the individual stand-ins
+void sim_wifi_reset();
+uint64_t sim_wifi_next_event_us();
+void sim_wifi_fire_events();
+void sim_serial_write(uint8_t c);
+
+// broker stand-in behind WiFiClient: checks the MQTT packets written to
+// it, answers CONNECT with CONNACK & QoS1 PUBLISH with PUBACK
+struct SIM_BROKER_STATS_T {
+	uint32_t connects, publishes, disconnects;
+	uint32_t qos1, duplicates;	// QoS1 publishes, those with DUP set
+	uint32_t errors;	// malformed or unexpected packets
+	uint32_t drops, losses;	// injected with p_broker_drop & p_mqtt_loss
+};
+extern SIM_BROKER_STATS_T sim_broker_stats;
+void sim_broker_open();
+bool sim_broker_dropped();
+void sim_broker_receive(const uint8_t *buf, size_t len);
+int sim_broker_available();
+int sim_broker_read();
+
+// thrown by ESP.restart(), caught by the boot loop in sim.cpp
+struct SimRestart {};
+
+#endif
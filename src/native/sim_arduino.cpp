@@ -0,0 +1,213 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Arduino core stand-ins: time, random, String, Print, Serial, ESP
+ */
+
+#include <stdarg.h>
+
+#include <Arduino.h>
+#include <coredecls.h>
+
+#include "sim.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+/* time runs only when the sketch waits
+ */
+unsigned long millis() { return sim_now_us() / 1000; }
+unsigned long micros() { return sim_now_us(); }
+uint64_t micros64() { return sim_now_us(); }
+void delay(unsigned long ms) { sim_advance_us(ms * 1000ULL); }
+void delayMicroseconds(unsigned int us) { sim_advance_us(us); }
+void yield() { sim_advance_us(50); }
+
+/* random() on the ESP8266 draws from the hardware RNG, so there is
+ * nothing to seed; use the simulation's seeded generator instead.
+ */
+long random(long howbig) {
+	if (howbig <= 0) return 0;
+	return sim_random() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+	if (howsmall >= howbig) return howsmall;
+	return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) { (void)seed; }
+
+/* The ESP8266's only ADC input: a reading takes ~70us, the value is
+ * just noise around the middle
+ */
+int analogRead(uint8_t pin) {
+	(void)pin;
+	sim_advance_us(70);
+	return 500 + (int)(sim_random() % 24);
+}
+
+static std::string number_string(unsigned long v, unsigned char base, bool negative) {
+	char buf[70];
+	char *p = &buf[sizeof(buf) - 1];
+	*p = 0;
+	do {
+		unsigned d = v % base;
+		*--p = d < 10 ? '0' + d : 'A' + d - 10;
+		v /= base;
+	} while (v);
+	if (negative) *--p = '-';
+	return std::string(p);
+}
+
+String::String(int v, unsigned char base) : String((long)v, base) {}
+String::String(unsigned int v, unsigned char base) : String((unsigned long)v, base) {}
+String::String(long v, unsigned char base)
+	: _s(number_string(v < 0 && base == DEC ? -(unsigned long)v : (unsigned long)v, base, v < 0 && base == DEC)) {}
+String::String(unsigned long v, unsigned char base) : _s(number_string(v, base, false)) {}
+
+size_t Print::write(const uint8_t *buf, size_t len) {
+	size_t n = 0;
+	while (len--) n += write(*buf++);
+	return n;
+}
+
+size_t Print::print(long v, int base) { return print(String(v, base)); }
+size_t Print::print(unsigned long v, int base) { return print(String(v, base)); }
+
+size_t Print::print(double v, int digits) {
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%.*f", digits, v);
+	return write(buf);
+}
+
+size_t Print::printf(const char *format, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n < 0) return 0;
+	return write((const uint8_t *)buf, strlen(buf));
+}
+
+size_t Print::printf_P(PGM_P format, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(buf, sizeof(buf), format, args);
+	va_end(args);
+	if (n < 0) return 0;
+	return write((const uint8_t *)buf, strlen(buf));
+}
+
+/* Like the core's UART driver: bytes go into the 128 byte TX FIFO, and
+ * write() only blocks once that is full; 10 bits per byte on the wire
+ */
+#define SIM_UART_FIFO 128
+
+size_t HardwareSerial::write(uint8_t c) {
+	sim_serial_write(c);
+	if (!_baud) return 1;
+	double now = sim_now_us(), byte_us = 10e6 / _baud;
+	if (_tx_done_us < now) _tx_done_us = now;
+	if (_tx_done_us - now > SIM_UART_FIFO * byte_us)
+		sim_advance_to_us((uint64_t)(_tx_done_us - SIM_UART_FIFO * byte_us));
+	_tx_done_us += byte_us;
+	return 1;
+}
+
+void HardwareSerial::flush() {
+	if (_tx_done_us > sim_now_us()) sim_advance_to_us((uint64_t)_tx_done_us);
+}
+
+String IPAddress::toString() const {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+	return String(buf);
+}
+
+size_t IPAddress::printTo(Print &p) const { return p.print(toString()); }
+
+void EspClass::restart() { throw SimRestart(); }
+
+void EspClass::deepSleep(uint64_t time_us, RFMode mode) {
+	sim_deep_sleep(time_us, mode);
+	throw SimRestart();
+}
+
+uint32_t EspClass::getFreeHeap() { return SIM_HEAP_FREE - sim_heap_used(); }
+
+uint32_t EspClass::getCycleCount() { return (uint32_t)(sim_now_us() * getCpuFreqMHz()); }
+
+/* Like the SDK: word-aligned offsets & sizes only
+ */
+bool EspClass::flashEraseSector(uint32_t sector) {
+	if (sector >= SIM_FLASH_SIZE / SIM_FLASH_SECTOR_SIZE) return false;
+	sim_flash_erase_sector(sector);
+	return true;
+}
+
+bool EspClass::flashWrite(uint32_t offset, const uint32_t *data, size_t size) {
+	if ((offset | size) & 3 || offset + size > SIM_FLASH_SIZE) return false;
+	sim_flash_write(offset, data, size);
+	return true;
+}
+
+bool EspClass::flashRead(uint32_t offset, uint32_t *data, size_t size) {
+	if ((offset | size) & 3 || offset + size > SIM_FLASH_SIZE) return false;
+	sim_flash_read(offset, data, size);
+	return true;
+}
+
+/* Offset in 4-byte blocks, like the core
+ */
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+	if (offset * 4 + size > SIM_RTC_USER_SIZE || size & 3) return false;
+	sim_rtc_read(offset * 4, data, size);
+	return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+	if (offset * 4 + size > SIM_RTC_USER_SIZE || size & 3) return false;
+	sim_rtc_write(offset * 4, data, size);
+	return true;
+}
+
+/* Same as the core's crc32(): MSB first, no final xor; bit by bit it
+ * takes about 1us per byte at 80MHz
+ */
+uint32_t crc32(const void *data, size_t length, uint32_t crc) {
+	const uint8_t *p = (const uint8_t *)data;
+	sim_advance_us(length);
+	while (length--) {
+		uint8_t c = *p++;
+		for (uint32_t i = 0x80; i > 0; i >>= 1) {
+			bool bit = crc & 0x80000000;
+			if (c & i) bit = !bit;
+			crc <<= 1;
+			if (bit) crc ^= 0x04c11db7;
+		}
+	}
+	return crc;
+}
+
+/* The simulated esp_delay() already wakes at the next event
+ */
+extern "C" void esp_schedule() {}
@@ -0,0 +1,378 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* EEPROM, LittleFS, PubSubClient & MQTT broker stand-ins
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
+
+#include <deque>
+#include <set>
+
+#include "secrets.h"
+#include "sim.h"
+
+EEPROMClass EEPROM;
+
+/* Read the EEPROM sector into RAM, like the core does
+ */
+void EEPROMClass::begin(size_t size) {
+	if (size > SIM_FLASH_SECTOR_SIZE) size = SIM_FLASH_SECTOR_SIZE;
+	size = (size + 3) & ~3;
+	if (_data) sim_heap_change(-(int32_t)_size);
+	delete[] _data;
+	_data = new uint8_t[size];
+	sim_heap_change(size);
+	_size = size;
+	_dirty = false;
+	sim_flash_read(SIM_EEPROM_SECTOR * SIM_FLASH_SECTOR_SIZE, _data, _size);
+}
+
+void EEPROMClass::write(int address, uint8_t val) {
+	if (address < 0 || (size_t)address >= _size) return;
+	if (_data[address] != val) { _data[address] = val; _dirty = true; }
+}
+
+/* Erase the whole sector and write it back, only when changed
+ */
+bool EEPROMClass::commit() {
+	if (!_size) return false;
+	if (!_dirty) return true;
+	sim_flash_erase_sector(SIM_EEPROM_SECTOR);
+	sim_flash_write(SIM_EEPROM_SECTOR * SIM_FLASH_SECTOR_SIZE, _data, _size);
+	_dirty = false;
+	return true;
+}
+
+void EEPROMClass::end() {
+	commit();
+	if (_data) sim_heap_change(-(int32_t)_size);
+	delete[] _data;
+	_data = NULL;
+	_size = 0;
+}
+
+/* LittleFS: files are kept in a map, flash time & wear follow what
+ * littlefs does for a small file rewrite: a fresh data block (erase +
+ * program) and a metadata commit, compacting the metadata now and then
+ */
+#define SIM_FS_COMPACT_EVERY 16
+#define SIM_FS_HEAP 1400 // struct + read/prog/lookahead buffers while mounted
+#define SIM_FS_FILE_HEAP 120
+
+namespace littlefs_impl {
+
+class SimFile : public fs::FileImpl {
+	public:
+		SimFile(LittleFSImpl *fs, const std::string &path, bool writing)
+			: _fs(fs), _path(path), _writing(writing), _pos(0) {
+			if (!writing) _buf = fs->_files[path];
+			sim_heap_change(SIM_FS_FILE_HEAP);
+		}
+		~SimFile() { close(); }
+		size_t write(const uint8_t *buf, size_t size) {
+			if (!_writing) return 0;
+			_buf.insert(_buf.end(), buf, buf + size);
+			return size;
+		}
+		size_t read(uint8_t *buf, size_t size) {
+			size_t n = std::min(size, _buf.size() - _pos);
+			memcpy(buf, _buf.data() + _pos, n);
+			_pos += n;
+			return n;
+		}
+		size_t size() const { return _buf.size(); }
+		void close() {
+			if (!_fs) return;
+			if (_writing) _fs->commit(_path, _buf);
+			sim_heap_change(-SIM_FS_FILE_HEAP);
+			_fs = NULL;
+		}
+	private:
+		LittleFSImpl *_fs;
+		std::string _path;
+		bool _writing;
+		size_t _pos;
+		std::vector<uint8_t> _buf;
+};
+
+bool LittleFSImpl::begin() {
+	if (_mounted_boot == sim_boot_count()) return true;
+	sim_advance_us(sim_sample_us(SIM_FS_MOUNT));
+	sim_heap_change(SIM_FS_HEAP);
+	_mounted_boot = sim_boot_count();
+	return true;
+}
+
+void LittleFSImpl::end() {
+	if (_mounted_boot != sim_boot_count()) return;
+	sim_heap_change(-SIM_FS_HEAP);
+	_mounted_boot = 0;
+}
+
+fs::FileImplPtr LittleFSImpl::open(const char *path, const char *mode) {
+	if (_mounted_boot != sim_boot_count()) return fs::FileImplPtr();
+	bool writing = mode[0] == 'w';
+	if (!writing) {
+		if (_files.find(path) == _files.end()) return fs::FileImplPtr();
+		uint8_t page[256];
+		sim_flash_read(_start, page, sizeof(page)); // metadata pair
+		std::vector<uint8_t> data(_files[path].size());
+		sim_flash_read(_start, data.data(), data.size());
+	}
+	return fs::FileImplPtr(new SimFile(this, path, writing));
+}
+
+void LittleFSImpl::commit(const std::string &path, const std::vector<uint8_t> &data) {
+	uint32_t first = _start / SIM_FLASH_SECTOR_SIZE, blocks = _size / _block;
+	std::vector<uint8_t> erased(data.size() + _page, 0xFF);
+	sim_flash_erase_sector(first + 2 + _next_block);
+	_next_block = (_next_block + 1) % (blocks - 2);
+	sim_flash_write(_start, erased.data(), erased.size());
+	if (++_commits % SIM_FS_COMPACT_EVERY == 0) sim_flash_erase_sector(first + (_commits / SIM_FS_COMPACT_EVERY) % 2);
+	_files[path] = data;
+}
+
+}
+
+PubSubClient &PubSubClient::setServer(IPAddress ip, uint16_t port) {
+	_ip = ip;
+	_domain = NULL;
+	_port = port;
+	return *this;
+}
+
+PubSubClient &PubSubClient::setServer(const char *domain, uint16_t port) {
+	_domain = domain;
+	_port = port;
+	return *this;
+}
+
+bool PubSubClient::connect(const char *id) {
+	return connect(id, NULL, NULL);
+}
+
+/* Open TCP if needed, then wait for CONNACK; like the real one, it
+ * doesn't notice a closed connection & waits MQTT_SOCKET_TIMEOUT
+ */
+#define SIM_MQTT_SOCKET_TIMEOUT_US 15000000ULL
+
+bool PubSubClient::connect(const char *id, const char *user, const char *pass) {
+	(void)id; (void)user; (void)pass;
+	_connected = false;
+	if (!_client->connected()) {
+		int res = _domain ? _client->connect(_domain, _port) : _client->connect(_ip, _port);
+		if (!res) return false;
+	}
+	if (sim_chance(sim_config.p_broker_drop)) {
+		sim_broker_stats.drops++;
+		sim_advance_us(SIM_MQTT_SOCKET_TIMEOUT_US);
+		_client->stop();
+		return false;
+	}
+	sim_advance_us(sim_sample_us(SIM_MQTT_CONNACK));
+	if (sim_chance(sim_config.p_mqtt_loss)) {
+		sim_broker_stats.losses++;
+		sim_advance_us(sim_sample_us(SIM_TCP_RTO));
+	}
+	if (!sim_wifi_up()) return false;
+	_connected = true;
+	return true;
+}
+
+bool PubSubClient::publish(const char *topic, const char *payload) {
+	(void)topic; (void)payload;
+	if (!connected()) return false;
+	sim_advance_us(sim_sample_us(SIM_MQTT_PUBLISH));
+	return true;
+}
+
+bool PubSubClient::connected() {
+	return _connected && _client->connected();
+}
+
+void PubSubClient::disconnect() {
+	_connected = false;
+	_client->stop();
+}
+
+/* Broker stand-in: a strict MQTT 3.1.1 parser for what a client writes;
+ * anything it does not expect counts as an error & drops the session,
+ * like a real broker closing the connection. Replies are sent in order,
+ * the CONNACK after the connack model's delay, each PUBACK a TCP round
+ * trip after its PUBLISH came in; some PUBACKs get lost. With the fault
+ * chances, a lost packet or reply costs a TCP retransmit, and the broker
+ * may close the connection instead of answering the CONNECT.
+ */
+SIM_BROKER_STATS_T sim_broker_stats;
+
+struct SIM_REPLY_T {
+	uint64_t at;	// readable from then on
+	uint8_t data[4];
+};
+
+static struct {
+	std::vector<uint8_t> in;		// bytes not yet forming a whole packet
+	std::deque<SIM_REPLY_T> out;
+	size_t out_pos;					// in out.front()
+	std::set<std::string> sessions;	// client ids with a persistent session
+	bool connected, closed;
+	bool dropped;	// closed by the broker, the client sees it
+} g_broker;
+
+void sim_broker_open() {
+	g_broker.in.clear();
+	g_broker.out.clear();
+	g_broker.out_pos = 0;
+	g_broker.connected = g_broker.closed = g_broker.dropped = false;
+}
+
+bool sim_broker_dropped() {
+	return g_broker.dropped;
+}
+
+static void broker_reply(uint64_t delay_us, uint8_t type, uint8_t b2, uint8_t b3) {
+	if (sim_chance(sim_config.p_mqtt_loss)) {
+		sim_broker_stats.losses++;
+		delay_us += sim_sample_us(SIM_TCP_RTO);
+	}
+	SIM_REPLY_T r = { sim_now_us() + delay_us, { type, 2, b2, b3 } };
+	if (!g_broker.out.empty() && r.at < g_broker.out.back().at) r.at = g_broker.out.back().at;
+	g_broker.out.push_back(r);
+}
+
+static bool broker_string(const uint8_t *p, size_t len, size_t *pos, std::string *s) {
+	if (*pos + 2 > len) return false;
+	size_t n = p[*pos] << 8 | p[*pos + 1];
+	if (*pos + 2 + n > len) return false;
+	s->assign((const char *)p + *pos + 2, n);
+	*pos += 2 + n;
+	return true;
+}
+
+static bool broker_connect(const uint8_t *p, size_t len) {
+	static const uint8_t variable[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+	if (g_broker.connected || len < sizeof(variable) + 3) return false;
+	if (memcmp(p, variable, sizeof(variable))) return false;
+	uint8_t flags = p[7];
+	size_t pos = 10;
+	std::string id, user, pass;
+	if (flags & 0x01 || (flags & 0x40 && !(flags & 0x80))) return false;
+	if (!broker_string(p, len, &pos, &id) || id.empty()) return false;
+	if (flags & 0x04) return false; // no will expected
+	if (flags & 0x80 && !broker_string(p, len, &pos, &user)) return false;
+	if (flags & 0x40 && !broker_string(p, len, &pos, &pass)) return false;
+	if (pos != len) return false;
+	if (sim_chance(sim_config.p_broker_drop)) {
+		sim_broker_stats.drops++;
+		g_broker.closed = g_broker.dropped = true;
+		return true;
+	}
+	uint8_t rc = user == MQTT_USER && pass == MQTT_AUTH ? 0 : 5;
+	bool present = false;
+	if (!rc && flags & 0x02) {
+		g_broker.sessions.erase(id);
+	} else if (!rc) {
+		present = !g_broker.sessions.insert(id).second;
+	}
+	broker_reply(sim_sample_us(SIM_MQTT_CONNACK), 0x20, present, rc);
+	g_broker.connected = rc == 0;
+	g_broker.closed = rc != 0;
+	sim_broker_stats.connects++;
+	return true;
+}
+
+static bool broker_publish(uint8_t flags, const uint8_t *p, size_t len) {
+	size_t pos = 0;
+	std::string topic;
+	uint8_t qos = (flags >> 1) & 3;
+	if (!g_broker.connected || qos > 1 || flags & 0x01) return false;
+	if (!broker_string(p, len, &pos, &topic) || topic.empty()) return false;
+	sim_broker_stats.publishes++;
+	if (!qos) return true;
+	if (pos + 2 > len) return false;
+	uint16_t id = p[pos] << 8 | p[pos + 1];
+	if (!id) return false;
+	sim_broker_stats.qos1++;
+	if (flags & 0x08) sim_broker_stats.duplicates++;
+	if (sim_chance(sim_config.p_puback_loss)) return true;
+	broker_reply(sim_sample_us(SIM_TCP), 0x40, id >> 8, id & 0xFF);
+	return true;
+}
+
+static bool broker_packet(uint8_t type, const uint8_t *p, size_t len) {
+	switch (type & 0xF0) {
+		case 0x10:
+			return type == 0x10 && broker_connect(p, len);
+		case 0x30:
+			return broker_publish(type & 0x0F, p, len);
+		case 0xE0:
+			if (type != 0xE0 || !g_broker.connected || len) return false;
+			g_broker.closed = true;
+			sim_broker_stats.disconnects++;
+			return true;
+	}
+	return false;
+}
+
+void sim_broker_receive(const uint8_t *buf, size_t len) {
+	g_broker.in.insert(g_broker.in.end(), buf, buf + len);
+	while (!g_broker.closed && g_broker.in.size() >= 2) {
+		size_t remaining = 0, head = 1;
+		uint8_t b;
+		do {
+			if (head > 4) { sim_broker_stats.errors++; g_broker.closed = true; break; }
+			if (head >= g_broker.in.size()) return;
+			b = g_broker.in[head];
+			remaining |= (size_t)(b & 0x7F) << (7 * (head - 1));
+			head++;
+		} while (b & 0x80);
+		if (g_broker.closed) break;
+		if (g_broker.in.size() < head + remaining) return;
+		if (!broker_packet(g_broker.in[0], &g_broker.in[head], remaining)) {
+			sim_broker_stats.errors++;
+			g_broker.closed = true;
+		}
+		g_broker.in.erase(g_broker.in.begin(), g_broker.in.begin() + head + remaining);
+	}
+	if (g_broker.closed && !g_broker.in.empty()) {
+		if (!g_broker.dropped) sim_broker_stats.errors++; // data after DISCONNECT or an error
+		g_broker.in.clear();
+	}
+}
+
+int sim_broker_available() {
+	int n = 0;
+	for (size_t i = 0; i < g_broker.out.size() && g_broker.out[i].at <= sim_now_us(); i++)
+		n += sizeof(g_broker.out[i].data);
+	return n ? n - g_broker.out_pos : 0;
+}
+
+int sim_broker_read() {
+	if (!sim_broker_available()) return -1;
+	uint8_t c = g_broker.out.front().data[g_broker.out_pos++];
+	if (g_broker.out_pos == sizeof(g_broker.out.front().data)) {
+		g_broker.out.pop_front();
+		g_broker.out_pos = 0;
+	}
+	return c;
+}
@@ -0,0 +1,683 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* ESP8266WiFi stand-in: a station connecting to the simulated mesh APs.
+ *
+ * Connection time is built from the steps the SDK appears to take,
+ * which is enough to reproduce the variants in variations.txt:
+ *   find AP    - nothing with BSSID & channel, scan_bssid with only the
+ *                BSSID, scan_full (strongest AP wins) otherwise; never
+ *                with a stale cache or an AP that is off
+ *   PMK        - only when not persisted from an earlier connection,
+ *                and that is only used with persistent(true)
+ *   assoc      - plus assoc_retry now and then
+ *   DHCP       - unless a static IP was configured
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <lwip/dns.h>
+extern "C" {
+#include <user_interface.h>
+}
+
+#include <vector>
+
+#include "sim.h"
+#include "secrets.h"
+
+ESP8266WiFiClass WiFi;
+
+// what the SDK keeps in its own flash area with persistent(true)
+static struct {
+	bool valid;
+	char ssid[33];
+	char auth[65];
+	uint8_t bssid[6];
+	int32_t channel;
+	bool pmk_valid;
+} g_sdk_config;
+
+// RAM state of the station, reset on every boot
+static struct {
+	bool configured;
+	char ssid[33];
+	char auth[65];
+	bool bssid_set;
+	uint8_t bssid[6];
+	int32_t channel;
+	bool pmk_valid;
+	bool use_sdk_config;
+	bool static_ip;
+	uint32_t ip, gateway, mask, dns1, dns2;
+	bool connecting;
+	bool reachable;
+	const SIM_AP_T *ap;
+	uint64_t connected_at;
+	uint64_t got_ip_at;
+	bool connected_sent, got_ip_sent, disconnected_sent;
+	bool arp_done;
+} g_sta;
+
+// event handlers, dropped once the sketch lets go of the handle
+template <typename T> struct SimEventHandler : public WiFiEventHandlerOpaque {
+	std::function<void(const T &)> f;
+};
+template <typename T> using SimEventHandlers = std::vector<std::weak_ptr<SimEventHandler<T> > >;
+static SimEventHandlers<WiFiEventStationModeConnected> g_on_connected;
+static SimEventHandlers<WiFiEventStationModeDisconnected> g_on_disconnected;
+static SimEventHandlers<WiFiEventStationModeGotIP> g_on_got_ip;
+
+template <typename T>
+static WiFiEventHandler add_handler(SimEventHandlers<T> &list, std::function<void(const T &)> f) {
+	std::shared_ptr<SimEventHandler<T> > handler = std::make_shared<SimEventHandler<T> >();
+	handler->f = f;
+	list.push_back(handler);
+	return handler;
+}
+
+template <typename T>
+static void call_handlers(SimEventHandlers<T> &list, const T &event) {
+	for (size_t i = 0; i < list.size(); i++) {
+		std::shared_ptr<SimEventHandler<T> > handler = list[i].lock();
+		if (handler) handler->f(event);
+	}
+}
+
+static const struct {
+	const char *ssid;
+	uint8_t bssid[6];
+	int32_t channel;
+	int32_t rssi;
+} g_neighbours[] = {
+	{ "FRITZ!Box 7590 XY", { 0x44, 0x4E, 0x6D, 0x01, 0x02, 0x03 }, 1, -78 },
+	{ "Vodafone-2A4C", { 0x9C, 0xC7, 0xA6, 0x0A, 0x0B, 0x0C }, 6, -84 },
+};
+#define SIM_SCAN_MAX (SIM_AP_COUNT + sizeof(g_neighbours) / sizeof(g_neighbours[0]))
+static struct {
+	const char *ssid;
+	const uint8_t *bssid;
+	int32_t channel;
+	int32_t rssi;
+} g_scan[SIM_SCAN_MAX];
+static int g_scan_count = 0;
+static bool g_scan_started = false;
+static uint64_t g_scan_done_at = 0; // async scans are done after this
+
+// the one dns_gethostbyname() lookup in flight
+static struct {
+	bool pending;
+	uint64_t at;
+	bool found;
+	dns_found_callback callback;
+	void *arg;
+} g_dns;
+
+void sim_wifi_reset() {
+	if (!sim_net.ssid) {
+		sim_net.ssid = WIFI_SSID;
+		sim_net.auth = WIFI_AUTH;
+		sim_net.broker_host = MQTT_SERVER;
+		sim_net.broker_port = MQTT_SERVER_PORT;
+	}
+	memset(&g_sta, 0, sizeof(g_sta));
+	memset(&g_dns, 0, sizeof(g_dns));
+	g_scan_count = 0;
+	g_scan_started = false;
+	g_on_connected.clear();
+	g_on_disconnected.clear();
+	g_on_got_ip.clear();
+	WiFi = ESP8266WiFiClass();
+}
+
+/* Once the association time has passed, persist what the SDK would
+ */
+static void sta_update() {
+	if (!g_sta.connecting || sim_now_us() < g_sta.connected_at) return;
+	g_sta.pmk_valid = true;
+	if (g_sdk_config.valid && !strcmp(g_sdk_config.ssid, g_sta.ssid)
+			&& !strcmp(g_sdk_config.auth, g_sta.auth))
+		g_sdk_config.pmk_valid = true;
+}
+
+bool sim_wifi_up() {
+	sta_update();
+	return g_sta.connecting && g_sta.reachable && sim_now_us() >= g_sta.got_ip_at;
+}
+
+/* The AP the station config leads to, NULL if none answers
+ */
+static const SIM_AP_T *sta_find_ap() {
+	const SIM_AP_T *best = NULL;
+	if (strcmp(g_sta.ssid, sim_net.ssid) || strcmp(g_sta.auth, sim_net.auth)) return NULL;
+	for (int i = 0; i < SIM_AP_COUNT; i++) {
+		const SIM_AP_T *ap = &sim_aps[i];
+		if (!ap->up) continue;
+		if (g_sta.bssid_set) {
+			if (memcmp(g_sta.bssid, ap->bssid, 6)) continue;
+			if (g_sta.channel && g_sta.channel != ap->channel) return NULL;
+			return ap;
+		}
+		if (!best || ap->rssi > best->rssi) best = ap;
+	}
+	return best;
+}
+
+/* lwIP resends a lost DHCP DISCOVER or REQUEST after 1s, then 2s, 4s...
+ */
+#define SIM_DHCP_RETRY_US 1000000ULL
+#define SIM_DHCP_TRIES 4
+
+static uint64_t dhcp_loss_us() {
+	uint64_t us = 0;
+	for (int i = 0; i < SIM_DHCP_TRIES && sim_chance(sim_config.p_dhcp_loss); i++) us += SIM_DHCP_RETRY_US << i;
+	return us;
+}
+
+/* Schedule the connection with the current station config
+ */
+static void sta_connect(uint64_t extra_us) {
+	uint64_t t = sim_now_us() + extra_us;
+	g_sta.connecting = true;
+	g_sta.ap = sta_find_ap();
+	g_sta.reachable = g_sta.ap != NULL;
+	if (!g_sta.bssid_set) t += sim_sample_us(SIM_SCAN_FULL);
+	else if (!g_sta.channel) t += sim_sample_us(SIM_SCAN_BSSID);
+	bool pmk_cached = g_sta.pmk_valid || (g_sta.use_sdk_config && g_sdk_config.valid && g_sdk_config.pmk_valid
+		&& !strcmp(g_sdk_config.ssid, g_sta.ssid) && !strcmp(g_sdk_config.auth, g_sta.auth));
+	if (!pmk_cached) t += sim_sample_us(SIM_PMK);
+	t += sim_sample_us(SIM_ASSOC);
+	if (sim_chance(sim_config.p_assoc_retry)) t += sim_sample_us(SIM_ASSOC_RETRY);
+	g_sta.connected_at = t;
+	g_sta.got_ip_at = g_sta.static_ip ? t : t + sim_sample_us(SIM_DHCP) + dhcp_loss_us();
+	g_sta.connected_sent = g_sta.got_ip_sent = g_sta.disconnected_sent = false;
+	g_sta.arp_done = false;
+}
+
+/* When the next SDK event is due, if any
+ */
+static uint64_t sta_next_event_us() {
+	if (!g_sta.connecting) return UINT64_MAX;
+	if (!g_sta.reachable) return g_sta.disconnected_sent ? UINT64_MAX : g_sta.connected_at;
+	if (!g_sta.connected_sent) return g_sta.connected_at;
+	if (!g_sta.got_ip_sent) return g_sta.got_ip_at;
+	return UINT64_MAX;
+}
+
+uint64_t sim_wifi_next_event_us() {
+	uint64_t t = sta_next_event_us();
+	if (g_dns.pending && g_dns.at < t) t = g_dns.at;
+	return t;
+}
+
+static void send_disconnected(WiFiDisconnectReason reason) {
+	WiFiEventStationModeDisconnected ev;
+	ev.ssid = g_sta.ssid;
+	memcpy(ev.bssid, g_sta.bssid, 6);
+	ev.reason = reason;
+	g_sta.disconnected_sent = true;
+	call_handlers(g_on_disconnected, ev);
+}
+
+/* Call the handlers for everything that happened up to now
+ */
+void sim_wifi_fire_events() {
+	uint64_t now = sim_now_us();
+	if (g_dns.pending && now >= g_dns.at) {
+		ip_addr_t ip = { sim_net.broker_ip };
+		g_dns.pending = false;
+		g_dns.callback(sim_net.broker_host, g_dns.found ? &ip : NULL, g_dns.arg);
+	}
+	if (!g_sta.connecting) return;
+	if (!g_sta.reachable) {
+		if (!g_sta.disconnected_sent && now >= g_sta.connected_at)
+			send_disconnected(WIFI_DISCONNECT_REASON_NO_AP_FOUND);
+		return;
+	}
+	if (!g_sta.connected_sent && now >= g_sta.connected_at) {
+		WiFiEventStationModeConnected ev;
+		ev.ssid = sim_net.ssid;
+		memcpy(ev.bssid, g_sta.ap->bssid, 6);
+		ev.channel = g_sta.ap->channel;
+		g_sta.connected_sent = true;
+		call_handlers(g_on_connected, ev);
+	}
+	if (g_sta.connected_sent && !g_sta.got_ip_sent && now >= g_sta.got_ip_at) {
+		WiFiEventStationModeGotIP ev;
+		ev.ip = g_sta.static_ip ? g_sta.ip : sim_net.lease_ip;
+		ev.mask = g_sta.static_ip ? g_sta.mask : sim_net.mask;
+		ev.gw = g_sta.static_ip ? g_sta.gateway : sim_net.gateway;
+		g_sta.got_ip_sent = true;
+		call_handlers(g_on_got_ip, ev);
+	}
+}
+
+bool ESP8266WiFiClass::mode(WiFiMode_t m) {
+	if (m == WIFI_OFF) disconnect();
+	_mode = m;
+	return true;
+}
+
+wl_status_t ESP8266WiFiClass::begin(const char *ssid, const char *passphrase,
+		int32_t channel, const uint8_t *bssid, bool connect) {
+	if (!(_mode & WIFI_STA)) mode(WIFI_STA);
+	disconnect();
+	if (strcmp(g_sta.ssid, ssid) || strcmp(g_sta.auth, passphrase ? passphrase : ""))
+		g_sta.pmk_valid = false;
+	g_sta.configured = true;
+	snprintf(g_sta.ssid, sizeof(g_sta.ssid), "%s", ssid);
+	snprintf(g_sta.auth, sizeof(g_sta.auth), "%s", passphrase ? passphrase : "");
+	g_sta.bssid_set = (bssid != NULL);
+	if (bssid) memcpy(g_sta.bssid, bssid, 6);
+	g_sta.channel = channel;
+	g_sta.use_sdk_config = _persistent;
+	if (_persistent) {
+		bool same_key = g_sdk_config.valid && !strcmp(g_sdk_config.ssid, g_sta.ssid)
+			&& !strcmp(g_sdk_config.auth, g_sta.auth);
+		g_sdk_config.pmk_valid = same_key && g_sdk_config.pmk_valid;
+		g_sdk_config.valid = true;
+		memcpy(g_sdk_config.ssid, g_sta.ssid, sizeof(g_sta.ssid));
+		memcpy(g_sdk_config.auth, g_sta.auth, sizeof(g_sta.auth));
+		memcpy(g_sdk_config.bssid, g_sta.bssid, 6);
+		g_sdk_config.channel = channel;
+	}
+	if (connect) sta_connect(0);
+	return status();
+}
+
+bool ESP8266WiFiClass::config(IPAddress local_ip, IPAddress gateway, IPAddress subnet,
+		IPAddress dns1, IPAddress dns2) {
+	g_sta.static_ip = (uint32_t)local_ip != 0;
+	g_sta.ip = local_ip;
+	g_sta.gateway = gateway;
+	g_sta.mask = subnet;
+	g_sta.dns1 = dns1;
+	g_sta.dns2 = dns2;
+	return true;
+}
+
+bool ESP8266WiFiClass::reconnect() {
+	if (!(_mode & WIFI_STA)) return false;
+	if (!g_sta.configured) {
+		if (!g_sdk_config.valid) return false;
+		g_sta.configured = true;
+		memcpy(g_sta.ssid, g_sdk_config.ssid, sizeof(g_sta.ssid));
+		memcpy(g_sta.auth, g_sdk_config.auth, sizeof(g_sta.auth));
+		g_sta.bssid_set = true;
+		memcpy(g_sta.bssid, g_sdk_config.bssid, 6);
+		g_sta.channel = g_sdk_config.channel;
+		g_sta.use_sdk_config = true;
+	}
+	disconnect();
+	sta_connect(sim_sample_us(SIM_RECONNECT));
+	return true;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifioff) {
+	sta_update();
+	if (g_sta.connecting && g_sta.connected_sent) send_disconnected(WIFI_DISCONNECT_REASON_ASSOC_LEAVE);
+	g_sta.connecting = false;
+	if (wifioff) _mode = WIFI_OFF;
+	return true;
+}
+
+wl_status_t ESP8266WiFiClass::status() {
+	if (sim_wifi_up()) return WL_CONNECTED;
+	if (g_sta.connecting && !g_sta.reachable && sim_now_us() >= g_sta.connected_at)
+		return WL_NO_SSID_AVAIL;
+	return WL_DISCONNECTED;
+}
+
+IPAddress ESP8266WiFiClass::localIP() {
+	if (!sim_wifi_up()) return IPAddress();
+	return IPAddress(g_sta.static_ip ? g_sta.ip : sim_net.lease_ip);
+}
+
+IPAddress ESP8266WiFiClass::subnetMask() {
+	if (!sim_wifi_up()) return IPAddress();
+	return IPAddress(g_sta.static_ip ? g_sta.mask : sim_net.mask);
+}
+
+IPAddress ESP8266WiFiClass::gatewayIP() {
+	if (!sim_wifi_up()) return IPAddress();
+	return IPAddress(g_sta.static_ip ? g_sta.gateway : sim_net.gateway);
+}
+
+IPAddress ESP8266WiFiClass::dnsIP(uint8_t dns_no) {
+	if (!sim_wifi_up()) return IPAddress();
+	if (g_sta.static_ip) return IPAddress(dns_no == 0 ? g_sta.dns1 : dns_no == 1 ? g_sta.dns2 : 0);
+	return IPAddress(dns_no == 0 ? sim_net.dns1 : dns_no == 1 ? sim_net.dns2 : 0);
+}
+
+uint8_t *ESP8266WiFiClass::BSSID() {
+	static uint8_t bssid[6];
+	if (sim_wifi_up()) memcpy(bssid, g_sta.ap->bssid, 6);
+	else memcpy(bssid, g_sta.bssid, 6);
+	return bssid;
+}
+
+static String bssid_string(const uint8_t *b) {
+	char buf[18];
+	snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", b[0], b[1], b[2], b[3], b[4], b[5]);
+	return String(buf);
+}
+
+String ESP8266WiFiClass::BSSIDstr() { return bssid_string(BSSID()); }
+
+int32_t ESP8266WiFiClass::channel() {
+	if (sim_wifi_up()) return g_sta.ap->channel;
+	return g_sta.channel ? g_sta.channel : 1;
+}
+
+int32_t ESP8266WiFiClass::RSSI() {
+	if (!sim_wifi_up()) return 31; // what the SDK reports when not connected
+	return g_sta.ap->rssi - (int32_t)(sim_random() % 5);
+}
+
+int ESP8266WiFiClass::hostByName(const char *aHostname, IPAddress &aResult) {
+	aResult = IPAddress();
+	if (!sim_wifi_up()) return 0;
+	sim_advance_us(sim_sample_us(SIM_DNS));
+	if (strcmp(aHostname, sim_net.broker_host) != 0) return 0;
+	aResult = IPAddress(sim_net.broker_ip);
+	return 1;
+}
+
+/* Answers with the broker's address after the round-trip; a second
+ * lookup while one is in flight is refused, lwIP's table is bigger
+ */
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found,
+		void *callback_arg) {
+	(void)addr;
+	if (!sim_wifi_up() || g_dns.pending || !found) return ERR_ARG;
+	g_dns.pending = true;
+	g_dns.at = sim_now_us() + sim_sample_us(SIM_DNS);
+	g_dns.found = strcmp(hostname, sim_net.broker_host) == 0;
+	g_dns.callback = found;
+	g_dns.arg = callback_arg;
+	return ERR_INPROGRESS;
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeConnected(
+		std::function<void(const WiFiEventStationModeConnected &)> f) {
+	return add_handler(g_on_connected, f);
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeDisconnected(
+		std::function<void(const WiFiEventStationModeDisconnected &)> f) {
+	return add_handler(g_on_disconnected, f);
+}
+
+WiFiEventHandler ESP8266WiFiClass::onStationModeGotIP(
+		std::function<void(const WiFiEventStationModeGotIP &)> f) {
+	return add_handler(g_on_got_ip, f);
+}
+
+void ESP8266WiFiClass::printDiag(Print &dest) {
+	dest.print("Mode: "); dest.println(_mode == WIFI_STA ? "STA" : "other");
+	dest.print("Channel: "); dest.println(channel());
+	dest.print("SSID ("); dest.print((int)strlen(g_sta.ssid)); dest.print("): "); dest.println(g_sta.ssid);
+	dest.print("BSSID set: "); dest.println(g_sta.bssid_set ? 1 : 0);
+	dest.print("Auto connect: "); dest.println(0);
+}
+
+/* A scan of one channel (and SSID) answers once a probe response comes
+ * in; without any, it dwells on the channel for the model's max. An
+ * async scan has its results once the same time has passed.
+ */
+int8_t ESP8266WiFiClass::scanNetworks(bool async, bool show_hidden, uint8_t channel, uint8_t *ssid) {
+	(void)show_hidden;
+	if (!(_mode & WIFI_STA)) mode(WIFI_STA);
+	g_scan_count = 0;
+	for (int i = 0; i < SIM_AP_COUNT; i++) {
+		if (!sim_aps[i].up) continue;
+		g_scan[g_scan_count].ssid = sim_net.ssid;
+		g_scan[g_scan_count].bssid = sim_aps[i].bssid;
+		g_scan[g_scan_count].channel = sim_aps[i].channel;
+		g_scan[g_scan_count].rssi = sim_aps[i].rssi - (int32_t)(sim_random() % 5);
+		g_scan_count++;
+	}
+	for (size_t i = 0; i < sizeof(g_neighbours) / sizeof(g_neighbours[0]); i++) {
+		g_scan[g_scan_count].ssid = g_neighbours[i].ssid;
+		g_scan[g_scan_count].bssid = g_neighbours[i].bssid;
+		g_scan[g_scan_count].channel = g_neighbours[i].channel;
+		g_scan[g_scan_count].rssi = g_neighbours[i].rssi;
+		g_scan_count++;
+	}
+	int n = 0;
+	for (int i = 0; i < g_scan_count; i++) {
+		if (channel && g_scan[i].channel != channel) continue;
+		if (ssid && strcmp(g_scan[i].ssid, (const char *)ssid)) continue;
+		g_scan[n++] = g_scan[i];
+	}
+	g_scan_count = n;
+	uint64_t us;
+	if (!channel) us = sim_sample_us(SIM_SCAN_DIAG);
+	else if (n) us = sim_sample_us(SIM_SCAN_CHANNEL);
+	else us = (uint64_t)(sim_models[SIM_SCAN_CHANNEL].max_ms * 1000);
+	g_scan_started = true;
+	g_scan_done_at = sim_now_us() + us;
+	if (async) return WIFI_SCAN_RUNNING;
+	sim_advance_us(us);
+	return g_scan_count;
+}
+
+int8_t ESP8266WiFiClass::scanComplete() {
+	if (!g_scan_started) return WIFI_SCAN_FAILED;
+	if (sim_now_us() < g_scan_done_at) return WIFI_SCAN_RUNNING;
+	return g_scan_count;
+}
+
+void ESP8266WiFiClass::scanDelete() {
+	g_scan_count = 0;
+	g_scan_started = false;
+}
+
+String ESP8266WiFiClass::SSID(uint8_t i) {
+	if (i >= g_scan_count) return String();
+	return String(g_scan[i].ssid);
+}
+
+int32_t ESP8266WiFiClass::RSSI(uint8_t i) {
+	if (i >= g_scan_count) return 0;
+	return g_scan[i].rssi;
+}
+
+int32_t ESP8266WiFiClass::channel(uint8_t i) {
+	if (i >= g_scan_count) return 0;
+	return g_scan[i].channel;
+}
+
+uint8_t *ESP8266WiFiClass::BSSID(uint8_t i) {
+	static uint8_t bssid[6];
+	memset(bssid, 0, 6);
+	if (i < g_scan_count) memcpy(bssid, g_scan[i].bssid, 6);
+	return bssid;
+}
+
+String ESP8266WiFiClass::BSSIDstr(uint8_t i) { return bssid_string(BSSID(i)); }
+
+/* TCP to the broker; anything else runs into the connect timeout. A
+ * lost ARP request is sent again by etharp_tmr() a second later, a lost
+ * SYN after lwIP's initial RTO of 3s.
+ */
+#define SIM_ARP_RETRY_US 1000000
+#define SIM_SYN_RETRY_US 3000000
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+	_connected = false;
+	if (!sim_wifi_up() || (uint32_t)ip == 0) { sim_advance_us(200); return 0; }
+	if ((uint32_t)ip != sim_net.broker_ip || port != sim_net.broker_port) {
+		sim_advance_us(5000000);
+		return 0;
+	}
+	if (!g_sta.arp_done) {
+		sim_advance_us(sim_sample_us(SIM_ARP));
+		if (sim_chance(sim_config.p_arp_loss)) sim_advance_us(SIM_ARP_RETRY_US);
+		g_sta.arp_done = true;
+	}
+	sim_advance_us(sim_sample_us(SIM_TCP));
+	if (sim_chance(sim_config.p_syn_loss)) sim_advance_us(SIM_SYN_RETRY_US);
+	sim_broker_open();
+	_connected = true;
+	return 1;
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+	IPAddress ip;
+	if (!WiFi.hostByName(host, ip)) return 0;
+	return connect(ip, port);
+}
+
+/* The PubSubClient stand-in does not write, it accounts for its own
+ * time; anything written goes to the broker stand-in in one segment
+ */
+size_t WiFiClient::write(const uint8_t *buf, size_t len) {
+	if (!_connected || !sim_wifi_up()) return 0;
+	sim_advance_us(sim_sample_us(SIM_MQTT_PUBLISH));
+	sim_broker_receive(buf, len);
+	return len;
+}
+
+/* Like the core: still connected while there is something to read, even
+ * when the broker closed the connection
+ */
+uint8_t WiFiClient::connected() {
+	return _connected && (!sim_broker_dropped() || sim_broker_available());
+}
+
+int WiFiClient::available() {
+	return _connected ? sim_broker_available() : 0;
+}
+
+int WiFiClient::read() {
+	return _connected ? sim_broker_read() : -1;
+}
+
+/* The SDK connects before the channel from begin() is applied, so the
+ * channel has to be found again
+ */
+/* Stops connecting, but keeps the station config
+ */
+extern "C" bool wifi_station_disconnect(void) {
+	sta_update();
+	if (g_sta.connecting && g_sta.connected_sent) send_disconnected(WIFI_DISCONNECT_REASON_ASSOC_LEAVE);
+	g_sta.connecting = false;
+	return true;
+}
+
+extern "C" bool wifi_station_connect(void) {
+	if (!g_sta.configured) return false;
+	int32_t channel = g_sta.channel;
+	WiFi.disconnect();
+	g_sta.channel = 0;
+	sta_connect(0);
+	g_sta.channel = channel;
+	return true;
+}
+
+/* UDP: only DNS to the configured server & mDNS questions have anyone
+ * listening; the broker's name gets an A record with sim_net.broker_ttl,
+ * other names NXDOMAIN or, for mDNS, no answer at all
+ */
+uint8_t WiFiUDP::begin(uint16_t port) {
+	(void)port;
+	_bound = sim_wifi_up();
+	return _bound;
+}
+
+void WiFiUDP::stop() {
+	_bound = false;
+	_queue.clear();
+	_in.clear();
+	_in_pos = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port) {
+	_to_ip = ip;
+	_to_port = port;
+	_out.clear();
+	return _bound;
+}
+
+int WiFiUDP::beginPacketMulticast(IPAddress addr, uint16_t port, IPAddress interfaceAddr, int ttl) {
+	(void)interfaceAddr; (void)ttl;
+	return beginPacket(addr, port);
+}
+
+/* Name of the first question; false if malformed
+ */
+static bool dns_question(const std::vector<uint8_t> &q, std::string *name, size_t *end) {
+	size_t pos = 12;
+	name->clear();
+	while (pos < q.size() && q[pos]) {
+		size_t len = q[pos];
+		if (len > 63 || pos + 1 + len > q.size()) return false;
+		if (!name->empty()) *name += '.';
+		name->append((const char *)&q[pos + 1], len);
+		pos += 1 + len;
+	}
+	if (pos + 5 > q.size()) return false;
+	*end = pos + 5;
+	return true;
+}
+
+int WiFiUDP::endPacket() {
+	if (!_bound || !sim_wifi_up()) return 0;
+	sim_advance_us(100);
+	bool mdns = _to_ip == (uint32_t)IPAddress(224, 0, 0, 251) && _to_port == 5353;
+	bool dns = _to_ip == (uint32_t)WiFi.dnsIP(0) && _to_port == 53;
+	std::string name;
+	size_t end;
+	if (!(mdns || dns) || _out.size() < 12 || !dns_question(_out, &name, &end)) return 1;
+	bool found = strcasecmp(name.c_str(), sim_net.broker_host) == 0;
+	if (mdns && !found) return 1;
+	Datagram d;
+	d.at = sim_now_us() + sim_sample_us(SIM_DNS);
+	d.data.assign(_out.begin(), _out.begin() + end);
+	d.data[2] = 0x80 | (_out[2] & 0x01); // answer, RD copied
+	d.data[3] = found ? 0x80 : 0x83; // RA, NXDOMAIN
+	if (found) {
+		uint32_t ip = sim_net.broker_ip, ttl = sim_net.broker_ttl;
+		const uint8_t answer[] = { 0xC0, 12, 0, 1, 0, 1,
+			(uint8_t)(ttl >> 24), (uint8_t)(ttl >> 16), (uint8_t)(ttl >> 8), (uint8_t)ttl, 0, 4,
+			(uint8_t)ip, (uint8_t)(ip >> 8), (uint8_t)(ip >> 16), (uint8_t)(ip >> 24) };
+		d.data[7] = 1;
+		d.data.insert(d.data.end(), answer, answer + sizeof(answer));
+	}
+	_queue.push_back(d);
+	return 1;
+}
+
+int WiFiUDP::parsePacket() {
+	_in.clear();
+	_in_pos = 0;
+	if (_queue.empty() || _queue.front().at > sim_now_us()) return 0;
+	_in = _queue.front().data;
+	_queue.pop_front();
+	return _in.size();
+}
+
+int WiFiUDP::read(uint8_t *buf, size_t len) {
+	size_t n = std::min(len, _in.size() - _in_pos);
+	memcpy(buf, _in.data() + _in_pos, n);
+	_in_pos += n;
+	return n;
+}
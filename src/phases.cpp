@@ -0,0 +1,81 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Latency histograms of the boot phases, kept over reboots
+ *
+ * Each boot adds its phase times from the trace to 8 bit log-scale
+ * histograms in the settings: they live in RTC memory with them and go
+ * to flash with every settings flush, so the device knows its own
+ * p50/p90/p99 without a serial cable. Counts are halved when one would
+ * overflow, so older boots fade out.
+ */
+
+#include <Arduino.h>
+
+#include "main.h"
+#include "phases.h"
+#include "trace.h"
+
+struct PHASE_INFO_T {
+	const char *name;	// trace span, see TIME_STOP() in main.cpp
+	uint16_t base_ms;	// first bucket edge, the last one is base * 128
+};
+
+static const PHASE_INFO_T phase_info[PHASE_COUNT] = {
+	{ "setup_total", 64 },
+	{ "setup_wifi", 64 },
+	{ "wifi_fast_connect", 32 },
+	{ "publish_mqtt", 4 },
+};
+
+static const uint8_t phase_percents[] = { 50, 90, 99 };
+
+void phases_clear(PHASES_T *p) {
+	memset(p, 0, sizeof(PHASES_T));
+}
+
+/* Count this boot's phases; call before trace_flush()
+ */
+void phases_record(PHASES_T *p) {
+	p->boots++;
+	for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+		uint32_t us;
+		if (trace_find(phase_info[i].name, &us)) histo8_add(&p->histo[i], phase_info[i].base_ms, us / 1000);
+	}
+}
+
+/* Show <name_p50=ms> etc. every PHASES_REPORT_EVERY boots, or when
+ * something was sent to us; the value is the upper bucket edge, -1 for
+ * the open last bucket
+ */
+void phases_display(const PHASES_T *p) {
+	bool asked = false;
+	while (Serial.available()) { Serial.read(); asked = true; }
+	if (!asked && (p->boots % PHASES_REPORT_EVERY)) return;
+
+	char key[32];
+	for (uint8_t i = 0; i < PHASE_COUNT; i++) {
+		if (!histo8_total(&p->histo[i])) continue;
+		for (uint8_t j = 0; j < sizeof(phase_percents); j++) {
+			snprintf(key, sizeof(key), "%s_p%u", phase_info[i].name, phase_percents[j]);
+			DEBUG_TAG_P(key, histo8_percentile(&p->histo[i], phase_info[i].base_ms, phase_percents[j]));
+		}
+	}
+	DEBUG_TAG("phase_count", histo8_total(&p->histo[PHASE_SETUP_TOTAL]));
+}
@@ -0,0 +1,48 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef PHASES_H
+#define PHASES_H
+
+#include <Arduino.h>
+
+#include "histogram.h"
+
+// boot phases whose times are kept with the settings, over reboots;
+// each is the trace span of the same name, counted in ms
+enum PHASE_ID {
+	PHASE_SETUP_TOTAL,
+	PHASE_SETUP_WIFI,
+	PHASE_WIFI_FAST,
+	PHASE_PUBLISH,
+	PHASE_COUNT
+};
+
+#define PHASES_REPORT_EVERY 16 // boots, or send any character to get them
+
+struct PHASES_T {
+	HISTO8_T histo[PHASE_COUNT];
+	uint8_t boots; // counted, wraps
+};
+
+void phases_clear(PHASES_T *p);
+void phases_record(PHASES_T *p);
+void phases_display(const PHASES_T *p);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Resolve the MQTT host once per TTL, without blocking the publish:
+ * resolver_start() only sends the query, unicast to the DNS server or,
+ * for a .local name, as an mDNS question asking for a unicast answer;
+ * resolver_finish() picks up the answer later. Only an answer with an
+ * A record replaces the cached address; a timeout or error keeps it.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+
+#include "resolver.h"
+
+#define DNS_PORT 53
+#define MDNS_PORT 5353
+#define DNS_TYPE_A 1
+#define DNS_CLASS_IN 1
+#define DNS_FLAG_RD 0x0100     // recursion desired
+#define DNS_FLAG_QR 0x8000     // this is an answer
+#define MDNS_CLASS_QU 0x8000   // ask for a unicast answer
+
+static WiFiUDP resolver_udp;
+static struct {
+	bool pending;
+	uint16_t id;	// 0 for mDNS
+	uint32_t sent_ms;
+} query;
+
+void resolver_clear(DNS_CACHE_T *c) {
+	memset(c, 0, sizeof(DNS_CACHE_T));
+}
+
+void resolver_age(DNS_CACHE_T *c, uint32_t ms) {
+	c->age_ms = (c->age_ms + ms < c->age_ms) ? UINT32_MAX : c->age_ms + ms;
+}
+
+bool resolver_stale(const DNS_CACHE_T *c) {
+	return !c->ip || c->age_ms / 1000 >= c->ttl_s;
+}
+
+static bool is_local(const char *host) {
+	size_t len = strlen(host);
+	return len > 6 && !strcasecmp(&host[len - 6], ".local");
+}
+
+/* Send an A query for host, no waiting
+ */
+bool resolver_start(const char *host, IPAddress dns) {
+	uint8_t buf[12 + 256 + 4];
+	bool mdns = is_local(host);
+	uint16_t n = 12;
+	query.pending = false;
+	query.id = mdns ? 0 : (uint16_t)random(1, 0x10000);
+	uint16_t flags = mdns ? 0 : DNS_FLAG_RD;
+	uint8_t header[12] = { (uint8_t)(query.id >> 8), (uint8_t)query.id,
+		(uint8_t)(flags >> 8), (uint8_t)flags, 0, 1, 0, 0, 0, 0, 0, 0 };
+	memcpy(buf, header, sizeof(header));
+	// labels
+	const char *label = host;
+	while (*label) {
+		const char *dot = strchr(label, '.');
+		size_t len = dot ? (size_t)(dot - label) : strlen(label);
+		if (len == 0 || len > 63 || n + 1 + len + 5 > sizeof(buf)) return false;
+		buf[n++] = len;
+		memcpy(&buf[n], label, len);
+		n += len;
+		label += len + (dot ? 1 : 0);
+	}
+	uint16_t qclass = DNS_CLASS_IN | (mdns ? MDNS_CLASS_QU : 0);
+	uint8_t tail[5] = { 0, 0, DNS_TYPE_A, (uint8_t)(qclass >> 8), (uint8_t)qclass };
+	memcpy(&buf[n], tail, sizeof(tail));
+	n += sizeof(tail);
+
+	resolver_udp.stop();
+	if (!resolver_udp.begin(0)) return false;
+	int ok = mdns
+		? resolver_udp.beginPacketMulticast(IPAddress(224, 0, 0, 251), MDNS_PORT, WiFi.localIP())
+		: resolver_udp.beginPacket(dns, DNS_PORT);
+	if (!ok) return false;
+	resolver_udp.write(buf, n);
+	if (!resolver_udp.endPacket()) return false;
+	query.pending = true;
+	query.sent_ms = millis();
+	return true;
+}
+
+/* Past a name at pos, 0 when it runs off the end
+ */
+static uint16_t skip_name(const uint8_t *p, uint16_t len, uint16_t pos) {
+	while (pos < len) {
+		if (p[pos] == 0) return pos + 1;
+		if ((p[pos] & 0xC0) == 0xC0) return pos + 2 <= len ? pos + 2 : 0;
+		pos += 1 + p[pos];
+	}
+	return 0;
+}
+
+/* First A record of an answer to our query
+ */
+static bool parse_answer(const uint8_t *p, uint16_t len, uint32_t *ip, uint32_t *ttl_s) {
+	if (len < 12) return false;
+	uint16_t id = p[0] << 8 | p[1], flags = p[2] << 8 | p[3];
+	if (id != query.id || !(flags & DNS_FLAG_QR) || (flags & 0x000F)) return false;
+	uint16_t questions = p[4] << 8 | p[5], answers = p[6] << 8 | p[7];
+	uint16_t pos = 12;
+	while (questions--) {
+		pos = skip_name(p, len, pos);
+		if (!pos || pos + 4 > len) return false;
+		pos += 4;
+	}
+	while (answers--) {
+		pos = skip_name(p, len, pos);
+		if (!pos || pos + 10 > len) return false;
+		uint16_t type = p[pos] << 8 | p[pos + 1];
+		uint16_t rclass = (p[pos + 2] << 8 | p[pos + 3]) & 0x7FFF; // mDNS cache-flush bit
+		uint32_t ttl = (uint32_t)p[pos + 4] << 24 | (uint32_t)p[pos + 5] << 16 | p[pos + 6] << 8 | p[pos + 7];
+		uint16_t rdlen = p[pos + 8] << 8 | p[pos + 9];
+		pos += 10;
+		if (pos + rdlen > len) return false;
+		if (type == DNS_TYPE_A && rclass == DNS_CLASS_IN && rdlen == 4) {
+			*ip = p[pos] | p[pos + 1] << 8 | p[pos + 2] << 16 | (uint32_t)p[pos + 3] << 24;
+			*ttl_s = ttl;
+			return true;
+		}
+		pos += rdlen;
+	}
+	return false;
+}
+
+/* Wait for the answer to resolver_start(), up to RESOLVER_TIMEOUT after
+ * it was sent; true when the cache was updated
+ */
+bool resolver_finish(DNS_CACHE_T *c) {
+	static uint8_t buf[RESOLVER_PACKET];
+	bool updated = false;
+	while (query.pending && millis() - query.sent_ms < RESOLVER_TIMEOUT) {
+		int size = resolver_udp.parsePacket();
+		if (!size) { yield(); continue; }
+		uint16_t len = resolver_udp.read(buf, sizeof(buf));
+		uint32_t ip, ttl_s;
+		if (!parse_answer(buf, len, &ip, &ttl_s) || !ip) continue;
+		c->ip = ip;
+		c->ttl_s = constrain(ttl_s, RESOLVER_TTL_MIN, RESOLVER_TTL_MAX);
+		c->age_ms = 0;
+		updated = true;
+		query.pending = false;
+	}
+	query.pending = false;
+	resolver_udp.stop();
+	return updated;
+}
+
+/* Blocking, for when there is no address yet; falls back on the core's
+ * resolver, which has no TTL
+ */
+bool resolver_lookup(DNS_CACHE_T *c, const char *host, IPAddress dns) {
+	if (resolver_start(host, dns) && resolver_finish(c)) return true;
+	IPAddress ip;
+	if (!WiFi.hostByName(host, ip)) return false;
+	c->ip = (uint32_t)ip;
+	c->ttl_s = RESOLVER_TTL_FALLBACK;
+	c->age_ms = 0;
+	return true;
+}
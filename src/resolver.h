@@ -0,0 +1,47 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// cached address of a host name, kept with the settings; there is no
+// wall clock, so its age is the time awake since the last answer
+#define RESOLVER_TTL_MIN 30      // s, answers with less are kept this long
+#define RESOLVER_TTL_MAX 86400   // s
+#define RESOLVER_TTL_FALLBACK 300 // s, after hostByName(), which has no TTL
+#define RESOLVER_TIMEOUT 1000    // ms to wait for an answer
+#define RESOLVER_PACKET 256      // bytes of an answer looked at
+
+struct DNS_CACHE_T {
+	uint32_t ip;		// last good address, 0 = none
+	uint32_t ttl_s;		// of that answer
+	uint32_t age_ms;	// awake since then, saturating
+};
+
+void resolver_clear(DNS_CACHE_T *c);
+void resolver_age(DNS_CACHE_T *c, uint32_t ms);
+bool resolver_stale(const DNS_CACHE_T *c);
+bool resolver_start(const char *host, IPAddress dns);
+bool resolver_finish(DNS_CACHE_T *c);
+bool resolver_lookup(DNS_CACHE_T *c, const char *host, IPAddress dns);
+
+#endif
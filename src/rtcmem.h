@@ -0,0 +1,36 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef RTCMEM_H
+#define RTCMEM_H
+
+// who uses which part of the 512 bytes of RTC user memory; offsets are
+// in 4-byte blocks, as ESP.rtcUserMemoryRead/Write take them
+#define RTC_USER_BLOCKS 128
+#define RTC_SETTINGS_BLOCK 0 // RTC_SETTINGS_T, see settings.cpp
+#define RTC_SETTINGS_BLOCKS 97
+#define RTC_OUTBOX_BLOCK 97 // QoS1 PUBLISHes not acknowledged, wifistuff.cpp
+#define RTC_OUTBOX_BLOCKS 26
+#define RTC_DUTY_BLOCK 123 // wakes counted by duty.cpp
+#define RTC_DUTY_BLOCKS 1
+#define RTC_TELEMETRY_BLOCK 124 // when to send the field names, telemetry.cpp
+#define RTC_TELEMETRY_BLOCKS 1
+// 125-127 are free
+
+#endif
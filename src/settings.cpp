@@ -22,15 +22,40 @@
 
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
-#include <EEPROM.h>
+#include <coredecls.h>
 
 #include "main.h"
+#include "rtcmem.h"
 #include "settings.h"
+#include "settingslog.h"
+#include "store.h"
 #include "secrets.h"
 
+// the strings of WIFI_SETTINGS_T, in SETTINGS_STR order
+static const char settings_strings[] PROGMEM =
+	WIFI_SSID "\0" WIFI_AUTH "\0" MQTT_SERVER "\0" MQTT_USER "\0" MQTT_AUTH;
+static_assert(sizeof(settings_strings) <= SETTINGS_STRINGS_SIZE, "settings strings");
+
+/* One of the packed strings, "" if the record has fewer
+ */
+const char *settings_str(const WIFI_SETTINGS_T *data, SETTINGS_STR which) {
+	const char *p = data->strings;
+	const char *end = data->strings + sizeof(data->strings);
+	for (uint8_t i = 0; i < which && p < end; i++) p += strnlen(p, end - p) + 1;
+	if (p >= end || !memchr(p, 0, end - p)) return "";
+	return p;
+}
+
 /* Use wifi object to build settings
  */
 void build_settings_from_wifi(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w) {
+    // what we learned so far is only good with valid settings
+    if (data->magic != MAGIC_NUM) {
+        ap_cache_clear(&data->ap_cache);
+        memset(&data->fast_histo, 0, sizeof(data->fast_histo));
+        phases_clear(&data->phases);
+        resolver_clear(&data->mqtt_dns);
+    }
     // main settings
     data->magic = MAGIC_NUM;
     data->ip_address = w->localIP();
@@ -38,75 +63,121 @@ void build_settings_from_wifi(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w) {
     data->ip_mask = w->subnetMask();
     data->ip_dns1 = w->dnsIP(0);
     data->ip_dns2 = w->dnsIP(1);
-    strncpy(data->wifi_ssid, WIFI_SSID, 50);
-    strncpy(data->wifi_auth, WIFI_AUTH, 50);
-    memcpy(data->wifi_bssid, w->BSSID(), 6);
-    data->wifi_channel = w->channel();
-    // lookup IP for mqtt server
-    strncpy(data->mqtt_host_str, MQTT_SERVER, 50);
-    IPAddress mqtt_ip;
-    int err = w->hostByName(MQTT_SERVER, mqtt_ip);
-    if (err==0) { 
-    #ifdef DEBUG_MODE
-    Serial.print(" ** Can't resolve host "); Serial.println(MQTT_SERVER); 
-    #endif
-    }
-    memcpy(&data->mqtt_host_ip, mqtt_ip, 4);
-    strncpy(data->mqtt_auth, MQTT_AUTH, 50);
-    strncpy(data->mqtt_user, MQTT_USER, 50);
+    ap_cache_connected(&data->ap_cache, w->BSSID(), w->channel(), w->RSSI(), 0);
+    // mqtt server, its address is looked up by the resolver
+    if (strcmp_P(settings_str(data, SETTINGS_MQTT_HOST), PSTR(MQTT_SERVER))) resolver_clear(&data->mqtt_dns);
+    memset(data->strings, 0, sizeof(data->strings));
+    memcpy_P(data->strings, settings_strings, sizeof(settings_strings));
     data->mqtt_host_port = MQTT_SERVER_PORT;
 }
 
-/* save settings to flash
+static_assert(sizeof(WIFI_SETTINGS_T) <= SETTINGS_LOG_MAX, "settings too big for the log");
+
+#define SETTINGS_FLUSH_SAVES 16 // flash at least every n changed saves
+
+// what store_rtc keeps, survives ESP.restart() and deep sleep
+struct RTC_SETTINGS_T {
+	uint32_t cold_crc;     // settings_cold_crc() of what's in SETTINGS_STORE
+	uint32_t boots;        // warm boots since the last cold start
+	uint16_t flash_saves;  // since the last cold start
+	uint16_t unflushed;    // changed saves not in SETTINGS_STORE yet
+	WIFI_SETTINGS_T settings;
+};
+
+static_assert(STORE_HDR_SIZE + sizeof(RTC_SETTINGS_T) <= RTC_SETTINGS_BLOCKS * 4, "RTC settings don't fit");
+
+static RTC_SETTINGS_T rtc_settings;
+static bool rtc_valid = false;
+static const char *settings_from = "none";
+
+/* crc of the settings without what changes on every boot anyway, the
+ * schedule, statistics & counters; when only those changed, flash can
+ * wait. The crc runs over the other fields in place, in struct order
+ */
+static uint32_t settings_cold_crc(const WIFI_SETTINGS_T *data) {
+	uint32_t crc = crc32(data, offsetof(WIFI_SETTINGS_T, ap_cache));
+	for (uint8_t i = 0; i < AP_CACHE_SIZE; i++) {
+		const AP_ENTRY_T *e = &data->ap_cache.ap[i];
+		crc = crc32(e->bssid, sizeof(e->bssid), crc);
+		crc = crc32(&e->channel, sizeof(e->channel), crc);
+	}
+	crc = crc32(&data->mqtt_dns.ip, sizeof(data->mqtt_dns.ip), crc);
+	crc = crc32(&data->mqtt_dns.ttl_s, sizeof(data->mqtt_dns.ttl_s), crc);
+	return crc32(data->strings, sizeof(data->strings), crc);
+}
+
+/* save settings to RTC memory, and to SETTINGS_STORE when the connection
+ * settings changed or every SETTINGS_FLUSH_SAVES changes
  */
 void save_settings_to_flash(WIFI_SETTINGS_T *data) {
-	char buf[sizeof(WIFI_SETTINGS_T)];
-	memcpy(&buf, data, sizeof(WIFI_SETTINGS_T));
-	EEPROM.begin(sizeof(WIFI_SETTINGS_T));
-	EEPROM.put(0, buf);
-	EEPROM.end();
+	if (rtc_valid && !memcmp(&rtc_settings.settings, data, sizeof(WIFI_SETTINGS_T))) return;
+	uint32_t cold = settings_cold_crc(data);
+	if (!rtc_valid || cold != rtc_settings.cold_crc
+			|| rtc_settings.unflushed + 1 >= SETTINGS_FLUSH_SAVES) {
+		SETTINGS_STORE.save(data, sizeof(WIFI_SETTINGS_T));
+		rtc_settings.cold_crc = cold;
+		rtc_settings.unflushed = 0;
+		rtc_settings.flash_saves++;
+	} else {
+		rtc_settings.unflushed++;
+	}
+	memcpy(&rtc_settings.settings, data, sizeof(WIFI_SETTINGS_T));
+	rtc_valid = store_rtc.save(&rtc_settings, sizeof(RTC_SETTINGS_T));
 }
 
-/* Read settings from flash, check if magic number is ok
+/* Read settings from RTC memory after a warm boot, else from
+ * SETTINGS_STORE; check if magic number is ok
  */
-int get_settings_from_flash(WIFI_SETTINGS_T *data) { // dunno why not parameters
-	char buf[sizeof(WIFI_SETTINGS_T)];
-	EEPROM.begin(sizeof(WIFI_SETTINGS_T));
-	EEPROM.get(0, buf);
-	EEPROM.end();
-	memcpy((char *)data, buf, sizeof(WIFI_SETTINGS_T));
+int get_settings_from_flash(WIFI_SETTINGS_T *data) {
+	rtc_valid = store_rtc.load(&rtc_settings, sizeof(RTC_SETTINGS_T));
+	if (rtc_valid) {
+		settings_from = "rtc";
+		settings_log_forget();
+		rtc_settings.boots++;
+		memcpy(data, &rtc_settings.settings, sizeof(WIFI_SETTINGS_T));
+		return (data->magic == MAGIC_NUM);
+	}
+	// cold start, RTC memory gets filled with the next save
+	memset(&rtc_settings, 0, sizeof(RTC_SETTINGS_T));
+	if (!SETTINGS_STORE.load(data, sizeof(WIFI_SETTINGS_T))) {
+		settings_from = "none";
+		memset(data, 0, sizeof(WIFI_SETTINGS_T));
+		return false;
+	}
+	settings_from = SETTINGS_STORE.name;
+	rtc_settings.cold_crc = settings_cold_crc(data);
+	memcpy(&rtc_settings.settings, data, sizeof(WIFI_SETTINGS_T));
 	return (data->magic == MAGIC_NUM);
 }
 
+/* Show where the settings came from and went to
+ */
+void display_settings_storage() {
+	DEBUG_TAGS("settings_from", settings_from);
+	DEBUG_TAG("rtc_boots", rtc_settings.boots);
+	DEBUG_TAG("rtc_unflushed", rtc_settings.unflushed);
+	settings_log_display();
+}
+
 /* Display the current settings on Serial
  */
 void display_settings(WIFI_SETTINGS_T *data) {
 	#ifdef DEBUG_MODE
-	char buf[100];
-	Serial.println("Settings:");
-	Serial.print("Magic:       "); 
-	sprintf(buf, "%04X", data->magic); Serial.println(buf);
-	Serial.print("Local IP:    "); 
-	sprintf(buf, "%08X", data->ip_address); Serial.println(buf);
-	Serial.print("Gateway IP:  "); 
-	sprintf(buf, "%08X", data->ip_gateway); Serial.println(buf);
-	Serial.print("Mask:        "); 
-	sprintf(buf, "%08X", data->ip_mask); Serial.println(buf);
-	Serial.print("DNS 1 IP:    "); 
-	sprintf(buf, "%08X", data->ip_dns1); Serial.println(buf);
-	Serial.print("DNS 2 IP:    "); 
-	sprintf(buf, "%08X", data->ip_dns2); Serial.println(buf);
-	Serial.print("Wifi SSID:   "); Serial.println(data->wifi_ssid);
-	Serial.print("Wifi Auth:   "); Serial.println(data->wifi_auth);
-	Serial.print("Wifi BSSID:  "); 
-	sprintf(buf, "%02X:%02X:%02X:%02X:%02X:%02X", 
-		data->wifi_bssid[0], data->wifi_bssid[1], data->wifi_bssid[2], 
-		data->wifi_bssid[3], data->wifi_bssid[4], data->wifi_bssid[5]); Serial.println(buf);
-	Serial.print("Wifi Channel:"); sprintf(buf, "%d", data->wifi_channel); Serial.println(buf);
-	Serial.print("MQTT Host:   "); Serial.println(data->mqtt_host_str);
-	Serial.print("MQTT IP:     "); sprintf(buf, "%08X", data->mqtt_host_ip); Serial.println(buf);
-	Serial.print("MQTT Port:   "); sprintf(buf, "%d", data->mqtt_host_port); Serial.println(buf);
-	Serial.print("MQTT User:   "); Serial.println(data->mqtt_user);
-	Serial.print("MQTT Pass:   "); Serial.println(data->mqtt_auth);
+	Serial.println(F("Settings:"));
+	Serial.printf_P(PSTR("Magic:       %04X\n"), (unsigned)data->magic);
+	Serial.printf_P(PSTR("Local IP:    %08X\n"), (unsigned)data->ip_address);
+	Serial.printf_P(PSTR("Gateway IP:  %08X\n"), (unsigned)data->ip_gateway);
+	Serial.printf_P(PSTR("Mask:        %08X\n"), (unsigned)data->ip_mask);
+	Serial.printf_P(PSTR("DNS 1 IP:    %08X\n"), (unsigned)data->ip_dns1);
+	Serial.printf_P(PSTR("DNS 2 IP:    %08X\n"), (unsigned)data->ip_dns2);
+	Serial.print(F("Wifi SSID:   ")); Serial.println(settings_str(data, SETTINGS_SSID));
+	Serial.print(F("Wifi Auth:   ")); Serial.println(settings_str(data, SETTINGS_AUTH));
+	ap_cache_display(&data->ap_cache);
+	Serial.print(F("MQTT Host:   ")); Serial.println(settings_str(data, SETTINGS_MQTT_HOST));
+	Serial.printf_P(PSTR("MQTT IP:     %08X\n"), (unsigned)data->mqtt_dns.ip);
+	Serial.printf_P(PSTR("MQTT DNS:    ttl %us, age %us\n"), (unsigned)data->mqtt_dns.ttl_s, (unsigned)(data->mqtt_dns.age_ms / 1000));
+	Serial.printf_P(PSTR("MQTT Port:   %u\n"), (unsigned)data->mqtt_host_port);
+	Serial.print(F("MQTT User:   ")); Serial.println(settings_str(data, SETTINGS_MQTT_USER));
+	Serial.print(F("MQTT Pass:   ")); Serial.println(settings_str(data, SETTINGS_MQTT_PASS));
 	#endif
-}
\ No newline at end of file
+}
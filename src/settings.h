@@ -22,30 +22,54 @@
 
 #include <Arduino.h>
 
+#include "apcache.h"
+#include "histogram.h"
+#include "phases.h"
+#include "resolver.h"
+#include "strategy.h"
+#include "secrets.h"
+
+// wifi & mqtt strings, back to back with their NULs instead of a 50 byte
+// array each; sized for the ones in secrets.h
+enum SETTINGS_STR {
+	SETTINGS_SSID,
+	SETTINGS_AUTH,
+	SETTINGS_MQTT_HOST,
+	SETTINGS_MQTT_USER,
+	SETTINGS_MQTT_PASS,
+};
+#define SETTINGS_STRINGS_SIZE ((sizeof(WIFI_SSID) + sizeof(WIFI_AUTH) + sizeof(MQTT_SERVER) \
+	+ sizeof(MQTT_USER) + sizeof(MQTT_AUTH) + 3) & ~3)
+
+// ordered by alignment, so there are no holes; in RAM & RTC memory
+// three times, and every byte is written to flash on a save
 struct WIFI_SETTINGS_T {
 	uint16_t magic;
+	uint16_t mqtt_host_port;
 	uint32_t ip_address;
 	uint32_t ip_gateway;
 	uint32_t ip_mask;
 	uint32_t ip_dns1;
 	uint32_t ip_dns2;
-	char wifi_ssid[50];
-	char wifi_auth[50];
-	uint8_t wifi_bssid[6];
-	uint16_t wifi_channel;
-	char mqtt_host_str[50];
-	uint32_t mqtt_host_ip;
-	uint16_t mqtt_host_port;
-	char mqtt_user[50];
-	char mqtt_auth[50];
+	AP_CACHE_T ap_cache; // APs serving the SSID, best first
+	DNS_CACHE_T mqtt_dns; // address of the mqtt host
+	char strings[SETTINGS_STRINGS_SIZE]; // see settings_str()
+	HISTO_T fast_histo; // ms of successful cached fast connects
+	uint16_t mqtt_packet_id; // last QoS1 packet id used
+	PHASES_T phases;    // ms of each boot phase, see phases.h
 	uint8_t force_slow;
+	uint8_t strategy_pos;
+	uint8_t strategy_count;
+	uint8_t strategy_schedule[STRATEGY_MAX];
 };
 
-const uint16_t MAGIC_NUM = 0x1AC4;
+const uint16_t MAGIC_NUM = 0x1AC8;
 
+const char *settings_str(const WIFI_SETTINGS_T *data, SETTINGS_STR which);
 void build_settings_from_wifi(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w);
 void save_settings_to_flash(WIFI_SETTINGS_T *data);
 int get_settings_from_flash(WIFI_SETTINGS_T *data);
 void display_settings(WIFI_SETTINGS_T *data);
+void display_settings_storage();
 
 #endif
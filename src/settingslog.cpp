@@ -0,0 +1,256 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Wear-leveled settings log in flash
+ *
+ * EEPROM.commit() erases and rewrites its sector on every save, ~35ms
+ * each time on the critical path. Here saves are appended to the current
+ * sector: only the bytes that changed since the last record, or nothing
+ * at all if nothing did. A sector is only erased when the log moves on
+ * to it, and it then starts with a full record. Loading takes the sector
+ * with the newest first record and replays the rest up to the first
+ * record that doesn't check out, e.g. one torn by a reset.
+ */
+
+#include <Arduino.h>
+#include <coredecls.h>
+
+#include "main.h"
+#include "flashmap.h"
+#include "settingslog.h"
+
+#define LOG_SECTOR_SIZE FS_PHYS_BLOCK
+#define LOG_MERGE_GAP 4 // unchanged bytes a delta chunk may span, ~ a chunk header
+
+#if SETTINGS_LOG_FILL > FS_PHYS_BLOCK
+#error "SETTINGS_LOG_FILL is bigger than a sector"
+#endif
+
+#if FLASH_LOG_SECTOR + SETTINGS_LOG_SECTORS > FLASH_STORE_SECTOR
+#error "settings log overlaps store_flash, see flashmap.h"
+#endif
+
+static uint8_t log_image[SETTINGS_LOG_MAX]; // what the log holds now
+static bool log_valid = false;   // log_image holds the newest record
+static bool log_scanned = false; // log_sector & log_pos are known
+static uint8_t log_sector = SETTINGS_LOG_SECTORS - 1;
+static uint16_t log_pos = LOG_SECTOR_SIZE; // full: next save moves on
+static uint32_t log_seq = 0;
+static uint16_t log_erases = 0, log_bytes = 0;
+
+// one record, word-aligned for the flash API
+static uint32_t log_buf[(sizeof(SETTINGS_LOG_HDR_T) + SETTINGS_LOG_MAX + 3) / 4];
+
+static uint32_t log_addr(uint8_t sector, uint16_t pos) {
+	return FLASH_SECTOR_ADDR(FLASH_LOG_SECTOR + sector) + pos;
+}
+
+static uint16_t log_padded(uint16_t len) {
+	return (sizeof(SETTINGS_LOG_HDR_T) + len + 3) & ~3;
+}
+
+static uint32_t log_crc(SETTINGS_LOG_HDR_T *hdr, const uint8_t *payload) {
+	SETTINGS_LOG_HDR_T h = *hdr;
+	h.crc = 0;
+	return crc32(payload, hdr->len, crc32(&h, sizeof(h)));
+}
+
+/* Read the header at this position into log_buf, NULL if it isn't one
+ */
+static SETTINGS_LOG_HDR_T *log_read_hdr(uint8_t sector, uint16_t pos, uint16_t size) {
+	SETTINGS_LOG_HDR_T *hdr = (SETTINGS_LOG_HDR_T *)log_buf;
+	if (pos + sizeof(SETTINGS_LOG_HDR_T) > LOG_SECTOR_SIZE) return NULL;
+	ESP.flashRead(log_addr(sector, pos), log_buf, sizeof(SETTINGS_LOG_HDR_T));
+	if (hdr->magic != SETTINGS_LOG_MAGIC || hdr->version != SETTINGS_LOG_VERSION) return NULL;
+	if (hdr->size != size || hdr->len > SETTINGS_LOG_MAX) return NULL;
+	if (pos + log_padded(hdr->len) > LOG_SECTOR_SIZE) return NULL;
+	return hdr;
+}
+
+/* Read the record at this position into log_buf, return its header if it
+ * checks out
+ */
+static SETTINGS_LOG_HDR_T *log_read(uint8_t sector, uint16_t pos, uint16_t size) {
+	SETTINGS_LOG_HDR_T *hdr = log_read_hdr(sector, pos, size);
+	if (!hdr) return NULL;
+	uint8_t *payload = (uint8_t *)(hdr + 1);
+	uint16_t rest = log_padded(hdr->len) - sizeof(SETTINGS_LOG_HDR_T);
+	if (rest) ESP.flashRead(log_addr(sector, pos) + sizeof(SETTINGS_LOG_HDR_T), (uint32_t *)payload, rest);
+	if (log_crc(hdr, payload) != hdr->crc) return NULL;
+	return hdr;
+}
+
+/* Check a delta payload fits the image, then apply it if asked to
+ */
+static bool log_apply(const uint8_t *p, uint16_t len, uint16_t size, bool apply) {
+	uint16_t i = 0;
+	while (i + 4 <= len) {
+		uint16_t offset, n;
+		memcpy(&offset, p + i, 2);
+		memcpy(&n, p + i + 2, 2);
+		i += 4;
+		if (offset + n > size || i + n > len) return false;
+		if (apply) memcpy(log_image + offset, p + i, n);
+		i += n;
+	}
+	return i == len;
+}
+
+/* Find the newest sector and replay it into log_image
+ */
+static bool log_scan(uint16_t size) {
+	log_scanned = true;
+	log_valid = false;
+	log_sector = SETTINGS_LOG_SECTORS - 1;
+	log_pos = LOG_SECTOR_SIZE;
+	log_erases = log_bytes = 0;
+	if (size > SETTINGS_LOG_MAX) return false;
+	// the sector starting with the newest full record that checks out;
+	// only the headers first, the crc is the slow part
+	uint32_t seq[SETTINGS_LOG_SECTORS];
+	bool candidate[SETTINGS_LOG_SECTORS];
+	for (uint8_t s = 0; s < SETTINGS_LOG_SECTORS; s++) {
+		SETTINGS_LOG_HDR_T *hdr = log_read_hdr(s, 0, size);
+		candidate[s] = hdr && hdr->type == SETTINGS_LOG_FULL && hdr->len == size;
+		seq[s] = candidate[s] ? hdr->seq : 0;
+	}
+	SETTINGS_LOG_HDR_T *hdr = NULL;
+	while (!hdr) {
+		int8_t newest = -1;
+		for (uint8_t s = 0; s < SETTINGS_LOG_SECTORS; s++) {
+			if (candidate[s] && (newest < 0 || (int32_t)(seq[s] - seq[newest]) > 0)) newest = s;
+		}
+		if (newest < 0) return false;
+		candidate[newest] = false;
+		hdr = log_read(newest, 0, size);
+		log_sector = newest;
+	}
+	memcpy(log_image, hdr + 1, size);
+	log_seq = hdr->seq;
+	log_pos = log_padded(size);
+	while ((hdr = log_read(log_sector, log_pos, size)) != NULL) {
+		const uint8_t *payload = (const uint8_t *)(hdr + 1);
+		if (hdr->seq != log_seq + 1) break;
+		if (hdr->type == SETTINGS_LOG_FULL && hdr->len == size) {
+			memcpy(log_image, payload, size);
+		} else if (hdr->type == SETTINGS_LOG_DELTA && log_apply(payload, hdr->len, size, false)) {
+			log_apply(payload, hdr->len, size, true);
+		} else {
+			break;
+		}
+		log_seq = hdr->seq;
+		log_pos += log_padded(hdr->len);
+	}
+	// anything but erased flash after the last good record: don't append to it
+	uint32_t word = 0;
+	if (log_pos + 4 <= LOG_SECTOR_SIZE) ESP.flashRead(log_addr(log_sector, log_pos), &word, 4);
+	if (word != 0xFFFFFFFF) log_pos = LOG_SECTOR_SIZE;
+	log_valid = true;
+	return true;
+}
+
+/* Forget where the log is at, the next save looks it up
+ */
+void settings_log_forget() {
+	log_scanned = log_valid = false;
+	log_erases = log_bytes = 0;
+}
+
+bool settings_log_load(void *data, uint16_t size) {
+	if (!log_scan(size)) return false;
+	memcpy(data, log_image, size);
+	return true;
+}
+
+/* Build the delta from the image to data in log_buf, return its length
+ */
+static uint16_t log_delta(const uint8_t *data, uint16_t size) {
+	uint8_t *out = (uint8_t *)log_buf + sizeof(SETTINGS_LOG_HDR_T);
+	uint16_t len = 0, i = 0;
+	while (i < size) {
+		if (data[i] == log_image[i]) { i++; continue; }
+		uint16_t start = i, end = i + 1;
+		// extend over changed bytes and short unchanged gaps
+		for (uint16_t j = end; j < size && j < end + LOG_MERGE_GAP; j++) {
+			if (data[j] != log_image[j]) end = j + 1;
+		}
+		uint16_t n = end - start;
+		if (len + 4 + n > size) return size; // no better than a full record
+		memcpy(out + len, &start, 2);
+		memcpy(out + len + 2, &n, 2);
+		memcpy(out + len + 4, data + start, n);
+		len += 4 + n;
+		i = end;
+	}
+	return len;
+}
+
+/* Append the changes since the last save; a full record when starting
+ * a sector. Finds the end of the log first if it wasn't loaded.
+ */
+bool settings_log_save(const void *data, uint16_t size) {
+	if (size > SETTINGS_LOG_MAX) return false;
+	if (!log_scanned) log_scan(size);
+	const uint8_t *d = (const uint8_t *)data;
+	SETTINGS_LOG_HDR_T *hdr = (SETTINGS_LOG_HDR_T *)log_buf;
+	uint8_t *payload = (uint8_t *)(hdr + 1);
+	uint8_t type = SETTINGS_LOG_DELTA;
+	log_bytes = 0;
+	uint16_t len = log_valid ? log_delta(d, size) : size;
+	if (log_valid && len == 0) return true; // nothing changed
+	if (len >= size / 2) type = SETTINGS_LOG_FULL;
+	if (log_pos + log_padded(type == SETTINGS_LOG_FULL ? size : len) > SETTINGS_LOG_FILL) {
+		log_sector = (log_sector + 1) % SETTINGS_LOG_SECTORS;
+		log_pos = 0;
+		if (!ESP.flashEraseSector(log_addr(log_sector, 0) / LOG_SECTOR_SIZE)) return false;
+		log_erases++;
+		type = SETTINGS_LOG_FULL;
+	}
+	if (type == SETTINGS_LOG_FULL) {
+		len = size;
+		memcpy(payload, d, size);
+	}
+	hdr->magic = SETTINGS_LOG_MAGIC;
+	hdr->version = SETTINGS_LOG_VERSION;
+	hdr->type = type;
+	hdr->seq = log_seq + 1;
+	hdr->len = len;
+	hdr->size = size;
+	uint16_t padded = log_padded(len);
+	memset(payload + len, 0xFF, padded - sizeof(SETTINGS_LOG_HDR_T) - len);
+	hdr->crc = log_crc(hdr, payload);
+	if (!ESP.flashWrite(log_addr(log_sector, log_pos), log_buf, padded)) {
+		log_pos = LOG_SECTOR_SIZE; // start over in the next sector
+		return false;
+	}
+	log_seq++;
+	log_pos += padded;
+	log_bytes = padded;
+	memcpy(log_image, d, size);
+	log_valid = true;
+	return true;
+}
+
+/* Show where the log is at, after a save
+ */
+void settings_log_display() {
+	DEBUG_TAG("log_seq", log_seq);
+	DEBUG_TAG("log_bytes", log_bytes);
+	DEBUG_TAG("log_erases", log_erases);
+}
@@ -0,0 +1,52 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef SETTINGSLOG_H
+#define SETTINGSLOG_H
+
+#include <Arduino.h>
+
+// append-only settings log in a ring of flash sectors, see flashmap.h;
+// every sector starts with a full record, followed by the
+// changes to it, so only the newest sector is needed to load
+#define SETTINGS_LOG_SECTORS 4
+#define SETTINGS_LOG_MAX 512 // max size of the settings struct
+#define SETTINGS_LOG_FILL 2048 // bytes used per sector, bounds the replay on load
+#define SETTINGS_LOG_MAGIC 0x5E7C
+#define SETTINGS_LOG_VERSION 1
+
+#define SETTINGS_LOG_FULL 1  // payload is the whole struct
+#define SETTINGS_LOG_DELTA 2 // payload is {offset, length, bytes} chunks
+
+struct SETTINGS_LOG_HDR_T {
+	uint16_t magic;
+	uint8_t version;
+	uint8_t type;
+	uint32_t seq;  // +1 per record
+	uint16_t len;  // payload bytes, records are padded to 4
+	uint16_t size; // size of the struct it holds
+	uint32_t crc;  // crc32 of the header with crc 0, then the payload
+};
+
+bool settings_log_load(void *data, uint16_t size);
+void settings_log_forget();
+bool settings_log_save(const void *data, uint16_t size);
+void settings_log_display();
+
+#endif
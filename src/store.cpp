@@ -0,0 +1,203 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Interchangeable settings stores, and a benchmark to compare them
+ *
+ * None of them copy more than needed: EEPROM only through its own RAM
+ * buffer, the others straight into or out of the settings struct.
+ */
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <LittleFS.h>
+#include <coredecls.h>
+
+#include "main.h"
+#include "flashmap.h"
+#include "rtcmem.h"
+#include "settingslog.h"
+#include "store.h"
+
+#define STORE_MAGIC 0x57A3
+#define STORE_EEPROM_SIZE 512
+#define STORE_LITTLEFS_FILE "/settings"
+
+// in front of the record for the stores without their own checks
+struct STORE_HDR_T {
+	uint32_t crc; // crc32 of the record
+	uint16_t magic;
+	uint16_t size;
+};
+
+static_assert(sizeof(STORE_HDR_T) == STORE_HDR_SIZE, "see store.h");
+
+static bool store_check(const STORE_HDR_T *hdr, const void *data, uint16_t size) {
+	return hdr->magic == STORE_MAGIC && hdr->size == size && hdr->crc == crc32(data, size);
+}
+
+static void store_header(STORE_HDR_T *hdr, const void *data, uint16_t size) {
+	hdr->magic = STORE_MAGIC;
+	hdr->size = size;
+	hdr->crc = crc32(data, size);
+}
+
+/* EEPROM: the core reads the sector into a heap buffer on begin() and
+ * erases + writes it on end() when anything changed
+ */
+static bool eeprom_load(void *data, uint16_t size) {
+	if (sizeof(STORE_HDR_T) + size > STORE_EEPROM_SIZE) return false;
+	EEPROM.begin(STORE_EEPROM_SIZE);
+	const uint8_t *p = EEPROM.getConstDataPtr();
+	memcpy(data, p + sizeof(STORE_HDR_T), size);
+	bool ok = store_check((const STORE_HDR_T *)p, data, size);
+	EEPROM.end();
+	return ok;
+}
+
+static bool eeprom_save(const void *data, uint16_t size) {
+	if (sizeof(STORE_HDR_T) + size > STORE_EEPROM_SIZE) return false;
+	STORE_HDR_T hdr;
+	store_header(&hdr, data, size);
+	EEPROM.begin(STORE_EEPROM_SIZE);
+	EEPROM.put(0, hdr);
+	const uint8_t *p = EEPROM.getConstDataPtr() + sizeof(STORE_HDR_T);
+	if (memcmp(p, data, size)) memcpy(EEPROM.getDataPtr() + sizeof(STORE_HDR_T), data, size);
+	EEPROM.end();
+	return true;
+}
+
+/* One flash sector, read straight into the struct; the record size must
+ * be a multiple of 4, as with the SDK's spi_flash_read()
+ */
+static bool flash_load(void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	uint32_t addr = FLASH_SECTOR_ADDR(FLASH_STORE_SECTOR);
+	if (size & 3) return false;
+	if (!ESP.flashRead(addr, (uint32_t *)&hdr, sizeof(hdr))) return false;
+	if (hdr.magic != STORE_MAGIC || hdr.size != size) return false;
+	if (!ESP.flashRead(addr + sizeof(hdr), (uint32_t *)data, size)) return false;
+	return store_check(&hdr, data, size);
+}
+
+static bool flash_save(const void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	uint32_t addr = FLASH_SECTOR_ADDR(FLASH_STORE_SECTOR);
+	if (size & 3) return false;
+	store_header(&hdr, data, size);
+	if (!ESP.flashEraseSector(addr / FS_PHYS_BLOCK)) return false;
+	// record first, the header makes it valid
+	if (!ESP.flashWrite(addr + sizeof(hdr), (uint32_t *)data, size)) return false;
+	return ESP.flashWrite(addr, (uint32_t *)&hdr, sizeof(hdr));
+}
+
+/* RTC user memory, in the settings' blocks; survives ESP.restart() and
+ * deep sleep
+ */
+static bool rtc_load(void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	if (size & 3 || sizeof(hdr) + size > RTC_SETTINGS_BLOCKS * 4) return false;
+	ESP.rtcUserMemoryRead(RTC_SETTINGS_BLOCK, (uint32_t *)&hdr, sizeof(hdr));
+	if (hdr.magic != STORE_MAGIC || hdr.size != size) return false;
+	ESP.rtcUserMemoryRead(RTC_SETTINGS_BLOCK + sizeof(hdr) / 4, (uint32_t *)data, size);
+	return store_check(&hdr, data, size);
+}
+
+static bool rtc_save(const void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	if (size & 3 || sizeof(hdr) + size > RTC_SETTINGS_BLOCKS * 4) return false;
+	store_header(&hdr, data, size);
+	ESP.rtcUserMemoryWrite(RTC_SETTINGS_BLOCK + sizeof(hdr) / 4, (uint32_t *)data, size);
+	ESP.rtcUserMemoryWrite(RTC_SETTINGS_BLOCK, (uint32_t *)&hdr, sizeof(hdr));
+	return true;
+}
+
+/* LittleFS on the sectors flashmap.h gives it, mounted on first use;
+ * it does its own wear leveling & power-loss safety
+ */
+static FS store_fs = FS(FSImplPtr(new littlefs_impl::LittleFSImpl(
+	FLASH_SECTOR_ADDR(FLASH_LITTLEFS_SECTOR), FS_PHYS_SIZE - FLASH_LITTLEFS_SECTOR * FS_PHYS_BLOCK,
+	FS_PHYS_PAGE, FS_PHYS_BLOCK, 2)));
+
+static bool littlefs_load(void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	if (!store_fs.begin()) return false;
+	File f = store_fs.open(STORE_LITTLEFS_FILE, "r");
+	if (!f) return false;
+	bool ok = f.size() == sizeof(hdr) + size
+		&& f.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)
+		&& f.read((uint8_t *)data, size) == size;
+	f.close();
+	return ok && store_check(&hdr, data, size);
+}
+
+static bool littlefs_save(const void *data, uint16_t size) {
+	STORE_HDR_T hdr;
+	if (!store_fs.begin()) return false;
+	File f = store_fs.open(STORE_LITTLEFS_FILE, "w");
+	if (!f) return false;
+	store_header(&hdr, data, size);
+	bool ok = f.write((const uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr)
+		&& f.write((const uint8_t *)data, size) == size;
+	f.close();
+	return ok;
+}
+
+static bool log_load(void *data, uint16_t size) {
+	return settings_log_load(data, size);
+}
+
+static bool log_save(const void *data, uint16_t size) {
+	return settings_log_save(data, size);
+}
+
+const SETTINGS_STORE_T store_eeprom = { "eeprom", eeprom_load, eeprom_save, STORE_EEPROM_SIZE };
+const SETTINGS_STORE_T store_flash = { "flash", flash_load, flash_save, 0 };
+const SETTINGS_STORE_T store_rtc = { "rtc", rtc_load, rtc_save, 0 };
+const SETTINGS_STORE_T store_littlefs = { "littlefs", littlefs_load, littlefs_save, sizeof(FS) };
+const SETTINGS_STORE_T store_log = { "log", log_load, log_save, SETTINGS_LOG_MAX * 2 + 16 };
+
+/* Save & load the settings with every store, show the times, whether
+ * they came back the same, and the RAM used; RTC memory is put back
+ * afterwards, it holds the live settings
+ */
+void store_benchmark(const void *data, uint16_t size) {
+	static const SETTINGS_STORE_T *stores[] = {
+		&store_eeprom, &store_flash, &store_rtc, &store_littlefs, &store_log
+	};
+	static uint8_t buf[SETTINGS_LOG_MAX];
+	static uint32_t rtc_backup[RTC_SETTINGS_BLOCKS];
+	if (size > sizeof(buf)) return;
+	ESP.rtcUserMemoryRead(RTC_SETTINGS_BLOCK, rtc_backup, sizeof(rtc_backup));
+	for (uint8_t i = 0; i < sizeof(stores) / sizeof(stores[0]); i++) {
+		const SETTINGS_STORE_T *s = stores[i];
+		uint32_t heap = ESP.getFreeHeap();
+		uint32_t t0 = micros();
+		bool ok = s->save(data, size);
+		uint32_t t1 = micros();
+		ok = ok && s->load(buf, size) && !memcmp(buf, data, size);
+		uint32_t t2 = micros();
+		int32_t kept = (int32_t)heap - (int32_t)ESP.getFreeHeap();
+		char key[24];
+		snprintf(key, sizeof(key), "store_save_%s", s->name); DEBUG_TAG_P(key, t1 - t0);
+		snprintf(key, sizeof(key), "store_load_%s", s->name); DEBUG_TAG_P(key, t2 - t1);
+		snprintf(key, sizeof(key), "store_ok_%s", s->name); DEBUG_TAGS_P(key, ok ? "true" : "false");
+		snprintf(key, sizeof(key), "store_ram_%s", s->name); DEBUG_TAG_P(key, s->ram + max(kept, (int32_t)0));
+	}
+	ESP.rtcUserMemoryWrite(RTC_SETTINGS_BLOCK, rtc_backup, sizeof(rtc_backup));
+}
@@ -0,0 +1,50 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <Arduino.h>
+
+// somewhere to keep a settings record; every store checks its own
+// integrity, load() is false for a missing or damaged record
+struct SETTINGS_STORE_T {
+	const char *name;
+	bool (*load)(void *data, uint16_t size);
+	bool (*save)(const void *data, uint16_t size);
+	uint16_t ram; // bytes it keeps besides the heap, or borrows while busy
+};
+
+#define STORE_HDR_SIZE 8 // what eeprom, flash, rtc & littlefs add to a record
+
+extern const SETTINGS_STORE_T store_eeprom;   // Arduino EEPROM, erase + write per change
+extern const SETTINGS_STORE_T store_flash;    // one sector, read straight into the struct
+extern const SETTINGS_STORE_T store_rtc;      // RTC user memory, lost on power-off
+extern const SETTINGS_STORE_T store_littlefs; // a file on a small LittleFS
+extern const SETTINGS_STORE_T store_log;      // the settings log, settingslog.h
+
+// where the settings live when RTC memory is lost, e.g.
+// build_flags = -DSETTINGS_STORE=store_eeprom
+#ifndef SETTINGS_STORE
+#define SETTINGS_STORE store_log
+#endif
+
+void store_benchmark(const void *data, uint16_t size);
+
+#endif
@@ -0,0 +1,217 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Connection strategies, one per variant in variations.txt, all in one
+ * firmware. Each boot takes the next one from a shuffled schedule that
+ * is kept with the settings, so variants are interleaved and see the
+ * same RF conditions.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#include "main.h"
+#include "settings.h"
+#include "strategy.h"
+
+#define STRAT_CACHED (STRAT_FASTCONNECT | STRAT_PERSISTENT | STRAT_CHANNEL | STRAT_BSSID)
+
+static const STRATEGY_T strategies[] = {
+	{ "g",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "i",    STRAT_CACHED | STRAT_RECONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "j",    STRAT_CACHED | STRAT_STATION_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "k",    STRAT_FASTCONNECT | STRAT_PERSISTENT | STRAT_STATION_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "l",    STRAT_FASTCONNECT | STRAT_PERSISTENT | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "m",    STRAT_FASTCONNECT | STRAT_PERSISTENT | STRAT_BSSID | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "o",    STRAT_FASTCONNECT | STRAT_CHANNEL | STRAT_BSSID | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 1, WAKE_RF_DEFAULT },
+	{ "p",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 5, WAKE_RF_DEFAULT },
+	{ "q",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP, 5, WAKE_RF_DEFAULT },
+	{ "r",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_MQTT_HOSTNAME, 5, WAKE_RF_DEFAULT },
+	{ "slow", STRAT_PRECONNECT, 5, WAKE_RF_DEFAULT },
+	{ "reconnect", STRAT_USERECONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 5, WAKE_RF_DEFAULT },
+	{ "s",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT | STRAT_ADAPTIVE_TIMEOUT, 5, WAKE_RF_DEFAULT },
+	{ "t",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT | STRAT_MQTT_PIPELINE, 5, WAKE_RF_DEFAULT },
+	{ "u",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT | STRAT_MQTT_PIPELINE | STRAT_MQTT_QOS1, 5, WAKE_RF_DEFAULT },
+	{ "v",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT, 5, WAKE_NO_RFCAL },
+	{ "w",    STRAT_CACHED | STRAT_BEGIN_CONNECT | STRAT_STATICIP | STRAT_PRECONNECT | STRAT_RECOVER_SCAN, 5, WAKE_RF_DEFAULT },
+};
+#define STRATEGY_COUNT (sizeof(strategies) / sizeof(strategies[0]))
+
+static const struct {
+	uint32_t flag;
+	const char *name;
+} flag_names[] = {
+	{ STRAT_FASTCONNECT, "fastconnect" }, { STRAT_PERSISTENT, "persistent" },
+	{ STRAT_CHANNEL, "channel" }, { STRAT_BSSID, "bssid" },
+	{ STRAT_BEGIN_CONNECT, "beginconnect" }, { STRAT_RECONNECT, "reconnect" },
+	{ STRAT_STATION_CONNECT, "stationconnect" }, { STRAT_STATICIP, "staticip" },
+	{ STRAT_PRECONNECT, "preconnect" }, { STRAT_MQTT_HOSTNAME, "mqtthostname" },
+	{ STRAT_AUTORECONNECT, "autoreconnect" }, { STRAT_ENABLESTA, "enablesta" },
+	{ STRAT_USERECONNECT, "usereconnect" }, { STRAT_ADAPTIVE_TIMEOUT, "adaptivetimeout" },
+	{ STRAT_MQTT_PIPELINE, "mqttpipeline" }, { STRAT_MQTT_QOS1, "mqttqos1" },
+	{ STRAT_RECOVER_SCAN, "recoverscan" },
+};
+
+// strategies from STRATEGY_DEFINE, numbered after the built-in ones
+static STRATEGY_T defined[STRATEGY_MAX];
+static char defined_names[STRATEGY_MAX][STRATEGY_NAME_MAX + 1];
+static uint8_t defined_count = 0;
+static bool defined_parsed = false;
+
+/* Add one flag of a STRATEGY_DEFINE entry, by its name in the tag
+ */
+static bool define_flag(const char *name, size_t len, STRATEGY_T *strat) {
+	for (uint8_t i = 0; i < sizeof(flag_names) / sizeof(flag_names[0]); i++) {
+		if (strlen(flag_names[i].name) == len && !strncmp(name, flag_names[i].name, len)) {
+			strat->flags |= flag_names[i].flag;
+			return true;
+		}
+	}
+	if (len == 5 && !strncmp(name, "rfcal", len)) { strat->wake_rf = WAKE_RFCAL; return true; }
+	if (len == 7 && !strncmp(name, "norfcal", len)) { strat->wake_rf = WAKE_NO_RFCAL; return true; }
+	return false;
+}
+
+/* Parse STRATEGY_DEFINE once; entries that don't parse are left out
+ * and shown on the serial port
+ */
+static void define_parse() {
+	if (defined_parsed) return;
+	defined_parsed = true;
+	const char *p = STRATEGY_DEFINE;
+	while (*p && defined_count < STRATEGY_MAX) {
+		const char *end = strchr(p, ',');
+		if (!end) end = p + strlen(p);
+		const char *eq = (const char *)memchr(p, '=', end - p);
+		STRATEGY_T *strat = &defined[defined_count];
+		strat->name = defined_names[defined_count];
+		strat->flags = 0;
+		strat->publish_count = 1;
+		strat->wake_rf = WAKE_RF_DEFAULT;
+		bool ok = eq && eq > p && eq - p <= STRATEGY_NAME_MAX;
+		const char *q = ok ? eq + 1 : end;
+		while (ok && q < end) {
+			size_t len = strcspn(q, "+/,");
+			ok = define_flag(q, len, strat);
+			q += len;
+			if (ok && *q == '/') {
+				char *num_end;
+				strat->publish_count = strtoul(q + 1, &num_end, 10);
+				q = num_end;
+				ok = (q == end) && strat->publish_count > 0;
+			}
+			if (q < end) q++;
+		}
+		if (ok) {
+			memcpy(defined_names[defined_count], p, eq - p);
+			defined_names[defined_count][eq - p] = 0;
+			defined_count++;
+		} else {
+			char msg[80];
+			snprintf(msg, sizeof(msg), "STRATEGY_DEFINE: skipped %.*s", (int)(end - p), p);
+			DEBUG_OUT(msg);
+		}
+		p = *end ? end + 1 : end;
+	}
+}
+
+static const STRATEGY_T *strategy_at(uint8_t i) {
+	return i < STRATEGY_COUNT ? &strategies[i] : &defined[i - STRATEGY_COUNT];
+}
+
+/* Fill list with the indexes of the strategies in STRATEGY_SCHEDULE
+ */
+static uint8_t strategy_enabled(uint8_t *list) {
+	const char *names = STRATEGY_SCHEDULE;
+	uint8_t count = 0;
+	define_parse();
+	uint8_t first = (names[0] == 0 && defined_count) ? STRATEGY_COUNT : 0;
+	for (uint8_t i = first; i < STRATEGY_COUNT + defined_count && count < STRATEGY_MAX; i++) {
+		bool found = (names[0] == 0);
+		size_t len = strlen(strategy_at(i)->name);
+		const char *p = names;
+		while (p && *p && !found) {
+			if (!strncmp(p, strategy_at(i)->name, len) && (p[len] == ',' || p[len] == 0)) found = true;
+			p = strchr(p, ',');
+			if (p) p++;
+		}
+		if (found) list[count++] = i;
+	}
+	return count;
+}
+
+/* Is the schedule in the settings usable with this firmware?
+ */
+static bool schedule_ok(WIFI_SETTINGS_T *data, const uint8_t *enabled, uint8_t count) {
+	if (data->strategy_count != count || data->strategy_pos > count) return false;
+	for (uint8_t i = 0; i < count; i++) {
+		bool found = false;
+		for (uint8_t j = 0; j < count; j++) found |= (data->strategy_schedule[i] == enabled[j]);
+		if (!found) return false;
+	}
+	return true;
+}
+
+/* Reshuffle the schedule when used up or not usable; false if no
+ * strategy is enabled
+ */
+static bool schedule_fill(WIFI_SETTINGS_T *data) {
+	uint8_t enabled[STRATEGY_MAX];
+	uint8_t count = strategy_enabled(enabled);
+	if (!count) return false;
+	if (!schedule_ok(data, enabled, count) || data->strategy_pos >= count) {
+		for (uint8_t i = count - 1; i > 0; i--) {
+			uint8_t j = random(i + 1);
+			uint8_t tmp = enabled[i]; enabled[i] = enabled[j]; enabled[j] = tmp;
+		}
+		memcpy(data->strategy_schedule, enabled, count);
+		data->strategy_count = count;
+		data->strategy_pos = 0;
+	}
+	return true;
+}
+
+/* Get the strategy for this boot, reshuffle the schedule when used up
+ */
+const STRATEGY_T *strategy_next(WIFI_SETTINGS_T *data) {
+	if (!schedule_fill(data)) return &strategies[0];
+	return strategy_at(data->strategy_schedule[data->strategy_pos++]);
+}
+
+/* The strategy the next boot gets, e.g. to pick how it wakes up
+ */
+const STRATEGY_T *strategy_peek(WIFI_SETTINGS_T *data) {
+	if (!schedule_fill(data)) return &strategies[0];
+	return strategy_at(data->strategy_schedule[data->strategy_pos]);
+}
+
+/* Show the <strategy=...> tag for this strategy
+ */
+void strategy_display(const STRATEGY_T *strat) {
+	char tag[TELEMETRY_TEXT_MAX + 1];
+	int n = snprintf(tag, sizeof(tag), "%s%s,", STRATEGY_BUILD_TAG, strat->name);
+	if (!(strat->flags & STRAT_FASTCONNECT) && (n < (int)sizeof(tag))) n += snprintf(&tag[n], sizeof(tag) - n, "no-settings,");
+	for (uint8_t i = 0; i < sizeof(flag_names) / sizeof(flag_names[0]); i++) {
+		if ((strat->flags & flag_names[i].flag) && (n < (int)sizeof(tag))) n += snprintf(&tag[n], sizeof(tag) - n, "%s,", flag_names[i].name);
+	}
+	if (strat->wake_rf == WAKE_RFCAL && (n < (int)sizeof(tag))) n += snprintf(&tag[n], sizeof(tag) - n, "rfcal,");
+	if (strat->wake_rf == WAKE_NO_RFCAL && (n < (int)sizeof(tag))) n += snprintf(&tag[n], sizeof(tag) - n, "norfcal,");
+	if (n < (int)sizeof(tag)) snprintf(&tag[n], sizeof(tag) - n, "publish%u,", strat->publish_count);
+	DEBUG_TAGS("strategy", tag);
+}
@@ -0,0 +1,82 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include <Arduino.h>
+
+// what a connection strategy does; see variations.txt for the variants
+#define STRAT_FASTCONNECT     0x0001 // use cached settings, else just SSID & auth
+#define STRAT_PERSISTENT      0x0002 // WiFi.persistent(true)
+#define STRAT_CHANNEL         0x0004 // give the cached channel to begin()
+#define STRAT_BSSID           0x0008 // give the cached BSSID to begin()
+#define STRAT_BEGIN_CONNECT   0x0010 // connect in begin()
+#define STRAT_RECONNECT       0x0020 // connect with reconnect() after begin()
+#define STRAT_STATION_CONNECT 0x0040 // connect with wifi_station_connect() after begin()
+#define STRAT_STATICIP        0x0080 // use cached IP config instead of DHCP
+#define STRAT_PRECONNECT      0x0100 // open TCP to the cached MQTT IP before MQTT
+#define STRAT_MQTT_HOSTNAME   0x0200 // let MQTT resolve the hostname
+#define STRAT_AUTORECONNECT   0x0400 // setAutoReconnect(true) + persistent(true)
+#define STRAT_ENABLESTA       0x0800 // enableSTA(true) first
+#define STRAT_USERECONNECT    0x1000 // without fastconnect: try reconnect() first
+#define STRAT_ADAPTIVE_TIMEOUT 0x2000 // fast connect deadline from fast_histo, implied by STRAT_CACHED_BEGIN
+#define STRAT_MQTT_PIPELINE   0x4000 // CONNECT & PUBLISHes in one write, see mqttlite.h
+#define STRAT_MQTT_QOS1       0x8000 // pipelined QoS1 publishes in a persistent session
+#define STRAT_RECOVER_SCAN   0x10000 // cached APs not found: scan for them channel by channel
+
+// the fastest way to connect; these feed the fast connect histogram
+#define STRAT_CACHED_BEGIN (STRAT_FASTCONNECT | STRAT_PERSISTENT | STRAT_CHANNEL \
+	| STRAT_BSSID | STRAT_BEGIN_CONNECT)
+
+struct STRATEGY_T {
+	const char *name;
+	uint32_t flags;
+	uint8_t publish_count;
+	uint8_t wake_rf; // RFMode to wake up with, only with DUTY_CYCLE_S
+};
+
+#define STRATEGY_MAX 20 // max number of strategies in a schedule
+#define STRATEGY_NAME_MAX 8 // longest name in STRATEGY_DEFINE
+
+// prefix for the <strategy=...> tag: channel, board, debug, SDK
+#ifndef STRATEGY_BUILD_TAG
+#define STRATEGY_BUILD_TAG "ch:?t,esp01,nodebug,sdk-default,"
+#endif
+
+// comma-separated strategy names to interleave; empty = all of them,
+// or only the STRATEGY_DEFINE ones if there are any
+#ifndef STRATEGY_SCHEDULE
+#define STRATEGY_SCHEDULE ""
+#endif
+
+// more strategies without editing strategy.cpp, e.g. from scripts/sweep.py:
+// comma-separated "name=flag+flag/publish_count", flags named as in the
+// <strategy=...> tag, plus "rfcal" or "norfcal" for the wake-up
+#ifndef STRATEGY_DEFINE
+#define STRATEGY_DEFINE ""
+#endif
+
+struct WIFI_SETTINGS_T;
+
+const STRATEGY_T *strategy_next(WIFI_SETTINGS_T *data);
+const STRATEGY_T *strategy_peek(WIFI_SETTINGS_T *data);
+void strategy_display(const STRATEGY_T *strat);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Cooperative tasks for setup()
+ *
+ * The network phases mostly wait for the SDK. Tasks with a step function,
+ * like sampling a sensor for the payload, run in those gaps: the waits in
+ * wifievents.cpp call tasks_poll(), which steps every task whose needs
+ * are done. The network phases themselves are inline tasks, the caller
+ * marks them with task_start() & task_stop(), so a later phase can wait
+ * for what it needs, e.g. the publish for the TCP connection & payload.
+ *
+ * tasks_display() shows how much of the step tasks' time was hidden in
+ * the waits, how long the inline ones still had to wait for them, and
+ * the critical path: from the task done last, back over the need that
+ * was done last each time.
+ */
+
+#include <Arduino.h>
+
+#include "main.h"
+#include "tasks.h"
+#include "trace.h"
+
+#define TASKS_PATH_MAX 64 // chars of the <critical_path> tag
+
+static TASK_T tasks[TASKS_MAX];
+static uint8_t tasks_count = 0;
+static uint8_t tasks_done = 0;		// TASK_BIT()s
+static bool tasks_polling = false;	// a step that waits must not step again
+static uint32_t tasks_base_us = 0;
+static uint32_t tasks_waited_us = 0;	// inline tasks waiting for step tasks
+
+/* Forget all tasks, call at the start of setup()
+ */
+void tasks_begin() {
+	tasks_count = 0;
+	tasks_done = 0;
+	tasks_waited_us = 0;
+	tasks_base_us = micros();
+}
+
+/* Returns the id for TASK_BIT(); when full, TASKS_MAX, and the task is
+ * never run
+ */
+uint8_t task_add(PGM_P name, TASK_FN fn, void *arg, uint8_t needs) {
+	if (tasks_count >= TASKS_MAX) return TASKS_MAX;
+	TASK_T *t = &tasks[tasks_count];
+	t->name = name;
+	t->fn = fn;
+	t->arg = arg;
+	t->line = 0;
+	t->needs = needs;
+	t->gate = TASKS_MAX;
+	t->span = TRACE_NONE;
+	t->started = t->done = false;
+	t->start_us = t->done_us = 0;
+	return tasks_count++;
+}
+
+/* Of the tasks in mask, the one that was done last
+ */
+static uint8_t tasks_last_done(uint8_t mask) {
+	uint8_t last = TASKS_MAX;
+	for (uint8_t i = 0; i < tasks_count; i++) {
+		if (!(mask & TASK_BIT(i)) || !tasks[i].done) continue;
+		if ((last == TASKS_MAX) || (tasks[i].done_us - tasks_base_us > tasks[last].done_us - tasks_base_us)) last = i;
+	}
+	return last;
+}
+
+static void task_mark_started(TASK_T *t) {
+	t->started = true;
+	t->start_us = micros();
+	t->gate = tasks_last_done(t->needs);
+	// step tasks don't nest with the spans of the phases they overlap
+	if (t->fn) t->span = trace_start_detached();
+}
+
+static void task_mark_done(uint8_t id) {
+	TASK_T *t = &tasks[id];
+	t->done = true;
+	t->done_us = micros();
+	tasks_done |= TASK_BIT(id);
+	if (t->fn) trace_stop_detached(t->span, t->name);
+}
+
+/* Any step tasks left, then the waits re-check more often
+ */
+bool tasks_pending() {
+	for (uint8_t i = 0; i < tasks_count; i++) {
+		if (tasks[i].fn && !tasks[i].done) return true;
+	}
+	return false;
+}
+
+/* One step of every step task that is ready; called from the waits
+ */
+void tasks_poll() {
+	if (tasks_polling) return;
+	tasks_polling = true;
+	for (uint8_t i = 0; i < tasks_count; i++) {
+		TASK_T *t = &tasks[i];
+		if (!t->fn || t->done || (t->needs & ~tasks_done)) continue;
+		if (!t->started) task_mark_started(t);
+		if (t->fn(t)) task_mark_done(i);
+	}
+	tasks_polling = false;
+}
+
+/* Step the tasks until all in mask are done; false on timeout, or when
+ * one of them is an inline task that isn't done, nothing here can do it
+ */
+bool tasks_wait(uint8_t mask, uint32_t timeout_ms) {
+	uint32_t start = millis();
+	while ((tasks_done & mask) != mask) {
+		for (uint8_t i = 0; i < tasks_count; i++) {
+			if ((mask & TASK_BIT(i)) && !tasks[i].fn && !tasks[i].done) return false;
+		}
+		tasks_poll();
+		if ((tasks_done & mask) == mask) break;
+		if (millis() - start >= timeout_ms) return false;
+		delay(TASKS_POLL_MS);
+	}
+	return true;
+}
+
+/* Start an inline task once its needs are done, false if they can't be
+ */
+bool task_start(uint8_t id, uint32_t timeout_ms) {
+	if (id >= tasks_count) return true;
+	TASK_T *t = &tasks[id];
+	uint32_t start = micros();
+	bool ok = tasks_wait(t->needs, timeout_ms);
+	tasks_waited_us += micros() - start;
+	if (ok) task_mark_started(t);
+	return ok;
+}
+
+void task_stop(uint8_t id) {
+	if ((id >= tasks_count) || tasks[id].done) return;
+	task_mark_done(id);
+}
+
+/* <tasks_overlap=us> of the step tasks hidden in the waits,
+ * <tasks_wait=us> the inline tasks still waited for them, and
+ * <critical_path=a-b-c>; after the timed part
+ */
+void tasks_display() {
+	uint32_t step_us = 0;
+	for (uint8_t i = 0; i < tasks_count; i++) {
+		if (tasks[i].fn && tasks[i].done) step_us += tasks[i].done_us - tasks[i].start_us;
+	}
+	DEBUG_TAG("tasks_overlap", step_us > tasks_waited_us ? step_us - tasks_waited_us : 0);
+	DEBUG_TAG("tasks_wait", tasks_waited_us);
+
+	// walk back from the task done last, then print front to back
+	uint8_t path[TASKS_MAX];
+	uint8_t len = 0;
+	for (uint8_t id = tasks_last_done(0xFF); (id != TASKS_MAX) && (len < TASKS_MAX); id = tasks[id].gate) {
+		path[len++] = id;
+	}
+	if (!len) return;
+	char text[TASKS_PATH_MAX] = "";
+	while (len--) {
+		if (text[0]) strncat(text, "-", sizeof(text) - strlen(text) - 1);
+		strncat_P(text, tasks[path[len]].name, sizeof(text) - strlen(text) - 1);
+	}
+	DEBUG_TAGS("critical_path", text);
+}
@@ -0,0 +1,72 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <Arduino.h>
+
+// small cooperative scheduler for setup(): tasks with declared needs run
+// in the gaps of the network waits, see tasks.cpp
+#define TASKS_MAX 8
+#define TASKS_POLL_MS 1 // re-check interval of the waits while tasks are pending
+#define TASK_BIT(id) ((uint8_t)(1 << (id)))
+
+struct TASK_T;
+// one step of a task, true once it is done
+typedef bool (*TASK_FN)(TASK_T *t);
+
+struct TASK_T {
+	PGM_P name;			// also the name of its trace span, PSTR()
+	TASK_FN fn;			// NULL: run inline by the caller, see task_start()
+	void *arg;
+	uint16_t line;		// where TASK_BEGIN() continues, 0 = at the start
+	uint8_t needs;		// TASK_BIT()s of the tasks that have to be done first
+	uint8_t gate;		// the need that was done last, for the critical path
+	uint8_t span;		// trace id
+	bool started, done;
+	uint32_t start_us, done_us;
+};
+
+// stackless steps in the style of protothreads: a step function is
+// re-entered where it last waited, by a switch on the line number, so
+// its locals don't survive a wait and it can't use switch itself; keep
+// state in t->arg
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#define TASK_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define TASK_FALLTHROUGH
+#endif
+#define TASK_BEGIN(t) switch ((t)->line) { case 0:
+#define TASK_WAIT_UNTIL(t, cond) do { \
+	(t)->line = __LINE__; TASK_FALLTHROUGH; case __LINE__: if (!(cond)) return false; \
+	} while (0)
+#define TASK_YIELD(t) do { (t)->line = __LINE__; return false; case __LINE__:; } while (0)
+#define TASK_END(t) } (t)->line = 0; return true
+
+void tasks_begin();
+uint8_t task_add(PGM_P name, TASK_FN fn, void *arg, uint8_t needs);
+bool tasks_pending();
+void tasks_poll();
+bool tasks_wait(uint8_t mask, uint32_t timeout_ms);
+bool task_start(uint8_t id, uint32_t timeout_ms);
+void task_stop(uint8_t id);
+void tasks_display();
+
+#endif
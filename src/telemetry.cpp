@@ -0,0 +1,212 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Telemetry tags, as <key=value> text or as compact binary frames
+ *
+ * Text is what serial_parse.py always read. A tag like <setup_total=208158>
+ * is 22 bytes, ~1.9ms at 115200 baud; as a binary record it's 6. Records
+ * are collected in RAM and sent as CRC-checked, COBS-framed frames, so
+ * 0x00 only shows up between frames and the normal text output can stay.
+ * Keys become 19 bit hashes. All names are sent along on the boot after
+ * a power-on, and on the boot after the host asked for them, which it
+ * does when it starts and when it sees an id it has no name for; hosts
+ * that can't ask, e.g. a capture to a file, get them every
+ * TELEMETRY_DICT_EVERY boots. The host keeps the names.
+ */
+
+#include <Arduino.h>
+#include "main.h"
+#include "rtcmem.h"
+#include "telemetry.h"
+
+#define TELEMETRY_RTC_MAGIC 0x7E1F
+#define TELEMETRY_ID_BITS 19
+
+#ifdef TELEMETRY_BINARY
+// in RTC memory, when to send all names
+struct TELEMETRY_RTC_T {
+	uint16_t magic;
+	uint8_t boots;		// since all names were sent
+	uint8_t requested;	// the host asked for them
+};
+
+static TELEMETRY_RTC_T rtc_names;
+static bool send_all = true;
+static uint8_t frame[TELEMETRY_FRAME_MAX];
+static uint8_t frame_len = 0;
+
+/* CRC-16/CCITT, bit by bit; frames are short
+ */
+static uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc) {
+	while (len--) {
+		crc ^= (uint16_t)*data++ << 8;
+		for (uint8_t i = 0; i < 8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	}
+	return crc;
+}
+
+/* Send what's collected as one frame
+ */
+static void frame_flush() {
+	if (!frame_len) return;
+	uint16_t crc = crc16(frame, frame_len, 0xffff);
+	frame[frame_len++] = crc >> 8;
+	frame[frame_len++] = crc & 0xff;
+
+	uint8_t out[TELEMETRY_FRAME_MAX + 3];
+	uint16_t n = 0, code_at = 1;
+	uint8_t code = 1;
+	out[n++] = 0;
+	n++; // code byte of the first block
+	for (uint16_t i = 0; i < frame_len; i++) {
+		if (frame[i]) { out[n++] = frame[i]; code++; }
+		if (!frame[i] || code == 0xff) {
+			out[code_at] = code;
+			code_at = n++;
+			code = 1;
+		}
+	}
+	out[code_at] = code;
+	out[n++] = 0;
+	Serial.write(out, n);
+	frame_len = 0;
+}
+
+/* Little-endian base 128, returns the bytes used
+ */
+static uint8_t put_varint(uint8_t *p, uint32_t v) {
+	uint8_t n = 0;
+	while (v >= 0x80) { p[n++] = (v & 0x7f) | 0x80; v >>= 7; }
+	p[n++] = v;
+	return n;
+}
+
+/* Add a record: tag, a number, then maybe some text; the number is the
+ * text's length if there is text. Starts a new frame if it doesn't fit.
+ */
+static void put_record(uint32_t tag, uint32_t v, const char *text) {
+	uint8_t rec[TELEMETRY_FRAME_MAX - 2];
+	uint8_t n = put_varint(rec, tag);
+	size_t len = 0;
+	if (text) {
+		len = min(strlen(text), (size_t)TELEMETRY_TEXT_MAX);
+		n += put_varint(&rec[n], len);
+		memcpy(&rec[n], text, len);
+		n += len;
+	} else {
+		n += put_varint(&rec[n], v);
+	}
+	if (frame_len + n + 2 > TELEMETRY_FRAME_MAX) frame_flush();
+	memcpy(&frame[frame_len], rec, n);
+	frame_len += n;
+}
+
+/* The key's name, on boots that send them; the record starts with the
+ * field id, then length & name like a text record. A key shown twice
+ * has its name sent twice, that's rare
+ */
+static void put_field(PGM_P key, uint32_t id) {
+	if (!send_all) return;
+	uint8_t rec[TELEMETRY_FRAME_MAX - 2];
+	uint8_t n = put_varint(rec, (TELEMETRY_CTL_FIELD << 2) | TELEMETRY_KIND_CONTROL);
+	n += put_varint(&rec[n], id);
+	size_t len = strnlen_P(key, TELEMETRY_KEY_MAX);
+	n += put_varint(&rec[n], len);
+	memcpy_P(&rec[n], key, len);
+	n += len;
+	if (frame_len + n + 2 > TELEMETRY_FRAME_MAX) frame_flush();
+	memcpy(&frame[frame_len], rec, n);
+	frame_len += n;
+}
+
+/* Whether the host asked for the names since the last look; whatever
+ * else it sent is dropped
+ */
+static bool names_requested() {
+	bool asked = false;
+	while (Serial.available()) asked |= (Serial.read() == TELEMETRY_NAMES_REQUEST);
+	return asked;
+}
+#endif
+
+/* Field id of a key: FNV-1a, folded to TELEMETRY_ID_BITS
+ */
+uint32_t telemetry_id(PGM_P key) {
+	uint32_t h = 2166136261u;
+	for (uint8_t c; (c = pgm_read_byte(key)); key++) { h ^= c; h *= 16777619u; }
+	return (h ^ (h >> TELEMETRY_ID_BITS)) & ((1u << TELEMETRY_ID_BITS) - 1);
+}
+
+/* Start of a boot's tags; in binary mode, see whether the names go
+ * along this time
+ */
+void telemetry_start() {
+#ifdef TELEMETRY_BINARY
+	static_assert(sizeof(TELEMETRY_RTC_T) == RTC_TELEMETRY_BLOCKS * 4, "RTC blocks");
+	ESP.rtcUserMemoryRead(RTC_TELEMETRY_BLOCK, (uint32_t *)&rtc_names, sizeof(rtc_names));
+	send_all = (rtc_names.magic != TELEMETRY_RTC_MAGIC) || rtc_names.requested
+		|| (rtc_names.boots + 1 >= TELEMETRY_DICT_EVERY) || names_requested();
+	rtc_names.magic = TELEMETRY_RTC_MAGIC;
+	rtc_names.boots = send_all ? 0 : rtc_names.boots + 1;
+	rtc_names.requested = false;
+	frame_len = 0;
+	frame_len += put_varint(frame, (TELEMETRY_CTL_START << 2) | TELEMETRY_KIND_CONTROL);
+#else
+	DEBUG_OUT(F("<start>"));
+#endif
+}
+
+/* End of a boot's tags, sends what's left
+ */
+void telemetry_complete() {
+#ifdef TELEMETRY_BINARY
+	if (frame_len + 1 + 2 > TELEMETRY_FRAME_MAX) frame_flush();
+	frame_len += put_varint(&frame[frame_len], (TELEMETRY_CTL_COMPLETE << 2) | TELEMETRY_KIND_CONTROL);
+	frame_flush();
+	rtc_names.requested = names_requested(); // for the next boot
+	ESP.rtcUserMemoryWrite(RTC_TELEMETRY_BLOCK, (uint32_t *)&rtc_names, sizeof(rtc_names));
+#else
+	DEBUG_OUT(F("<complete>"));
+#endif
+}
+
+/* A number, shown as <key=value>
+ */
+void telemetry_value(PGM_P key, int32_t value) {
+#ifdef TELEMETRY_BINARY
+	uint32_t id = telemetry_id(key);
+	put_field(key, id);
+	if (value < 0) put_record((id << 2) | TELEMETRY_KIND_NEGATIVE, (uint32_t)(-1 - value), NULL);
+	else put_record((id << 2) | TELEMETRY_KIND_VALUE, value, NULL);
+#else
+	DEBUG_OUTS('<'); DEBUG_OUTS(FPSTR(key)); DEBUG_OUTS('='); DEBUG_OUTS(value); DEBUG_OUT('>');
+#endif
+}
+
+/* Some text, shown as <key=text>
+ */
+void telemetry_text(PGM_P key, const char *text) {
+#ifdef TELEMETRY_BINARY
+	uint32_t id = telemetry_id(key);
+	put_field(key, id);
+	put_record((id << 2) | TELEMETRY_KIND_TEXT, 0, text);
+#else
+	DEBUG_OUTS('<'); DEBUG_OUTS(FPSTR(key)); DEBUG_OUTS('='); DEBUG_OUTS(text); DEBUG_OUT('>');
+#endif
+}
@@ -0,0 +1,59 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+// build_flags = -DTELEMETRY_BINARY sends the <key=value> tags as binary
+// frames instead; scripts/serial_parse.py decodes both
+//
+// frame:  0x00, COBS(records..., crc16 big-endian), 0x00
+// record: varint(id << 2 | kind), then per kind
+//   0: varint value            1: varint (-1 - value), for negatives
+//   2: varint length, text     3: control, id is one of TELEMETRY_CTL_*
+// varints are little-endian base 128; the crc is CRC-16/CCITT, init
+// 0xffff, over the records; field ids are telemetry_id() of the key
+//
+// host to device: TELEMETRY_NAMES_REQUEST asks for all field names,
+// they come along with the boot's records at the next <start>
+#define TELEMETRY_KIND_VALUE 0
+#define TELEMETRY_KIND_NEGATIVE 1
+#define TELEMETRY_KIND_TEXT 2
+#define TELEMETRY_KIND_CONTROL 3
+#define TELEMETRY_CTL_START 0
+#define TELEMETRY_CTL_COMPLETE 1
+#define TELEMETRY_CTL_FIELD 2 // varint id, varint length, key name
+
+#define TELEMETRY_FRAME_MAX 200 // records are sent once this is full
+#define TELEMETRY_TEXT_MAX 160 // longer text is cut, <strategy=...> is ~120
+#define TELEMETRY_KEY_MAX 32
+#define TELEMETRY_DICT_EVERY 16 // boots between sending all field names again
+#define TELEMETRY_NAMES_REQUEST 0x05
+
+void telemetry_start();
+void telemetry_complete();
+// keys may be in flash: they are only read with the _P functions, which
+// work for RAM as well on the ESP8266
+void telemetry_value(PGM_P key, int32_t value);
+void telemetry_text(PGM_P key, const char *text);
+uint32_t telemetry_id(PGM_P key);
+
+#endif
@@ -26,9 +26,6 @@
 
 /* Display a number with <key=value> format, for timing macros
  */
-void times_display(const char *name, uint32_t micro_count) {
-    DEBUG_OUTS("<"); 
-    DEBUG_OUTS(name); DEBUG_OUTS("=");
-    DEBUG_OUTS(micro_count); 
-    DEBUG_OUT(">");
+void times_display(PGM_P name, uint32_t micro_count) {
+    DEBUG_TAG_P(name, micro_count);
 }
@@ -20,10 +20,14 @@
 #ifndef TIMES_H
 #define TIMES_H
 
-#define TIME_START(timer_id) uint32_t timer_id = micros()
-#define TIME_STOP(timer_id, timer_name_string) times_display(timer_name_string, micros()-timer_id)
+#include "trace.h"
 
-void times_display(const char *name, uint32_t micro_count);
+// spans go to the trace ring, shown by trace_flush() at the end of setup();
+// the names are string literals, kept in flash
+#define TIME_START(timer_id) uint8_t timer_id = trace_start()
+#define TIME_STOP(timer_id, timer_name_string) trace_stop(timer_id, PSTR(timer_name_string))
+
+void times_display(PGM_P name, uint32_t micro_count);
 
 #endif
 
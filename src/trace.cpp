@@ -0,0 +1,153 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Span trace, so timing doesn't measure its own Serial output
+ *
+ * trace_start() and trace_stop() only note ESP.getCycleCount() in a RAM
+ * ring, no printing. Spans are keyed by a one-byte id, the sequence
+ * number of their start, and know the span that was open when they
+ * started. trace_flush() prints them after the timed part. The cycle
+ * counter wraps after 53s at 80MHz and 26.8s at 160MHz; a slow fallback
+ * can take longer than that, so millis() is noted too and used past it.
+ */
+
+#include <Arduino.h>
+#include "main.h"
+#include "times.h"
+#include "trace.h"
+
+static TRACE_SPAN_T trace_ring[TRACE_SPANS];
+static uint8_t trace_next = 0;	// id of the next span
+static uint8_t trace_count = 0;	// spans since trace_begin(), up to TRACE_NONE
+static uint8_t trace_open = TRACE_NONE;
+static uint32_t trace_base = 0;
+static uint32_t trace_base_ms = 0;
+
+/* Time between two points in us, from the cycle counter if it can't have
+ * wrapped in between, else from millis()
+ */
+static uint32_t trace_us(uint32_t cycles, uint32_t ms) {
+	uint32_t mhz = ESP.getCpuFreqMHz();
+	if (ms + 1 < 0xFFFFFFFFUL / 1000 / mhz) return cycles / mhz;
+	return ms * 1000;
+}
+
+/* Forget all spans, times are shown relative to now
+ */
+void trace_begin() {
+	trace_next = 0;
+	trace_count = 0;
+	trace_open = TRACE_NONE;
+	trace_base_ms = millis();
+	trace_base = ESP.getCycleCount();
+}
+
+/* Open a span inside the current one, return its id
+ */
+uint8_t trace_start() {
+	if (trace_count == TRACE_NONE) return TRACE_NONE;
+	uint8_t id = trace_next++;
+	trace_count++;
+	TRACE_SPAN_T *s = &trace_ring[id & (TRACE_SPANS - 1)];
+	s->name = NULL;
+	s->parent = trace_open;
+	trace_open = id;
+	s->start_ms = millis();
+	s->start = ESP.getCycleCount();
+	return id;
+}
+
+/* Close a span; name must be a string in flash, PSTR(), it's only kept
+ * as a pointer
+ */
+void trace_stop(uint8_t id, PGM_P name) {
+	uint32_t now = ESP.getCycleCount(), now_ms = millis();
+	if (id == TRACE_NONE) return;
+	TRACE_SPAN_T *s = &trace_ring[id & (TRACE_SPANS - 1)];
+	s->us = trace_us(now - s->start, now_ms - s->start_ms);
+	s->name = name;
+	trace_open = s->parent;
+}
+
+/* Open a span that doesn't nest, for work that runs in the gaps of
+ * others, see tasks.cpp; it only knows the span open at its start
+ */
+uint8_t trace_start_detached() {
+	uint8_t open = trace_open;
+	uint8_t id = trace_start();
+	trace_open = open;
+	return id;
+}
+
+/* Close it, whatever was opened in the meantime stays open
+ */
+void trace_stop_detached(uint8_t id, PGM_P name) {
+	uint8_t open = trace_open;
+	trace_stop(id, name);
+	trace_open = open;
+}
+
+/* Is this id still in the ring?
+ */
+static bool trace_kept(uint8_t id) {
+	return (id != TRACE_NONE) && ((uint8_t)(trace_next - 1 - id) < TRACE_SPANS)
+		&& ((uint8_t)(trace_next - 1 - id) < trace_count);
+}
+
+/* Time of the last closed span with this name, before trace_flush();
+ * name is in RAM
+ */
+bool trace_find(const char *name, uint32_t *us) {
+	uint8_t kept = trace_count < TRACE_SPANS ? trace_count : TRACE_SPANS;
+	for (uint8_t i = 1; i <= kept; i++) {
+		TRACE_SPAN_T *s = &trace_ring[(uint8_t)(trace_next - i) & (TRACE_SPANS - 1)];
+		if (s->name && !strcmp_P(name, s->name)) {
+			*us = s->us;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Show the closed spans in start order: first as <name=us> like
+ * times_display() did, then as a tree with start offsets
+ */
+void trace_flush() {
+	uint8_t kept = trace_count < TRACE_SPANS ? trace_count : TRACE_SPANS;
+	uint8_t first = trace_next - kept;
+
+	for (uint8_t i = 0; i < kept; i++) {
+		TRACE_SPAN_T *s = &trace_ring[(uint8_t)(first + i) & (TRACE_SPANS - 1)];
+		if (s->name) times_display(s->name, s->us);
+	}
+	for (uint8_t i = 0; i < kept; i++) {
+		uint8_t id = first + i;
+		TRACE_SPAN_T *s = &trace_ring[id & (TRACE_SPANS - 1)];
+		if (!s->name) continue;
+		uint8_t depth = 0;
+		for (uint8_t p = s->parent; trace_kept(p) && (depth < TRACE_SPANS); p = trace_ring[p & (TRACE_SPANS - 1)].parent) depth++;
+		DEBUG_OUTS(F("trace "));
+		for (uint8_t d = 0; d < depth; d++) DEBUG_OUTS(F("  "));
+		DEBUG_OUTS(FPSTR(s->name)); DEBUG_OUTS(F(" @")); DEBUG_OUTS(trace_us(s->start - trace_base, s->start_ms - trace_base_ms));
+		DEBUG_OUTS(F(" +")); DEBUG_OUT(s->us);
+	}
+	DEBUG_TAG("trace_spans", trace_count);
+	if (trace_count > kept) DEBUG_TAG("trace_dropped", trace_count - kept);
+	trace_begin();
+}
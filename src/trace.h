@@ -0,0 +1,46 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// ring of timed spans, only shown by trace_flush() once setup() is done;
+// must be a power of 2, a boot uses about a dozen
+#define TRACE_SPANS 32
+#define TRACE_NONE 0xFF // no parent, or no span
+
+struct TRACE_SPAN_T {
+	PGM_P name;			// set by trace_stop(), NULL while still open
+	uint32_t start;		// ESP.getCycleCount()
+	uint32_t start_ms;	// millis(), for when the cycle counter wrapped
+	uint32_t us;
+	uint8_t parent;		// id of the enclosing span, or TRACE_NONE
+};
+
+void trace_begin();
+uint8_t trace_start();
+void trace_stop(uint8_t id, PGM_P name);
+uint8_t trace_start_detached();
+void trace_stop_detached(uint8_t id, PGM_P name);
+bool trace_find(const char *name, uint32_t *us);
+void trace_flush();
+
+#endif
@@ -0,0 +1,111 @@
+/*
+  Copyright (c) 2022-2022 John Mueller
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+/* Wait for the wifi connection with SDK events instead of polling
+ *
+ * The station event handlers note the exact micros() of each step and
+ * wake the waiting loop with esp_schedule(), so the next phase starts
+ * as soon as the SDK has an IP for us, not at the next poll interval.
+ * Meanwhile the waits step the tasks of tasks.cpp.
+ */
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <coredecls.h>
+
+#include "main.h"
+#include "tasks.h"
+#include "wifievents.h"
+
+#define WAIT_RECHECK 10 // ms, re-check status() in case an event is missed
+
+static WiFiEventHandler h_connected, h_got_ip, h_disconnected;
+static volatile bool ev_got_ip = false;
+static volatile uint32_t ts_begin = 0, ts_connected = 0, ts_got_ip = 0, ts_tcp = 0;
+static volatile int ev_disconnect_reason = 0;
+
+/* Register the station event handlers, once per boot
+ */
+void wifi_events_setup(ESP8266WiFiClass *w) {
+	h_connected = w->onStationModeConnected([](const WiFiEventStationModeConnected &ev) {
+		(void)ev;
+		ts_connected = micros();
+		esp_schedule();
+	});
+	h_got_ip = w->onStationModeGotIP([](const WiFiEventStationModeGotIP &ev) {
+		(void)ev;
+		ts_got_ip = micros();
+		ev_got_ip = true;
+		esp_schedule();
+	});
+	h_disconnected = w->onStationModeDisconnected([](const WiFiEventStationModeDisconnected &ev) {
+		ev_disconnect_reason = ev.reason;
+		esp_schedule();
+	});
+}
+
+/* Start timing a new connection attempt; call just before begin()
+ */
+void wifi_events_begin() {
+	ev_got_ip = false;
+	ev_disconnect_reason = 0;
+	ts_connected = ts_got_ip = ts_tcp = 0;
+	ts_begin = micros();
+}
+
+/* Sleep until we have an IP or the timeout passed, return true if connected
+ */
+int wifi_wait_connected(ESP8266WiFiClass *w, uint32_t timeout_ms) {
+	esp_delay(timeout_ms, [w]() {
+		tasks_poll();
+		return !ev_got_ip && (w->status() != WL_CONNECTED);
+	}, tasks_pending() ? TASKS_POLL_MS : WAIT_RECHECK);
+	return (w->status() == WL_CONNECTED);
+}
+
+/* Like wifi_wait_connected, but give up as soon as the SDK reports a
+ * disconnect, e.g. no AP found; for when there is another AP to try
+ */
+int wifi_wait_attempt(ESP8266WiFiClass *w, uint32_t timeout_ms) {
+	esp_delay(timeout_ms, [w]() {
+		tasks_poll();
+		return !ev_got_ip && !ev_disconnect_reason && (w->status() != WL_CONNECTED);
+	}, tasks_pending() ? TASKS_POLL_MS : WAIT_RECHECK);
+	return (w->status() == WL_CONNECTED);
+}
+
+/* Note when the TCP connection came up
+ */
+void wifi_events_tcp_connected() {
+	ts_tcp = micros();
+}
+
+/* Show the event times of the last attempt, relative to its begin()
+ */
+void wifi_events_display() {
+	if (ts_connected) DEBUG_TAG("ev_connected", ts_connected - ts_begin);
+	if (ts_got_ip) DEBUG_TAG("ev_got_ip", ts_got_ip - ts_begin);
+	if (ev_disconnect_reason) DEBUG_TAG("ev_disconnect_reason", ev_disconnect_reason);
+}
+
+/* Same for the TCP connection, which comes up after the wifi is shown
+ */
+void wifi_events_display_tcp() {
+	if (ts_tcp) DEBUG_TAG("ev_tcp", ts_tcp - ts_begin);
+}
@@ -24,25 +24,36 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h>
+#include <coredecls.h>
+extern "C" {
+#include <user_interface.h>
+}
 
 #include "main.h"
 #include "secrets.h"
+#include "apcache.h"
+#include "histogram.h"
+#include "mqttlite.h"
+#include "rtcmem.h"
 #include "settings.h"
+#include "strategy.h"
+#include "times.h"
+#include "wifievents.h"
 #include "wifistuff.h"
 
 /* Show the current connection information on Serial
  */
 void show_connection(ESP8266WiFiClass *w) {
     #ifdef DEBUG_MODE
-    Serial.print("WiFi Status - State:  "); Serial.println(w->status()); 
-    Serial.print("  IP address:         "); Serial.print(w->localIP());
-    Serial.print("  Gateway IP address: "); Serial.println(w->gatewayIP());
-    Serial.print("  Subnet mask:        "); Serial.println(w->subnetMask());
-    Serial.print("  DNS 0 IP address:   "); Serial.print(w->dnsIP(0));
-    Serial.print("  DNS 1 IP address:   "); Serial.print(w->dnsIP(1));
-    Serial.print("  DNS 2 IP address:   "); Serial.println(w->dnsIP(2));
-    Serial.print("  BSSID:              "); Serial.print(w->BSSIDstr().c_str());
-    Serial.print("  Channel: "); Serial.println(w->channel());
+    Serial.print(F("WiFi Status - State:  ")); Serial.println(w->status()); 
+    Serial.print(F("  IP address:         ")); Serial.print(w->localIP());
+    Serial.print(F("  Gateway IP address: ")); Serial.println(w->gatewayIP());
+    Serial.print(F("  Subnet mask:        ")); Serial.println(w->subnetMask());
+    Serial.print(F("  DNS 0 IP address:   ")); Serial.print(w->dnsIP(0));
+    Serial.print(F("  DNS 1 IP address:   ")); Serial.print(w->dnsIP(1));
+    Serial.print(F("  DNS 2 IP address:   ")); Serial.println(w->dnsIP(2));
+    Serial.print(F("  BSSID:              ")); Serial.print(w->BSSIDstr().c_str());
+    Serial.print(F("  Channel: ")); Serial.println(w->channel());
     #endif
 }
 
@@ -51,74 +62,434 @@ void show_connection(ESP8266WiFiClass *w) {
 int wifi_slow_connect(ESP8266WiFiClass *w) {
 	#define SLOW_TIMEOUT 10000 // ms
 	w->mode(WIFI_STA);
+	wifi_events_begin();
 	w->begin(WIFI_SSID, WIFI_AUTH);
-	uint32_t timeout = millis() + SLOW_TIMEOUT;
-	while ((w->status() != WL_CONNECTED) && (millis()<timeout)) { delay(10); }
-	return (w->status() == WL_CONNECTED);
+	return wifi_wait_connected(w, SLOW_TIMEOUT);
 }
 
 /* To test just reconnecting without building a connection
  */
 int wifi_just_reconnect(ESP8266WiFiClass *w) {
-	uint32_t timeout = millis() + 5000; // max 5s
 	w->mode(WIFI_STA);
+	wifi_events_begin();
 	w->reconnect();
-	while ((w->status() != WL_CONNECTED) && (millis()<timeout)) { delay(10); }
-	return (w->status() == WL_CONNECTED);
+	return wifi_wait_connected(w, 5000); // max 5s
 }
 
-/* Try doing a fast connection, with cached BSSID, channel & persist
+#define FAST_TIMEOUT 5000 // ms
+#define FAST_TIMEOUT_MIN 300 // ms
+#define FAST_HISTO_BASE 32 // ms, first bucket of fast_histo
+#define FAST_HISTO_MIN_SAMPLES 20
+#define FAST_TIMEOUT_PERCENTILE 99
+#define FAST_TIMEOUT_FACTOR 150 // %
+
+/* How long to wait for a fast connection: 1.5x p99 of the earlier fast
+ * connects, which are the ones with the cached AP & begin(); so for
+ * those, or any adaptive strategy. FAST_TIMEOUT for the others, and
+ * until enough fast connects have been counted.
  */
-int wifi_fast_connect(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w) {
-	#define FAST_TIMEOUT 5000 // ms
+uint32_t wifi_fast_timeout(WIFI_SETTINGS_T *data, const STRATEGY_T *strat) {
+	bool cached_begin = (strat->flags & STRAT_CACHED_BEGIN) == STRAT_CACHED_BEGIN;
+	if (!cached_begin && !(strat->flags & STRAT_ADAPTIVE_TIMEOUT)) return FAST_TIMEOUT;
+	if (histo_total(&data->fast_histo) < FAST_HISTO_MIN_SAMPLES) return FAST_TIMEOUT;
+	uint32_t p = histo_percentile(&data->fast_histo, FAST_HISTO_BASE, FAST_TIMEOUT_PERCENTILE);
+	if (p >= FAST_TIMEOUT * 100 / FAST_TIMEOUT_FACTOR) return FAST_TIMEOUT;
+	return max(p * FAST_TIMEOUT_FACTOR / 100, (uint32_t)FAST_TIMEOUT_MIN);
+}
+
+#define FAST_ENTRY_FACTOR 3 // per-AP deadline, times its last connect time
+
+/* One fast connect attempt, to a cached AP if given; with more APs to
+ * try, a disconnect ends it early
+ */
+static int wifi_fast_attempt(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w, const STRATEGY_T *strat,
+		const AP_ENTRY_T *ap, uint32_t timeout, bool more) {
+	int32_t ch = (ap && (strat->flags & STRAT_CHANNEL)) ? ap->channel : 0;
+	const uint8_t *bssid = (ap && (strat->flags & STRAT_BSSID)) ? ap->bssid : NULL;
+	wifi_events_begin();
+	w->begin(settings_str(data, SETTINGS_SSID), settings_str(data, SETTINGS_AUTH), ch, bssid, 
+		(strat->flags & STRAT_BEGIN_CONNECT) != 0);
+	if (strat->flags & STRAT_RECONNECT) w->reconnect();
+	if (strat->flags & STRAT_STATION_CONNECT) wifi_station_connect();
+	if (more) return wifi_wait_attempt(w, timeout);
+	return wifi_wait_connected(w, timeout);
+}
+
+#define RECOVER_CHANNEL_MAX 13
+
+/* Channels to look for the SSID on: the cached APs' first, then the
+ * non-overlapping 1, 6 & 11, then the rest
+ */
+static uint8_t recover_channels(const AP_CACHE_T *c, uint8_t *list) {
+	static const uint8_t common[] = { 1, 6, 11 };
+	uint8_t candidates[AP_CACHE_SIZE + sizeof(common) + RECOVER_CHANNEL_MAX];
+	uint8_t n = 0, count = 0;
+	for (uint8_t i = 0; i < AP_CACHE_SIZE; i++) candidates[n++] = c->ap[i].channel;
+	for (uint8_t i = 0; i < sizeof(common); i++) candidates[n++] = common[i];
+	for (uint8_t ch = 1; ch <= RECOVER_CHANNEL_MAX; ch++) candidates[n++] = ch;
+	for (uint8_t i = 0; i < n; i++) {
+		if (!candidates[i] || candidates[i] > RECOVER_CHANNEL_MAX) continue;
+		if (memchr(list, candidates[i], count)) continue;
+		list[count++] = candidates[i];
+	}
+	return count;
+}
+
+/* None of the cached APs answered where we expected them, e.g. the AP
+ * moved to another channel: scan for our SSID one channel at a time and
+ * stop at the first channel it shows up on, preferring a cached BSSID,
+ * then try the fast connect again with what the scan found. Much cheaper
+ * than the slow connect's full scan & fresh association.
+ */
+static int wifi_fast_recover(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w, const STRATEGY_T *strat,
+		uint32_t timeout) {
+	uint32_t start = millis();
+	uint8_t channels[RECOVER_CHANNEL_MAX];
+	uint8_t count = recover_channels(&data->ap_cache, channels);
+	AP_ENTRY_T found;
+	memset(&found, 0, sizeof(found));
+	bool found_cached = false;
+	uint8_t scans = 0;
+	wifi_station_disconnect(); // leaves the station config alone, unlike disconnect()
+	TIME_START(ts_recover_scan);
+	for (uint8_t i = 0; i < count && !found.channel; i++) {
+		if (scans && millis() - start + FAST_TIMEOUT_MIN > timeout) break;
+		scans++;
+		int8_t n = w->scanNetworks(false, false, channels[i], (uint8_t *)settings_str(data, SETTINGS_SSID));
+		for (int8_t j = 0; j < n; j++) {
+			if (w->SSID(j) != settings_str(data, SETTINGS_SSID)) continue;
+			ap_cache_seen(&data->ap_cache, w->BSSID(j), w->channel(j), w->RSSI(j));
+			bool cached = ap_cache_find(&data->ap_cache, w->BSSID(j)) != NULL;
+			if (found.channel && (found_cached > cached || (found_cached == cached && found.rssi >= w->RSSI(j))))
+				continue;
+			memcpy(found.bssid, w->BSSID(j), 6);
+			found.channel = w->channel(j);
+			found.rssi = constrain(w->RSSI(j), -128, 0);
+			found_cached = cached;
+		}
+		w->scanDelete();
+	}
+	TIME_STOP(ts_recover_scan, "recover_scan");
+	DEBUG_TAG("recover_scans", scans);
+	DEBUG_TAG("recover_channel", found.channel);
+	uint32_t spent = millis() - start;
+	if (!found.channel || spent + FAST_TIMEOUT_MIN > timeout) return false;
+	if (!wifi_fast_attempt(data, w, strat, &found, timeout - spent, false)) {
+		ap_cache_failed(&data->ap_cache, found.bssid);
+		return false;
+	}
+	ap_cache_connected(&data->ap_cache, w->BSSID(), w->channel(), w->RSSI(), 0);
+	return true;
+}
+
+/* Try doing a fast connection with the cached settings the strategy
+ * asks for: BSSID, channel, IP config & persist
+ * With BSSID or channel, the cached APs are tried best first, all within
+ * the fast timeout; the fastest strategy gives each AP a deadline from
+ * its last connect time, the others only move on when an AP fails.
+ * If none of them works, STRAT_RECOVER_SCAN looks for them by channel.
+ */
+int wifi_fast_connect(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w, const STRATEGY_T *strat) {
+	uint32_t timeout = wifi_fast_timeout(data, strat);
+	uint32_t start = millis();
 	// try fast connect
-	w->persistent(true);
+	if (strat->flags & STRAT_PERSISTENT) w->persistent(true);
 	w->mode(WIFI_STA);
-	w->config(IPAddress(data->ip_address),
-		IPAddress(data->ip_gateway), IPAddress(data->ip_mask), 
-		IPAddress(data->ip_dns1), IPAddress(data->ip_dns2));
-	w->begin(data->wifi_ssid, data->wifi_auth, data->wifi_channel, data->wifi_bssid, true);
-	// wait for connection
-	uint32_t timeout = millis() + FAST_TIMEOUT;
-	//wifi_set_channel(ch);
-	//wifi_station_connect();
-	//w->reconnect();
-	while ((w->status() != WL_CONNECTED) && (millis()<timeout)) { delay(10); }
-	if ((w->status() == WL_CONNECTED) && (w->channel() != data->wifi_channel)) {
-		DEBUG_OUT("*** CHANNEL CHANGED *** **************************************");
-		DEBUG_OUTS("Specified: "); DEBUG_OUTS(data->wifi_channel);
-		DEBUG_OUTS(" - received: "); DEBUG_OUT(w->channel());
+	if (strat->flags & STRAT_STATICIP) {
+		w->config(IPAddress(data->ip_address),
+			IPAddress(data->ip_gateway), IPAddress(data->ip_mask), 
+			IPAddress(data->ip_dns1), IPAddress(data->ip_dns2));
+	}
+	AP_ENTRY_T tried[AP_CACHE_SIZE]; // the cache gets re-sorted as we go
+	memcpy(tried, data->ap_cache.ap, sizeof(tried));
+	bool use_cache = (strat->flags & (STRAT_CHANNEL | STRAT_BSSID)) && tried[0].channel;
+	bool cached_begin = (strat->flags & STRAT_CACHED_BEGIN) == STRAT_CACHED_BEGIN;
+	bool recover = use_cache && (strat->flags & STRAT_RECOVER_SCAN);
+	uint8_t count = use_cache ? AP_CACHE_SIZE : 1;
+	uint8_t attempts = 0;
+	int32_t channel = 0;
+	for (uint8_t i = 0; i < count; i++) {
+		const AP_ENTRY_T *ap = use_cache ? &tried[i] : NULL;
+		if (ap && !ap->channel) break;
+		uint32_t spent = millis() - start;
+		if (attempts && spent + FAST_TIMEOUT_MIN > timeout) break;
+		uint32_t deadline = timeout - spent;
+		bool more = ap && (i + 1 < count) && tried[i + 1].channel;
+		if (more && cached_begin && ap->latency_ms) {
+			deadline = min(deadline, max((uint32_t)ap->latency_ms * FAST_ENTRY_FACTOR,
+				(uint32_t)FAST_TIMEOUT_MIN));
+		}
+		uint32_t attempt_start = millis();
+		attempts++;
+		if (ap) channel = ap->channel;
+		DEBUG_TAG("fast_ap", i);
+		if (wifi_fast_attempt(data, w, strat, ap, deadline, more || recover)) {
+			uint32_t took = millis() - attempt_start;
+			if (cached_begin) histo_add(&data->fast_histo, FAST_HISTO_BASE, took);
+			ap_cache_connected(&data->ap_cache, w->BSSID(), w->channel(), w->RSSI(),
+				cached_begin ? took : 0);
+			break;
+		}
+		if (ap) ap_cache_failed(&data->ap_cache, ap->bssid);
+	}
+	if (recover && (w->status() != WL_CONNECTED) && (millis() - start + FAST_TIMEOUT_MIN <= timeout)) {
+		channel = 0; // the scan found the new channel, nothing to show
+		wifi_fast_recover(data, w, strat, timeout - (millis() - start));
+	}
+	DEBUG_TAG("fast_timeout", timeout);
+	DEBUG_TAG("fast_attempts", attempts);
+	if ((w->status() == WL_CONNECTED) && channel && (w->channel() != channel)) {
+		DEBUG_OUT(F("*** CHANNEL CHANGED *** **************************************"));
+		DEBUG_OUTS(F("Specified: ")); DEBUG_OUTS(channel);
+		DEBUG_OUTS(F(" - received: ")); DEBUG_OUT(w->channel());
 		w->printDiag(Serial);
 	}
 	return (w->status() == WL_CONNECTED);
 }
 
+/* The fast connect timed out, but a cached AP was fine after all:
+ * count it as slower than the deadline so the deadline grows
+ */
+void wifi_fast_missed(WIFI_SETTINGS_T *data, const STRATEGY_T *strat) {
+	if ((strat->flags & STRAT_CACHED_BEGIN) != STRAT_CACHED_BEGIN) return;
+	histo_add(&data->fast_histo, FAST_HISTO_BASE, wifi_fast_timeout(data, strat));
+}
+
+#define PROBE_TIMEOUT 4000 // ms, a scan of all channels takes ~2s
+
+/* After the publish, with the radio idle: start a scan for our SSID in
+ * the background, picked up by wifi_probe_finish() before the reboot
+ */
+void wifi_probe_start(void *arg) {
+	WIFI_SETTINGS_T *data = (WIFI_SETTINGS_T *)arg;
+	WiFi.scanNetworks(true, false, 0, (uint8_t *)settings_str(data, SETTINGS_SSID));
+}
+
+static bool probe_saw(int8_t n, const uint8_t *bssid) {
+	for (int8_t i = 0; i < n; i++) {
+		if (!memcmp(WiFi.BSSID(i), bssid, 6)) return true;
+	}
+	return false;
+}
+
+/* Merge what the background scan found into the AP cache: a cached AP
+ * seen on another channel gets the new one, and one not seen in
+ * AP_PROBE_MISSES scans in a row counts as failed, so the next fast
+ * connect tries it last; false if there was nothing to merge
+ */
+bool wifi_probe_finish(WIFI_SETTINGS_T *data) {
+	uint32_t start = millis();
+	int8_t n;
+	while (((n = WiFi.scanComplete()) == WIFI_SCAN_RUNNING) && (millis() - start < PROBE_TIMEOUT)) delay(10);
+	if (n < 0) return false; // not started, or not done in time
+	DEBUG_OUTS(F("AP probe: ")); DEBUG_OUTS(n); DEBUG_OUTS(F(" APs in ")); DEBUG_OUTS(millis() - start); DEBUG_OUT(F("ms"));
+	for (int8_t i = 0; i < n; i++) {
+		if (WiFi.SSID(i) != settings_str(data, SETTINGS_SSID)) continue;
+		AP_ENTRY_T *e = ap_cache_find(&data->ap_cache, WiFi.BSSID(i));
+		if (e && (e->channel != WiFi.channel(i))) {
+			DEBUG_OUTS(F("AP moved to channel ")); DEBUG_OUT(WiFi.channel(i));
+		}
+		ap_cache_seen(&data->ap_cache, WiFi.BSSID(i), WiFi.channel(i), WiFi.RSSI(i));
+	}
+	// a miss can re-sort the cache, so collect them first
+	uint8_t missing[AP_CACHE_SIZE][6];
+	uint8_t missing_count = 0;
+	for (uint8_t i = 0; i < AP_CACHE_SIZE; i++) {
+		const AP_ENTRY_T *e = &data->ap_cache.ap[i];
+		if (e->channel && !probe_saw(n, e->bssid)) memcpy(missing[missing_count++], e->bssid, 6);
+	}
+	for (uint8_t i = 0; i < missing_count; i++) ap_cache_missed(&data->ap_cache, missing[i]);
+	WiFi.scanDelete();
+	ap_cache_display(&data->ap_cache);
+	return true;
+}
+
 /* Connect to this IP address & port; saves MQTT time
+ * connect() itself returns on lwIP's connected callback. A failed one
+ * mostly fails at once (RST from the broker, no route), so wait a little
+ * before sending the next SYN instead of retrying in a tight loop.
  */
 int preconnect_ip(WiFiClient *wclient, IPAddress ip, int port) {
 	#define PRECONNECT_TIMEOUT 5000
+	#define PRECONNECT_RETRY_MS 20
 	uint32_t timeout = millis() + PRECONNECT_TIMEOUT;
-	while ((!wclient->connect(ip, port)) && (millis()<timeout)) { delay(50); }
+	while ((!wclient->connect(ip, port)) && (millis()<timeout)) { delay(PRECONNECT_RETRY_MS); }
+	if (wclient->connected()) wifi_events_tcp_connected();
 	return (wclient->connected());
 }
 
-/* Publish something to our MQTT server
+/* Topic & value of the strategy's extra publishes, i >= 2
+ */
+static void extra_message(uint8_t i, char *topic, char *value) {
+	sprintf(topic, "wled/testing%d", i);
+	sprintf(value, "VALUE%d", i);
+}
+
+static MQTT_LITE_T mqtt_flight;
+
+#define MQTT_OUTBOX_MAGIC 0x0B0C
+#define MQTT_OUTBOX_MAX 3 // PUBLISHes kept; with a new flight, they fit in MQTT_LITE_BUF
+
+// QoS1 PUBLISHes of the last flight that weren't acknowledged, in RTC
+// memory: survives ESP.restart() & deep sleep, not a power loss
+struct MQTT_OUTBOX_T {
+	uint16_t magic;
+	uint8_t len;	// bytes of data used
+	uint8_t count;	// PUBLISHes in it
+	uint32_t crc;
+	uint8_t data[RTC_OUTBOX_BLOCKS * 4 - 8];
+};
+
+static_assert(sizeof(MQTT_OUTBOX_T) <= RTC_OUTBOX_BLOCKS * 4, "MQTT outbox doesn't fit");
+
+static uint8_t outbox_resent = 0;
+static int8_t outbox_kept = -1; // -1: not a QoS1 flight
+
+/* What the last flight left, empty if RTC memory was lost
+ */
+static void outbox_load(MQTT_OUTBOX_T *o) {
+	ESP.rtcUserMemoryRead(RTC_OUTBOX_BLOCK, (uint32_t *)o, sizeof(MQTT_OUTBOX_T));
+	if (o->magic != MQTT_OUTBOX_MAGIC || o->len > sizeof(o->data) || o->crc != crc32(o->data, o->len))
+		o->len = o->count = 0;
+}
+
+/* Keep the flight's QoS1 PUBLISHes that weren't acknowledged; RTC memory
+ * is only written when that changed
+ */
+static void outbox_keep(MQTT_OUTBOX_T *o) {
+	uint8_t data[sizeof(o->data)];
+	uint16_t len = sizeof(data);
+	outbox_kept = mqtt_lite_unacked(&mqtt_flight, data, &len, MQTT_OUTBOX_MAX);
+	if (len == o->len && !memcmp(data, o->data, len)) return;
+	o->magic = MQTT_OUTBOX_MAGIC;
+	o->len = len;
+	o->count = outbox_kept;
+	memcpy(o->data, data, len);
+	o->crc = crc32(o->data, len);
+	ESP.rtcUserMemoryWrite(RTC_OUTBOX_BLOCK, (uint32_t *)o, sizeof(MQTT_OUTBOX_T));
+}
+
+/* QoS1 packet ids go on over reboots, so a persistent session never
+ * sees an id reused soon
+ */
+static void flight_publish(WIFI_SETTINGS_T *data, bool qos1, const char *topic, const char *value) {
+	if (!qos1) { mqtt_lite_publish(&mqtt_flight, topic, value); return; }
+	if (++data->mqtt_packet_id == 0) data->mqtt_packet_id = 1;
+	mqtt_lite_publish_qos1(&mqtt_flight, topic, value, data->mqtt_packet_id);
+}
+
+/* This boot's publishes & the DISCONNECT
+ */
+static void flight_messages(WIFI_SETTINGS_T *data, const STRATEGY_T *strat, bool qos1,
+		const char *topic, const char *value) {
+	DEBUG_OUTS(topic); DEBUG_OUTS(F("="));DEBUG_OUT(value);
+	if (strlen(topic)>1) {
+		flight_publish(data, qos1, topic, value);
+		for (uint8_t i=2; i<=strat->publish_count; i++) {
+			char extra_topic[20], extra_value[10];
+			extra_message(i, extra_topic, extra_value);
+			flight_publish(data, qos1, extra_topic, extra_value);
+		}
+	}
+	mqtt_lite_disconnect(&mqtt_flight);
+}
+
+/* CONNECT, the publishes & DISCONNECT in one write, then wait for the
+ * CONNACK: once the broker accepted the session, QoS0 publishes behind
+ * it went through as well; QoS1 ones are done when all are PUBACKed.
+ * QoS1 ones a previous boot left unacknowledged go out again with DUP
+ * first, but only when the CONNACK says the broker kept the session, so
+ * then the CONNECT goes out alone; without the session they're dropped.
+ */
+static int publish_mqtt_pipelined(WiFiClient *wclient, WIFI_SETTINGS_T *data, const STRATEGY_T *strat,
+		const char *topic, const char *value) {
+	bool qos1 = strat->flags & STRAT_MQTT_QOS1;
+	MQTT_OUTBOX_T outbox;
+	outbox.len = outbox.count = 0;
+	if (qos1) outbox_load(&outbox);
+	if (!wclient->connected()) {
+		int res = (strat->flags & STRAT_MQTT_HOSTNAME)
+			? wclient->connect(settings_str(data, SETTINGS_MQTT_HOST), data->mqtt_host_port)
+			: wclient->connect(data->mqtt_dns.ip, data->mqtt_host_port);
+		if (!res) return false;
+	}
+	mqtt_lite_begin(&mqtt_flight);
+	mqtt_lite_connect(&mqtt_flight, MQTT_CLIENT_ID, settings_str(data, SETTINGS_MQTT_USER),
+		settings_str(data, SETTINGS_MQTT_PASS), !qos1);
+	if (!outbox.len) flight_messages(data, strat, qos1, topic, value);
+	TIME_START(ts_flight);
+	bool sent = mqtt_lite_send(&mqtt_flight, wclient);
+	TIME_STOP(ts_flight, "mqtt_flight");
+	if (!sent) {
+		if (qos1 && !outbox.len) outbox_keep(&outbox);
+		return false;
+	}
+	TIME_START(ts_connack);
+	bool present = false;
+	bool accepted = mqtt_lite_connack(wclient, &present);
+	TIME_STOP(ts_connack, "mqtt_connack");
+	if (outbox.len && accepted) {
+		mqtt_lite_begin(&mqtt_flight);
+		if (present) outbox_resent = mqtt_lite_publish_packets(&mqtt_flight, outbox.data, outbox.len);
+		flight_messages(data, strat, qos1, topic, value);
+		sent = mqtt_lite_send(&mqtt_flight, wclient);
+	}
+	if (!qos1) return accepted;
+	if (!accepted || !sent) {
+		if (!outbox.len) outbox_keep(&outbox); // else the flight has only the CONNECT
+		return false;
+	}
+	TIME_START(ts_acks);
+	bool acked = mqtt_lite_acks(&mqtt_flight, wclient);
+	TIME_STOP(ts_acks, "mqtt_acks");
+	outbox_keep(&outbox);
+	return acked;
+}
+
+/* Show how long each QoS1 publish took to be acknowledged, -1 if never,
+ * and what was resent from & left for the outbox, once the timing is
+ * done; only once per flight
+ */
+void publish_mqtt_display() {
+	if (!mqtt_flight.msg_count) return;
+	for (uint8_t i = 0; i < mqtt_flight.msg_count; i++) {
+		char key[16];
+		snprintf(key, sizeof(key), "mqtt_ack_%u", i + 1);
+		DEBUG_TAG_P(key, mqtt_flight.msg[i].acked ? (int32_t)mqtt_flight.msg[i].ack_us : -1);
+	}
+	DEBUG_TAG("mqtt_retransmits", mqtt_flight.retransmits);
+	if (outbox_kept >= 0) {
+		DEBUG_TAG("mqtt_resent", outbox_resent);
+		DEBUG_TAG("mqtt_outbox", outbox_kept);
+	}
+	outbox_resent = 0;
+	outbox_kept = -1;
+	mqtt_lite_begin(&mqtt_flight);
+}
+
+/* Publish something to our MQTT server, plus the strategy's extra topics
  */
-int publish_mqtt(WiFiClient *wclient, WIFI_SETTINGS_T *data, 
+int publish_mqtt(WiFiClient *wclient, WIFI_SETTINGS_T *data, const STRATEGY_T *strat,
 		const char *topic, const char *value) {
+	if (strat->flags & (STRAT_MQTT_PIPELINE | STRAT_MQTT_QOS1)) return publish_mqtt_pipelined(wclient, data, strat, topic, value);
 	// no timeouts no ragrets
 	PubSubClient mqtt_client(*wclient);
-	mqtt_client.setServer(data->mqtt_host_ip, data->mqtt_host_port);
-	//mqtt_client.setServer(data->mqtt_host_str, data->mqtt_host_port);
+	if (strat->flags & STRAT_MQTT_HOSTNAME) {
+		mqtt_client.setServer(settings_str(data, SETTINGS_MQTT_HOST), data->mqtt_host_port);
+	} else {
+		mqtt_client.setServer(data->mqtt_dns.ip, data->mqtt_host_port);
+	}
 	int status = false;
-	if (mqtt_client.connect(MQTT_CLIENT_ID, data->mqtt_user, data->mqtt_auth)) {
-		DEBUG_OUTS(topic); DEBUG_OUTS("=");DEBUG_OUT(value);
+	if (mqtt_client.connect(MQTT_CLIENT_ID, settings_str(data, SETTINGS_MQTT_USER),
+			settings_str(data, SETTINGS_MQTT_PASS))) {
+		DEBUG_OUTS(topic); DEBUG_OUTS(F("="));DEBUG_OUT(value);
 		if (strlen(topic)>1) {
 			mqtt_client.publish(topic, value);
-			mqtt_client.publish("wled/testing2", "VALUE2");
-			mqtt_client.publish("wled/testing3", "VALUE3");
-			mqtt_client.publish("wled/testing4", "VALUE4");
-			mqtt_client.publish("wled/testing5", "VALUE5");
+			for (uint8_t i=2; i<=strat->publish_count; i++) {
+				char extra_topic[20], extra_value[10];
+				extra_message(i, extra_topic, extra_value);
+				mqtt_client.publish(extra_topic, extra_value);
+			}
 		}
 		status = true;
 	} else {
@@ -23,13 +23,21 @@
 #include <Arduino.h>
 #include <ESP8266WiFi.h>
 
+#include "settings.h"
+#include "strategy.h"
+
 void show_connection(ESP8266WiFiClass *w);
 int wifi_just_reconnect(ESP8266WiFiClass *w);
 int wifi_slow_connect(ESP8266WiFiClass *w);
-int wifi_fast_connect(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w);
+uint32_t wifi_fast_timeout(WIFI_SETTINGS_T *data, const STRATEGY_T *strat);
+int wifi_fast_connect(WIFI_SETTINGS_T *data, ESP8266WiFiClass *w, const STRATEGY_T *strat);
+void wifi_fast_missed(WIFI_SETTINGS_T *data, const STRATEGY_T *strat);
+void wifi_probe_start(void *arg);
+bool wifi_probe_finish(WIFI_SETTINGS_T *data);
 int preconnect_ip(WiFiClient *wclient, IPAddress ip, int port);
-int publish_mqtt(WiFiClient *wclient, WIFI_SETTINGS_T *data, 
+int publish_mqtt(WiFiClient *wclient, WIFI_SETTINGS_T *data, const STRATEGY_T *strat,
     const char *topic, const char *value);
+void publish_mqtt_display();
 
 #endif
 